@@ -26,7 +26,7 @@ if (ENABLE_FFMPEG_AUDIO_DECODE)
         "${current_project_dir}/src/FfmpegAudioDecode.cpp"
     )
 	if (WIN32)
-		target_link_libraries(${CMAKE_PROJECT_NAME} PRIVATE
+		set(ffmpeg_libraries
 			"${extra_obs_prebuilt_deps_dir}/lib/avcodec.lib"
 			"${extra_obs_prebuilt_deps_dir}/lib/avdevice.lib"
 			"${extra_obs_prebuilt_deps_dir}/lib/avfilter.lib"
@@ -37,7 +37,7 @@ if (ENABLE_FFMPEG_AUDIO_DECODE)
 		)
 	endif()
 	if (APPLE)
-		target_link_libraries(${CMAKE_PROJECT_NAME} PRIVATE
+		set(ffmpeg_libraries
 			"${extra_obs_prebuilt_deps_dir}/lib/libavcodec.dylib"
 			"${extra_obs_prebuilt_deps_dir}/lib/libavdevice.dylib"
 			"${extra_obs_prebuilt_deps_dir}/lib/libavfilter.dylib"
@@ -47,8 +47,24 @@ if (ENABLE_FFMPEG_AUDIO_DECODE)
 			"${extra_obs_prebuilt_deps_dir}/lib/libswscale.dylib"
 		)
 	endif()
+	if (UNIX AND NOT APPLE)
+		# distribution packages, the same ones libobs is built against
+		find_package(PkgConfig REQUIRED)
+		pkg_check_modules(FFMPEG REQUIRED IMPORTED_TARGET libavcodec libavformat libavutil)
+		set(ffmpeg_libraries PkgConfig::FFMPEG)
+	endif()
+	target_link_libraries(${CMAKE_PROJECT_NAME} PRIVATE ${ffmpeg_libraries})
 endif()
 
+# links another target, e.g. a tool, against the same FFmpeg as the plugin
+function(target_link_ffmpeg target)
+    target_include_directories(${target} PRIVATE
+        "${extra_obs_deps_dir}/include"
+        "${extra_obs_prebuilt_deps_dir}/include"
+    )
+    target_link_libraries(${target} PRIVATE ${ffmpeg_libraries})
+endfunction()
+
 function(copy_ffmpeg_library target)
     if (WIN32)
         # Define your string array
@@ -0,0 +1,16 @@
+# CMake Linux defaults module
+
+include_guard(GLOBAL)
+
+# Set default installation directories
+include(GNUInstallDirs)
+
+if(CMAKE_INSTALL_LIBDIR MATCHES "(CMAKE_SYSTEM_PROCESSOR)")
+  string(REPLACE "CMAKE_SYSTEM_PROCESSOR" "${CMAKE_SYSTEM_PROCESSOR}" CMAKE_INSTALL_LIBDIR "${CMAKE_INSTALL_LIBDIR}")
+endif()
+
+# Enable find_package targets to become globally available targets
+set(CMAKE_FIND_PACKAGE_TARGETS_GLOBAL TRUE)
+
+# libobs, ALSA and FFmpeg come from the distribution, there is no prebuilt
+# dependency download on Linux
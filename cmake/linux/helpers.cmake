@@ -0,0 +1,71 @@
+# CMake Linux helper functions module
+
+# cmake-format: off
+# cmake-lint: disable=C0103
+# cmake-lint: disable=C0307
+# cmake-format: on
+
+include_guard(GLOBAL)
+
+include(helpers_common)
+
+# set_target_properties_plugin: Set target properties for use in obs-studio
+function(set_target_properties_plugin target)
+  set(options "")
+  set(oneValueArgs "")
+  set(multiValueArgs PROPERTIES)
+  cmake_parse_arguments(PARSE_ARGV 0 _STPO "${options}" "${oneValueArgs}" "${multiValueArgs}")
+
+  message(DEBUG "Setting additional properties for target ${target}...")
+
+  while(_STPO_PROPERTIES)
+    list(POP_FRONT _STPO_PROPERTIES key value)
+    set_property(TARGET ${target} PROPERTY ${key} "${value}")
+  endwhile()
+
+  set_target_properties(
+    ${target}
+    PROPERTIES VERSION 0
+               SOVERSION ${PLUGIN_VERSION}
+               PREFIX "")
+
+  install(
+    TARGETS ${target}
+    LIBRARY DESTINATION "${CMAKE_INSTALL_LIBDIR}/obs-plugins"
+    RUNTIME DESTINATION "${CMAKE_INSTALL_BINDIR}")
+
+  if(TARGET plugin-support)
+    target_link_libraries(${target} PRIVATE plugin-support)
+  endif()
+
+  target_install_resources(${target})
+endfunction()
+
+# target_install_resources: Helper function to add resources into the install tree
+function(target_install_resources target)
+  message(DEBUG "Installing resources for target ${target}...")
+  if(EXISTS "${CMAKE_CURRENT_SOURCE_DIR}/data")
+    file(GLOB_RECURSE data_files "${CMAKE_CURRENT_SOURCE_DIR}/data/*")
+    foreach(data_file IN LISTS data_files)
+      cmake_path(RELATIVE_PATH data_file BASE_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}/data/" OUTPUT_VARIABLE
+                 relative_path)
+      cmake_path(GET relative_path PARENT_PATH relative_path)
+      target_sources(${target} PRIVATE "${data_file}")
+      source_group("Resources/${relative_path}" FILES "${data_file}")
+    endforeach()
+
+    install(
+      DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}/data/"
+      DESTINATION "${CMAKE_INSTALL_DATADIR}/obs/obs-plugins/${target}"
+      USE_SOURCE_PERMISSIONS)
+  endif()
+endfunction()
+
+# target_add_resource: Helper function to add a specific resource to the install tree
+function(target_add_resource target resource)
+  message(DEBUG "Add resource '${resource}' to target ${target} at destination '${target_destination}'...")
+
+  install(FILES "${resource}" DESTINATION "${CMAKE_INSTALL_DATADIR}/obs/obs-plugins/${target}")
+
+  source_group("Resources" FILES "${resource}")
+endfunction()
@@ -0,0 +1,100 @@
+#include "ActionScheduler.hpp"
+
+#include <chrono>
+
+namespace AVerMedia {
+
+const char *action_name(ActionScheduler::Action action)
+{
+    switch (action) {
+    case ActionScheduler::Action::None:
+        return "none";
+    case ActionScheduler::Action::Activate:
+        return "activate";
+    case ActionScheduler::Action::Resume:
+        return "resume";
+    case ActionScheduler::Action::Deactivate:
+        return "deactivate";
+    case ActionScheduler::Action::Shutdown:
+        return "shutdown";
+    }
+    return "unknown";
+}
+
+GraphStep resume_step(const GraphState &graph)
+{
+    if (graph.stale || !graph.device_matches)
+        return GraphStep::Activate;
+    if (graph.in_standby)
+        return GraphStep::LeaveStandby;
+    if (graph.running)
+        return GraphStep::Ungate;
+    return GraphStep::Activate;
+}
+
+GraphStep deactivate_step(const GraphState &graph, bool warm_standby)
+{
+    // an Activate for another device may have been replaced by this one
+    if (warm_standby && graph.running && !graph.stale && graph.device_matches)
+        return GraphStep::EnterStandby;
+    return GraphStep::Deactivate;
+}
+
+ActionScheduler::ActionScheduler(std::function<void()> notify_) : notify(std::move(notify_)) {}
+
+uint64_t ActionScheduler::Post(Action action)
+{
+    uint64_t ticket;
+    bool final;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (shutdown)
+            return latest.load(std::memory_order_relaxed);
+
+        if (pending.action != Action::None)
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+
+        ticket = latest.load(std::memory_order_relaxed) + 1;
+        pending = {action, ticket};
+        final = shutdown = action == Action::Shutdown;
+        latest.store(ticket, std::memory_order_release);
+    }
+
+    if (final)
+        completed_cond.notify_all();
+    if (notify)
+        notify();
+    return ticket;
+}
+
+ActionScheduler::Task ActionScheduler::Take()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Task task = pending;
+    pending = {};
+    return task;
+}
+
+void ActionScheduler::Complete(const Task &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (task.ticket > completed)
+            completed = task.ticket;
+    }
+    completed_cond.notify_all();
+}
+
+bool ActionScheduler::Wait(uint64_t ticket, uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto done = [&] { return completed >= ticket || shutdown; };
+
+    if (timeout_ms == UINT32_MAX) {
+        completed_cond.wait(lock, done);
+        return true;
+    }
+    return completed_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace AVerMedia {
+
+// Hands device control actions from OBS callbacks to a source's worker
+// thread. Only the newest intent is kept: posting while another action is
+// still pending replaces it, and a running action can poll IsSuperseded() to
+// give up early. Shutdown is final, nothing posted after it is run.
+class ActionScheduler
+{
+public:
+    enum class Action {
+        None,
+        Activate,
+        Resume, // activate, but reuse a graph kept in warm standby
+        Deactivate,
+        Shutdown
+    };
+
+    struct Task {
+        Action action = Action::None;
+        uint64_t ticket = 0;
+    };
+
+    // `notify` is called after every post, outside the lock, to wake the
+    // worker (e.g. release a semaphore it waits on together with messages).
+    explicit ActionScheduler(std::function<void()> notify = {});
+
+    uint64_t Post(Action action);
+
+    // Worker side: takes the pending action, Action::None if there is none.
+    Task Take();
+    void Complete(const Task &task);
+
+    // True once anything was posted after `task`, so its work is stale.
+    bool IsSuperseded(const Task &task) const
+    {
+        return latest.load(std::memory_order_acquire) > task.ticket;
+    }
+
+    // Blocks until `ticket`, or an action posted after it, has completed, or
+    // the scheduler was shut down. Returns false on timeout.
+    bool Wait(uint64_t ticket, uint32_t timeout_ms = UINT32_MAX);
+
+    uint64_t CoalescedCount() const { return coalesced.load(std::memory_order_relaxed); }
+
+private:
+    std::function<void()> notify;
+
+    mutable std::mutex mutex;
+    std::condition_variable completed_cond;
+    Task pending;
+    uint64_t completed = 0;
+    bool shutdown = false;
+
+    std::atomic<uint64_t> latest{0};
+    std::atomic<uint64_t> coalesced{0};
+};
+
+const char *action_name(ActionScheduler::Action action);
+
+// What a worker that can keep its graph in warm standby does with a Resume
+// or a Deactivate, kept out of the platform loops so it is testable anywhere.
+struct GraphState {
+    bool running = false;        // a graph was built and started
+    bool in_standby = false;     // running, but its output is gated
+    bool stale = false;          // the device changed while the source was hidden
+    bool device_matches = false; // the graph's device is the one in the settings
+};
+
+enum class GraphStep {
+    Activate,
+    Deactivate,
+    EnterStandby,
+    LeaveStandby,
+    Ungate // the graph already runs for this device, only let its output through
+};
+
+GraphStep resume_step(const GraphState &graph);
+GraphStep deactivate_step(const GraphState &graph, bool warm_standby);
+
+} // namespace AVerMedia
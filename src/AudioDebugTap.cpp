@@ -0,0 +1,296 @@
+#include "AudioDebugTap.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/bmem.h>
+#include <util/util.hpp>
+#include <util/dstr.hpp>
+
+#define TAP_RING_SIZE (1024 * 1024)
+#define TAP_SCRATCH_SIZE (64 * 1024)
+#define TAP_WRITER_INTERVAL_MS 10
+
+#define DEBUG_TAP_RAW "debug_tap_raw"
+#define DEBUG_TAP_BITSTREAM "debug_tap_bitstream"
+#define DEBUG_TAP_PCM "debug_tap_pcm"
+#define DEBUG_TAP_CONTAINER "debug_tap_container"
+
+using namespace AVerMedia;
+
+static const uint8_t w64_riff[16] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11,
+                                     0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t w64_wave[16] = {0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11,
+                                     0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t w64_fmt[16] = {0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11,
+                                    0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t w64_data[16] = {0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11,
+                                     0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+static void put_le16(FILE *file, uint16_t value)
+{
+    uint8_t b[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    fwrite(b, 1, sizeof(b), file);
+}
+
+static void put_le32(FILE *file, uint32_t value)
+{
+    put_le16(file, (uint16_t)value);
+    put_le16(file, (uint16_t)(value >> 16));
+}
+
+static void put_le64(FILE *file, uint64_t value)
+{
+    put_le32(file, (uint32_t)value);
+    put_le32(file, (uint32_t)(value >> 32));
+}
+
+static void put_fmt_body(FILE *file, const AudioDebugTap::Format &format)
+{
+    uint16_t block_align = (uint16_t)(format.channels * format.bits / 8);
+    put_le16(file, format.is_float ? 3 : 1); // WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM
+    put_le16(file, format.channels);
+    put_le32(file, format.sample_rate);
+    put_le32(file, format.sample_rate * block_align);
+    put_le16(file, block_align);
+    put_le16(file, format.bits);
+}
+
+AudioDebugTap::AudioDebugTap(const char *name_) : name(name_) {}
+
+AudioDebugTap::~AudioDebugTap()
+{
+    Stop();
+    bfree(scratch);
+}
+
+bool AudioDebugTap::Start(const std::string &path_, Container container_)
+{
+    if (thread_started)
+        return true;
+
+    file = os_fopen(path_.c_str(), "wb");
+    if (!file) {
+        obs_log(LOG_WARNING, "AudioDebugTap(%s): failed to open %s", name, path_.c_str());
+        return false;
+    }
+
+    if (!ring.IsAllocated())
+        ring.Allocate(TAP_RING_SIZE);
+    if (!scratch) {
+        scratch_size = TAP_SCRATCH_SIZE;
+        scratch = (uint8_t *)bmalloc(scratch_size);
+    }
+
+    path = path_;
+    container = container_;
+    data_bytes = 0;
+    dropped.store(0, std::memory_order_relaxed);
+    stop.store(false, std::memory_order_relaxed);
+    WriteHeader(); // placeholder, patched once the sizes are known
+
+    // nothing is reading the ring right now; leftovers belong to the previous file
+    ring.Skip(ring.Available());
+
+    if (pthread_create(&thread, nullptr, WriterThread, this) != 0) {
+        obs_log(LOG_WARNING, "AudioDebugTap(%s): failed to create writer thread", name);
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    thread_started = true;
+    active.store(true, std::memory_order_release);
+
+    obs_log(LOG_INFO, "AudioDebugTap(%s): writing to %s", name, path.c_str());
+    return true;
+}
+
+void AudioDebugTap::Stop()
+{
+    if (!thread_started)
+        return;
+
+    active.store(false, std::memory_order_release);
+    stop.store(true, std::memory_order_release);
+    pthread_join(thread, nullptr);
+    thread_started = false;
+
+    if (container != Container::Raw) {
+        fseek(file, 0, SEEK_SET);
+        WriteHeader();
+    }
+    fclose(file);
+    file = nullptr;
+    format_set.store(false, std::memory_order_relaxed);
+
+    obs_log(LOG_INFO, "AudioDebugTap(%s): closed %s, %llu bytes, %llu dropped", name, path.c_str(),
+            (unsigned long long)data_bytes, (unsigned long long)Dropped());
+}
+
+void AudioDebugTap::SetFormat(const Format &format_)
+{
+    // first format wins; the header describes one format for the whole file
+    if (format_set.load(std::memory_order_relaxed))
+        return;
+    format = format_;
+    format_set.store(true, std::memory_order_release);
+}
+
+void AudioDebugTap::Write(const void *data, size_t size)
+{
+    if (!IsActive())
+        return;
+    if (!ring.Write(data, size))
+        dropped.fetch_add(size, std::memory_order_relaxed);
+}
+
+void AudioDebugTap::WritePlanar(const uint8_t *const *planes, size_t channels, size_t frames,
+                                size_t bytes_per_sample)
+{
+    if (!IsActive() || channels == 0 || bytes_per_sample == 0)
+        return;
+
+    size_t frame_size = channels * bytes_per_sample;
+    size_t chunk_frames = scratch_size / frame_size;
+    size_t done = 0;
+
+    while (done < frames) {
+        size_t count = frames - done;
+        if (count > chunk_frames)
+            count = chunk_frames;
+
+        uint8_t *out = scratch;
+        for (size_t i = done; i < done + count; i++) {
+            for (size_t ch = 0; ch < channels; ch++) {
+                memcpy(out, planes[ch] + i * bytes_per_sample, bytes_per_sample);
+                out += bytes_per_sample;
+            }
+        }
+        Write(scratch, count * frame_size);
+        done += count;
+    }
+}
+
+void AudioDebugTap::WriteHeader()
+{
+    if (container == Container::Raw)
+        return;
+
+    Format fmt = format_set.load(std::memory_order_acquire) ? format : Format{};
+
+    if (container == Container::Wav) {
+        uint32_t data_size = data_bytes > UINT32_MAX - 36 ? UINT32_MAX - 36 : (uint32_t)data_bytes;
+        fwrite("RIFF", 1, 4, file);
+        put_le32(file, 36 + data_size);
+        fwrite("WAVEfmt ", 1, 8, file);
+        put_le32(file, 16);
+        put_fmt_body(file, fmt);
+        fwrite("data", 1, 4, file);
+        put_le32(file, data_size);
+    } else {
+        // Sony Wave64: GUID chunk ids, 64-bit sizes that include the 24 byte chunk header
+        const uint64_t header_size = 16 + 8 + 16 + (24 + 16) + 24;
+        fwrite(w64_riff, 1, 16, file);
+        put_le64(file, header_size + data_bytes);
+        fwrite(w64_wave, 1, 16, file);
+        fwrite(w64_fmt, 1, 16, file);
+        put_le64(file, 24 + 16);
+        put_fmt_body(file, fmt);
+        fwrite(w64_data, 1, 16, file);
+        put_le64(file, 24 + data_bytes);
+    }
+}
+
+void *AudioDebugTap::WriterThread(void *opaque)
+{
+    auto tap = (AudioDebugTap *)opaque;
+    os_set_thread_name("avt_debug_tap_writer");
+
+    uint8_t buffer[16 * 1024];
+    while (true) {
+        bool stopping = tap->stop.load(std::memory_order_acquire);
+
+        size_t size;
+        while ((size = tap->ring.Read(buffer, sizeof(buffer))) > 0) {
+            fwrite(buffer, 1, size, tap->file);
+            tap->data_bytes += size;
+        }
+
+        if (stopping)
+            break;
+        os_sleep_ms(TAP_WRITER_INTERVAL_MS);
+    }
+    return nullptr;
+}
+
+static std::string make_tap_path(const char *tap_name, AudioDebugTap::Container container)
+{
+    static std::atomic<unsigned int> counter{0};
+
+    const char *ext = container == AudioDebugTap::Container::Wav ? "wav"
+                    : container == AudioDebugTap::Container::W64 ? "w64"
+                                                                 : "bin";
+
+    BPtr<char> dir = obs_module_config_path("taps");
+    os_mkdirs(dir);
+
+    BPtr<char> stamp = os_generate_formatted_filename(ext, false, "%CCYY-%MM-%DD_%hh-%mm-%ss");
+
+    DStr path;
+    dstr_printf(path, "%s/%s-%u-%s", dir.Get(), tap_name, counter++, stamp.Get());
+    return std::string(path->array);
+}
+
+static void update_tap(AudioDebugTap &tap, bool enable, AudioDebugTap::Container container)
+{
+    if (enable && !tap.IsActive()) {
+        tap.Start(make_tap_path(tap.Name(), container), container);
+    } else if (!enable && tap.IsActive()) {
+        tap.Stop();
+    }
+}
+
+void AudioDebugTaps::Update(obs_data_t *settings)
+{
+    auto container = (AudioDebugTap::Container)obs_data_get_int(settings, DEBUG_TAP_CONTAINER);
+    if (container != AudioDebugTap::Container::W64)
+        container = AudioDebugTap::Container::Wav;
+
+    update_tap(raw, obs_data_get_bool(settings, DEBUG_TAP_RAW), container);
+    // the bitstream is not PCM, keep it as-is
+    update_tap(bitstream, obs_data_get_bool(settings, DEBUG_TAP_BITSTREAM),
+               AudioDebugTap::Container::Raw);
+    update_tap(pcm, obs_data_get_bool(settings, DEBUG_TAP_PCM), container);
+}
+
+void AudioDebugTaps::StopAll()
+{
+    raw.Stop();
+    bitstream.Stop();
+    pcm.Stop();
+}
+
+void AudioDebugTaps::GetDefaults(obs_data_t *settings)
+{
+    obs_data_set_default_bool(settings, DEBUG_TAP_RAW, false);
+    obs_data_set_default_bool(settings, DEBUG_TAP_BITSTREAM, false);
+    obs_data_set_default_bool(settings, DEBUG_TAP_PCM, false);
+    obs_data_set_default_int(settings, DEBUG_TAP_CONTAINER, (int)AudioDebugTap::Container::Wav);
+}
+
+void AudioDebugTaps::AddProperties(obs_properties_t *props)
+{
+    obs_properties_t *group = obs_properties_create();
+
+    obs_properties_add_bool(group, DEBUG_TAP_RAW, obs_module_text("DebugTap.Raw"));
+    obs_properties_add_bool(group, DEBUG_TAP_BITSTREAM, obs_module_text("DebugTap.Bitstream"));
+    obs_properties_add_bool(group, DEBUG_TAP_PCM, obs_module_text("DebugTap.Pcm"));
+
+    obs_property_t *container = obs_properties_add_list(group, DEBUG_TAP_CONTAINER,
+                                                        obs_module_text("DebugTap.Container"),
+                                                        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(container, "WAV", (int)AudioDebugTap::Container::Wav);
+    obs_property_list_add_int(container, "W64", (int)AudioDebugTap::Container::W64);
+
+    obs_properties_add_group(props, "debug_taps", obs_module_text("DebugTap"), OBS_GROUP_NORMAL, group);
+}
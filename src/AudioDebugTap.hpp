@@ -0,0 +1,86 @@
+#pragma once
+
+#include <obs.h>
+#include <util/threading.h>
+#include <atomic>
+#include <string>
+
+#include "SpscRing.hpp"
+
+namespace AVerMedia {
+
+// Dumps one point of the audio pipeline to disk without touching the disk on
+// the audio thread. Producers copy into a lock-free ring; a writer thread
+// drains it into a WAV/W64 (or raw) file.
+class AudioDebugTap
+{
+public:
+    enum class Container {
+        Raw,
+        Wav,
+        W64
+    };
+
+    struct Format {
+        uint32_t sample_rate = 0;
+        uint16_t channels = 0;
+        uint16_t bits = 0;
+        bool is_float = false;
+    };
+
+    explicit AudioDebugTap(const char *name);
+    ~AudioDebugTap();
+
+    bool Start(const std::string &path, Container container);
+    void Stop();
+
+    // Producer side, real-time safe. Data is dropped (and counted) when the
+    // writer cannot keep up.
+    bool IsActive() const { return active.load(std::memory_order_acquire); }
+    void SetFormat(const Format &format);
+    void Write(const void *data, size_t size);
+    void WritePlanar(const uint8_t *const *planes, size_t channels, size_t frames,
+                     size_t bytes_per_sample);
+
+    const char *Name() const { return name; }
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    static void *WriterThread(void *opaque);
+    void WriteHeader();
+
+    const char *name;
+    std::string path;
+    Container container = Container::Raw;
+    Format format;
+    std::atomic<bool> format_set{false};
+    std::atomic<bool> active{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> dropped{0};
+
+    SpscRing ring;
+    uint8_t *scratch = nullptr;
+    size_t scratch_size = 0;
+
+    FILE *file = nullptr;
+    uint64_t data_bytes = 0;
+    pthread_t thread;
+    bool thread_started = false;
+};
+
+// The three tap points of a source: raw capture, the bitstream extracted by
+// the demuxer and the decoded PCM.
+struct AudioDebugTaps
+{
+    AudioDebugTap raw{"raw"};
+    AudioDebugTap bitstream{"bitstream"};
+    AudioDebugTap pcm{"pcm"};
+
+    void Update(obs_data_t *settings);
+    void StopAll();
+
+    static void GetDefaults(obs_data_t *settings);
+    static void AddProperties(obs_properties_t *props);
+};
+
+} // namespace AVerMedia
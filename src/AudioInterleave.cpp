@@ -0,0 +1,159 @@
+#include "AudioInterleave.hpp"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define INTERLEAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define INTERLEAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define INTERLEAVE_AVX2_TARGET
+#else
+#define INTERLEAVE_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+/*
+ * All kernels rely on the same trick: on a little-endian CPU an interleaved
+ * stereo pair of int16 is one 32-bit word whose low half is the left sample
+ * and high half the right one. So a pair is just
+ *
+ *     (uint32_t)left >> 16 | (uint32_t)right & 0xFFFF0000
+ *
+ * which keeps exactly the bits `x >> 16` would keep, without any narrowing
+ * or shuffling.
+ */
+
+namespace AVerMedia {
+
+void interleave_s32p_to_s16_scalar(const int32_t *left, const int32_t *right,
+                                   int16_t *out, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        out[i * 2] = (int16_t)(left[i] >> 16);
+        out[i * 2 + 1] = (int16_t)(right[i] >> 16);
+    }
+}
+
+#if defined(INTERLEAVE_NEON)
+
+static void interleave_neon(const int32_t *left, const int32_t *right,
+                            int16_t *out, size_t frames)
+{
+    size_t i = 0;
+    uint32_t *dst = (uint32_t *)out;
+    for (; i + 8 <= frames; i += 8) {
+        uint32x4_t l0 = vld1q_u32((const uint32_t *)left + i);
+        uint32x4_t l1 = vld1q_u32((const uint32_t *)left + i + 4);
+        uint32x4_t r0 = vld1q_u32((const uint32_t *)right + i);
+        uint32x4_t r1 = vld1q_u32((const uint32_t *)right + i + 4);
+        // keep the top half of right, insert left >> 16 below it
+        vst1q_u32(dst + i, vsriq_n_u32(r0, l0, 16));
+        vst1q_u32(dst + i + 4, vsriq_n_u32(r1, l1, 16));
+    }
+    interleave_s32p_to_s16_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+#elif defined(INTERLEAVE_X86)
+
+static void interleave_sse2(const int32_t *left, const int32_t *right,
+                            int16_t *out, size_t frames)
+{
+    const __m128i high = _mm_set1_epi32((int)0xFFFF0000);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(left + i));
+        __m128i r = _mm_loadu_si128((const __m128i *)(right + i));
+        __m128i pair = _mm_or_si128(_mm_srli_epi32(l, 16), _mm_and_si128(r, high));
+        _mm_storeu_si128((__m128i *)(out + i * 2), pair);
+    }
+    interleave_s32p_to_s16_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+INTERLEAVE_AVX2_TARGET
+static void interleave_avx2(const int32_t *left, const int32_t *right,
+                            int16_t *out, size_t frames)
+{
+    const __m256i high = _mm256_set1_epi32((int)0xFFFF0000);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256i l = _mm256_loadu_si256((const __m256i *)(left + i));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(right + i));
+        __m256i pair = _mm256_or_si256(_mm256_srli_epi32(l, 16), _mm256_and_si256(r, high));
+        _mm256_storeu_si256((__m256i *)(out + i * 2), pair);
+    }
+    interleave_s32p_to_s16_scalar(left + i, right + i, out + i * 2, frames - i);
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static interleave_kernel select_kernel()
+{
+#if defined(INTERLEAVE_NEON)
+    return {interleave_neon, "neon"};
+#elif defined(INTERLEAVE_X86)
+    if (cpu_has_avx2())
+        return {interleave_avx2, "avx2"};
+    return {interleave_sse2, "sse2"};
+#else
+    return {interleave_s32p_to_s16_scalar, "scalar"};
+#endif
+}
+
+static const interleave_kernel &kernel()
+{
+    static const interleave_kernel selected = select_kernel();
+    return selected;
+}
+
+void interleave_s32p_to_s16(const int32_t *left, const int32_t *right,
+                            int16_t *out, size_t frames)
+{
+    kernel().proc(left, right, out, frames);
+}
+
+const char *interleave_kernel_name()
+{
+    return kernel().name;
+}
+
+size_t interleave_kernels(interleave_kernel *kernels, size_t max)
+{
+    interleave_kernel all[3];
+    size_t count = 0;
+    all[count++] = {interleave_s32p_to_s16_scalar, "scalar"};
+#if defined(INTERLEAVE_NEON)
+    all[count++] = {interleave_neon, "neon"};
+#elif defined(INTERLEAVE_X86)
+    all[count++] = {interleave_sse2, "sse2"};
+    if (cpu_has_avx2())
+        all[count++] = {interleave_avx2, "avx2"};
+#endif
+
+    for (size_t i = 0; i < count && i < max; i++)
+        kernels[i] = all[i];
+    return count < max ? count : max;
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace AVerMedia {
+
+// Interleaves two planes of 32-bit PCM into 16-bit stereo, keeping the upper
+// 16 bits of every sample. The result is bit-exact with `(int16_t)(x >> 16)`.
+void interleave_s32p_to_s16(const int32_t *left, const int32_t *right,
+                            int16_t *out, size_t frames);
+
+// Plain C++ reference version, always available.
+void interleave_s32p_to_s16_scalar(const int32_t *left, const int32_t *right,
+                                   int16_t *out, size_t frames);
+
+// Name of the kernel picked for this CPU ("neon", "avx2", "sse2" or "scalar").
+const char *interleave_kernel_name();
+
+typedef void (*interleave_proc_t)(const int32_t *, const int32_t *, int16_t *, size_t);
+
+struct interleave_kernel {
+    interleave_proc_t proc;
+    const char *name;
+};
+
+// Every kernel this CPU can run, the scalar one first and the one picked by
+// interleave_s32p_to_s16() last. Returns how many, for tests and benchmarks.
+size_t interleave_kernels(interleave_kernel *kernels, size_t max);
+
+} // namespace AVerMedia
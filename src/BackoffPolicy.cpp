@@ -0,0 +1,32 @@
+#include "BackoffPolicy.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace AVerMedia {
+
+BackoffPolicy::BackoffPolicy(const Config &config_, uint32_t seed) : config(config_), rng(seed)
+{
+    config.multiplier = std::max(config.multiplier, 1.0);
+    config.jitter = std::clamp(config.jitter, 0.0, 1.0);
+    config.max_ms = std::max(config.max_ms, config.initial_ms);
+}
+
+uint32_t BackoffPolicy::NextDelayMs()
+{
+    double delay = (double)config.initial_ms * std::pow(config.multiplier, (double)exponent);
+    delay = std::min(delay, (double)config.max_ms);
+
+    // stop growing the exponent once the cap is reached
+    if (delay < (double)config.max_ms)
+        exponent++;
+    attempts++;
+
+    if (config.jitter > 0.0) {
+        std::uniform_real_distribution<double> spread(1.0 - config.jitter, 1.0 + config.jitter);
+        delay = std::min(delay * spread(rng), (double)config.max_ms);
+    }
+    return (uint32_t)std::lround(delay);
+}
+
+} // namespace AVerMedia
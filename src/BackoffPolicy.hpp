@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+namespace AVerMedia {
+
+// Exponential backoff with jitter for retry loops that are normally woken by
+// an event (e.g. device arrival) and only fall back to polling. The n-th
+// delay is initial * multiplier^n, capped at max, then spread by +/- jitter so
+// several sources do not retry in lockstep.
+class BackoffPolicy
+{
+public:
+    struct Config {
+        uint32_t initial_ms = 100;
+        uint32_t max_ms = 30000;
+        double multiplier = 2.0;
+        double jitter = 0.2; // fraction of the delay, 0 disables
+    };
+
+    BackoffPolicy() : BackoffPolicy(Config{}) {}
+    explicit BackoffPolicy(const Config &config, uint32_t seed = std::random_device{}());
+
+    // Delay before the next attempt; advances the attempt counter.
+    uint32_t NextDelayMs();
+    void Reset()
+    {
+        exponent = 0;
+        attempts = 0;
+    }
+    // Delays handed out since the last Reset(), also past the cap.
+    uint32_t Attempts() const { return attempts; }
+
+private:
+    Config config;
+    uint32_t exponent = 0; // stops growing at the cap
+    uint32_t attempts = 0;
+    std::minstd_rand rng;
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,138 @@
+#include "CaptureSession.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace AVerMedia {
+
+void CaptureSession::Output(uint64_t from_generation, const struct obs_source_audio *audio)
+{
+    outputs.fetch_add(1);
+    if (from_generation == generation.load()) {
+        for (const Member &member : *Load())
+            member.sink(audio);
+    }
+    outputs.fetch_sub(1);
+}
+
+size_t CaptureSession::MemberCount() const
+{
+    outputs.fetch_add(1);
+    size_t count = Load()->size();
+    outputs.fetch_sub(1);
+    return count;
+}
+
+void CaptureSession::Publish(std::unique_ptr<const Members> next)
+{
+    // both sides are sequentially consistent: an Output() that counted
+    // itself after this exchange reads the new list
+    std::unique_ptr<const Members> old(members.exchange(next.release()));
+    // an Output() that started before may still read the old list; sinks
+    // hand one buffer to OBS, so this spins briefly
+    while (outputs.load() != 0)
+        std::this_thread::yield();
+}
+
+CaptureSessionRegistry::Membership CaptureSessionRegistry::Join(const std::string &device_key,
+                                                                const void *id,
+                                                                CaptureSession::Sink sink,
+                                                                std::function<void()> promote)
+{
+    std::string key = device_key.empty() ? "#" + std::to_string((uintptr_t)id) : device_key;
+
+    bool moved;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = member_keys.find(id);
+        moved = it != member_keys.end() && it->second != key;
+    }
+    if (moved)
+        Leave(id);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<CaptureSession> &session = sessions[key];
+    if (!session)
+        session = std::make_shared<CaptureSession>(key);
+    member_keys[id] = key;
+
+    Membership membership;
+    membership.session = session;
+
+    auto members = std::make_unique<CaptureSession::Members>(*session->Load());
+    auto member = std::find_if(members->begin(), members->end(),
+                               [id](const CaptureSession::Member &m) { return m.id == id; });
+    if (member != members->end()) {
+        member->sink = std::move(sink);
+        member->promote = std::move(promote);
+    } else {
+        members->push_back({id, std::move(sink), std::move(promote)});
+        if (members->size() > 1)
+            obs_log(LOG_INFO, "CaptureSession: %zu sources share %s", members->size(),
+                    key.c_str());
+    }
+
+    membership.leader = members->front().id == id;
+    membership.generation = session->generation;
+    session->Publish(std::move(members));
+    return membership;
+}
+
+void CaptureSessionRegistry::Leave(const void *id)
+{
+    std::lock_guard<std::recursive_mutex> promote_lock(promote_mutex);
+    std::function<void()> promote;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = member_keys.find(id);
+        if (it == member_keys.end())
+            return;
+
+        auto session_it = sessions.find(it->second);
+        member_keys.erase(it);
+        if (session_it == sessions.end())
+            return;
+
+        // outlives the lock below even if the session is erased
+        std::shared_ptr<CaptureSession> keep = session_it->second;
+        CaptureSession &session = *keep;
+        auto members = std::make_unique<CaptureSession::Members>(*session.Load());
+        auto member = std::find_if(members->begin(), members->end(),
+                                   [id](const CaptureSession::Member &m) { return m.id == id; });
+        if (member == members->end())
+            return;
+
+        bool wasLeader = member == members->begin();
+        members->erase(member);
+
+        if (members->empty()) {
+            sessions.erase(session_it);
+        } else if (wasLeader) {
+            session.generation++;
+            promote = members->front().promote;
+            obs_log(LOG_INFO, "CaptureSession: leader of %s left, handing over capture",
+                    session.key.c_str());
+        }
+        session.Publish(std::move(members));
+    }
+
+    if (promote)
+        promote();
+}
+
+size_t CaptureSessionRegistry::SessionCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.size();
+}
+
+CaptureSessionRegistry &GetCaptureSessionRegistry()
+{
+    static CaptureSessionRegistry registry;
+    return registry;
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <obs.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AVerMedia {
+
+// One capture and decode pipeline shared by every source that uses the same
+// device. The first member is the leader: it runs the capture and hands each
+// buffer to Output(), which fans it out to all members. The member list is
+// copied on every change and swapped in whole, so Output() never locks; the
+// old list is freed once no Output() can still be reading it.
+class CaptureSession
+{
+public:
+    using Sink = std::function<void(const struct obs_source_audio *)>;
+
+    explicit CaptureSession(std::string key) : key(std::move(key)) {}
+    ~CaptureSession() { delete members.load(); }
+
+    CaptureSession(const CaptureSession &) = delete;
+    CaptureSession &operator=(const CaptureSession &) = delete;
+
+    const std::string &Key() const { return key; }
+
+    // `generation` is the one the leader got from Join(). Buffers from a
+    // leader that has since been replaced are dropped, so a pipeline that is
+    // still shutting down never duplicates the new leader's audio.
+    void Output(uint64_t generation, const struct obs_source_audio *audio);
+
+    size_t MemberCount() const;
+
+private:
+    friend class CaptureSessionRegistry;
+
+    struct Member {
+        const void *id;
+        Sink sink;
+        std::function<void()> promote;
+    };
+    using Members = std::vector<Member>;
+
+    // Only valid under the registry's mutex or inside an Output() count.
+    const Members *Load() const { return members.load(); }
+    // Swaps in `next` and frees the old list once no Output() uses it.
+    void Publish(std::unique_ptr<const Members> next);
+
+    const std::string key;
+    // front() is the leader; written under the registry's mutex only
+    std::atomic<const Members *> members{new Members()};
+    std::atomic<uint64_t> generation{0};
+    mutable std::atomic<int> outputs{0}; // Output() and MemberCount() calls in progress
+};
+
+// Refcounted sessions keyed by device identity. A session lives as long as
+// it has members.
+class CaptureSessionRegistry
+{
+public:
+    struct Membership {
+        std::shared_ptr<CaptureSession> session;
+        bool leader = false;
+        uint64_t generation = 0;
+    };
+
+    // Adds `id` to the session of `key`, leaving any session of another key
+    // first. Joining again with the same key keeps the current role. An
+    // empty key never shares. Only the leader should capture; everyone else
+    // receives the leader's audio through `sink`.
+    //
+    // `promote` runs when the leader leaves and `id` takes over. It is
+    // called from the leaving thread and should only schedule work; it may
+    // call Join() and Leave().
+    Membership Join(const std::string &key, const void *id, CaptureSession::Sink sink,
+                    std::function<void()> promote);
+
+    // After this returns, `id`'s sink is not called again and its promote
+    // callback is not running. Must not be called from a sink.
+    void Leave(const void *id);
+
+    size_t SessionCount();
+
+private:
+    std::recursive_mutex promote_mutex; // taken before `mutex`, again from a promote callback
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<CaptureSession>> sessions;
+    std::unordered_map<const void *, std::string> member_keys;
+};
+
+// Process-wide registry shared by all AVerMedia sources.
+CaptureSessionRegistry &GetCaptureSessionRegistry();
+
+} // namespace AVerMedia
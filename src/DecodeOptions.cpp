@@ -0,0 +1,110 @@
+#include "DecodeOptions.hpp"
+
+#include <obs-module.h>
+#include <cstring>
+
+#define DECODE_THREAD_PRIORITY "decode_thread_priority"
+#define DECODE_CPU_AFFINITY "decode_cpu_affinity"
+#define DECODE_IDLE_OUTPUT "decode_idle_output"
+#define DECODE_PROFILE "decode_profile"
+#define DECODE_INLINE "decode_inline"
+
+enum IdleOutput { IDLE_OUTPUT_SILENCE = 0, IDLE_OUTPUT_NOTHING = 1 };
+
+using namespace AVerMedia;
+
+static const char *profile_names[] = {"quality", "balanced", "low-cpu"};
+
+const char *AVerMedia::decode_profile_name(DecodeProfile profile)
+{
+    size_t index = (size_t)profile;
+    return index < sizeof(profile_names) / sizeof(profile_names[0]) ? profile_names[index] : "unknown";
+}
+
+bool AVerMedia::parse_decode_profile(const char *name, DecodeProfile &profile)
+{
+    for (size_t i = 0; i < sizeof(profile_names) / sizeof(profile_names[0]); i++) {
+        if (strcmp(name, profile_names[i]) == 0) {
+            profile = (DecodeProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+DecodeOptions DecodeOptions::FromSettings(obs_data_t *settings)
+{
+    DecodeOptions options;
+
+    long long priority = obs_data_get_int(settings, DECODE_THREAD_PRIORITY);
+    if (priority >= (long long)ThreadPriority::Normal &&
+        priority <= (long long)ThreadPriority::RealtimeFifo) {
+        options.thread_priority = (ThreadPriority)priority;
+    }
+
+    options.cpu_list = obs_data_get_string(settings, DECODE_CPU_AFFINITY);
+    options.cpu_affinity = parse_cpu_list(options.cpu_list);
+    options.idle_silence = obs_data_get_int(settings, DECODE_IDLE_OUTPUT) != IDLE_OUTPUT_NOTHING;
+
+    long long profile = obs_data_get_int(settings, DECODE_PROFILE);
+    if (profile >= (long long)DecodeProfile::Quality && profile <= (long long)DecodeProfile::LowCpu) {
+        options.profile = (DecodeProfile)profile;
+    }
+    options.inline_decode = obs_data_get_bool(settings, DECODE_INLINE);
+    return options;
+}
+
+void DecodeOptions::GetDefaults(obs_data_t *settings)
+{
+    obs_data_set_default_int(settings, DECODE_THREAD_PRIORITY, (int)ThreadPriority::Normal);
+    obs_data_set_default_string(settings, DECODE_CPU_AFFINITY, "");
+    obs_data_set_default_int(settings, DECODE_IDLE_OUTPUT, IDLE_OUTPUT_SILENCE);
+    obs_data_set_default_int(settings, DECODE_PROFILE, (int)DecodeProfile::Quality);
+    obs_data_set_default_bool(settings, DECODE_INLINE, false);
+}
+
+void DecodeOptions::AddProperties(obs_properties_t *props)
+{
+    obs_properties_t *group = obs_properties_create();
+
+    obs_property_t *profile = obs_properties_add_list(group, DECODE_PROFILE,
+                                                      obs_module_text("Decode.Profile"),
+                                                      OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(profile, obs_module_text("Decode.Profile.Quality"),
+                              (int)DecodeProfile::Quality);
+    obs_property_list_add_int(profile, obs_module_text("Decode.Profile.Balanced"),
+                              (int)DecodeProfile::Balanced);
+    obs_property_list_add_int(profile, obs_module_text("Decode.Profile.LowCpu"),
+                              (int)DecodeProfile::LowCpu);
+    obs_property_set_long_description(profile, obs_module_text("Decode.Profile.Description"));
+
+    obs_property_t *inline_decode =
+        obs_properties_add_bool(group, DECODE_INLINE, obs_module_text("Decode.Inline"));
+    obs_property_set_long_description(inline_decode, obs_module_text("Decode.Inline.Description"));
+
+    obs_property_t *priority = obs_properties_add_list(group, DECODE_THREAD_PRIORITY,
+                                                       obs_module_text("Decode.ThreadPriority"),
+                                                       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(priority, obs_module_text("Decode.ThreadPriority.Normal"),
+                              (int)ThreadPriority::Normal);
+    obs_property_list_add_int(priority, obs_module_text("Decode.ThreadPriority.High"),
+                              (int)ThreadPriority::High);
+    obs_property_list_add_int(priority, obs_module_text("Decode.ThreadPriority.RealtimeRR"),
+                              (int)ThreadPriority::RealtimeRR);
+    obs_property_list_add_int(priority, obs_module_text("Decode.ThreadPriority.RealtimeFifo"),
+                              (int)ThreadPriority::RealtimeFifo);
+
+    obs_property_t *affinity = obs_properties_add_text(group, DECODE_CPU_AFFINITY,
+                                                       obs_module_text("Decode.CpuAffinity"),
+                                                       OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(affinity, obs_module_text("Decode.CpuAffinity.Description"));
+
+    obs_property_t *idle = obs_properties_add_list(group, DECODE_IDLE_OUTPUT,
+                                                   obs_module_text("Decode.IdleOutput"),
+                                                   OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+    obs_property_list_add_int(idle, obs_module_text("Decode.IdleOutput.Silence"), IDLE_OUTPUT_SILENCE);
+    obs_property_list_add_int(idle, obs_module_text("Decode.IdleOutput.Nothing"), IDLE_OUTPUT_NOTHING);
+    obs_property_set_long_description(idle, obs_module_text("Decode.IdleOutput.Description"));
+
+    obs_properties_add_group(props, "decode", obs_module_text("Decode"), OBS_GROUP_NORMAL, group);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <obs.h>
+#include <cstdint>
+#include <string>
+
+#include "ThreadTuning.hpp"
+
+namespace AVerMedia {
+
+// Trade-off between decoding cost and fidelity, mapped to an FFmpeg decoder
+// and its options when the stream is opened.
+enum class DecodeProfile {
+    Quality = 0,  // default decoders, everything decoded
+    Balanced = 1, // no DRC processing, DTS core only (skips XLL/XBR/X96)
+    LowCpu = 2,   // as Balanced, AC-3 through the fixed-point decoder
+};
+
+const char *decode_profile_name(DecodeProfile profile);
+// Accepts the names above ("quality", "balanced", "low-cpu").
+bool parse_decode_profile(const char *name, DecodeProfile &profile);
+
+// Per-source settings of the FFmpeg decode pipeline, shared by all source types.
+struct DecodeOptions
+{
+    ThreadPriority thread_priority = ThreadPriority::Normal;
+    std::string cpu_list; // e.g. "2,3" or "4-7", empty for any CPU
+    uint64_t cpu_affinity = 0;
+    // what null and pause bursts (an idle source) turn into: silence of the
+    // same duration, or no audio at all
+    bool idle_silence = true;
+    DecodeProfile profile = DecodeProfile::Quality;
+    // Parse and decode bursts on the capture thread, for the lowest latency
+    // with a single source. Falls back to the decode thread when it takes
+    // too long.
+    bool inline_decode = false;
+
+    // Set by the source, not a setting: identifies the capture device for the
+    // stream parameter cache (encoded DirectShow id or CoreAudio UID).
+    std::string device_key;
+
+    static DecodeOptions FromSettings(obs_data_t *settings);
+    static void GetDefaults(obs_data_t *settings);
+    static void AddProperties(obs_properties_t *props);
+
+    bool SameThreadTuning(const DecodeOptions &other) const
+    {
+        return thread_priority == other.thread_priority && cpu_affinity == other.cpu_affinity;
+    }
+    bool SameDecoder(const DecodeOptions &other) const
+    {
+        return profile == other.profile && inline_decode == other.inline_decode;
+    }
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,103 @@
+#include "DeviceRegistry.hpp"
+
+#include <obs.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <chrono>
+
+namespace AVerMedia {
+
+DeviceRegistry::DeviceRegistry(Enumerator enumerator_, uint32_t debounce_ms_)
+    : enumerator(std::move(enumerator_)),
+      debounce_ms(debounce_ms_),
+      snapshot(std::make_shared<const DeviceList>())
+{
+}
+
+DeviceRegistry::~DeviceRegistry()
+{
+    Stop();
+}
+
+void DeviceRegistry::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable())
+        return;
+
+    stopping = false;
+    dirty = true;
+    worker = std::thread(&DeviceRegistry::Loop, this);
+}
+
+void DeviceRegistry::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable())
+            return;
+        stopping = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+void DeviceRegistry::Invalidate()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dirty = true;
+    }
+    cond.notify_all();
+}
+
+std::shared_ptr<const DeviceList> DeviceRegistry::Snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return snapshot;
+}
+
+uint64_t DeviceRegistry::Generation() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return generation;
+}
+
+void DeviceRegistry::Loop()
+{
+    os_set_thread_name("AVerMedia device registry");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    bool first = true;
+
+    while (true) {
+        cond.wait(lock, [this] { return stopping || dirty; });
+        if (stopping)
+            break;
+
+        // a hotplug usually fires several notifications, let them settle
+        if (!first) {
+            cond.wait_for(lock, std::chrono::milliseconds(debounce_ms),
+                          [this] { return stopping; });
+            if (stopping)
+                break;
+        }
+        first = false;
+        dirty = false;
+
+        lock.unlock();
+        uint64_t start = os_gettime_ns();
+        auto devices = std::make_shared<const DeviceList>(enumerator());
+        uint64_t elapsed_ms = (os_gettime_ns() - start) / 1000000;
+        lock.lock();
+
+        snapshot = std::move(devices);
+        generation++;
+        obs_log(LOG_DEBUG, "DeviceRegistry: %zu devices, scan took %llu ms",
+                snapshot->size(), (unsigned long long)elapsed_ms);
+    }
+}
+
+} // namespace AVerMedia
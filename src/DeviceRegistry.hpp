@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace AVerMedia {
+
+struct DeviceEntry {
+    std::string id;   // value stored in the source settings
+    std::string name; // display name
+};
+
+using DeviceList = std::vector<DeviceEntry>;
+
+// Process-wide cache of capture devices. The OS enumeration runs on a worker
+// thread; property callbacks only take the latest snapshot and never wait for
+// a scan. Hotplug notifications call Invalidate(), bursts are coalesced into a
+// single rescan.
+class DeviceRegistry
+{
+public:
+    using Enumerator = std::function<DeviceList()>;
+
+    explicit DeviceRegistry(Enumerator enumerator, uint32_t debounce_ms = 250);
+    ~DeviceRegistry();
+
+    void Start();
+    void Stop();
+
+    // Safe to call from any thread, including OS notification callbacks.
+    void Invalidate();
+
+    std::shared_ptr<const DeviceList> Snapshot() const;
+
+    // Incremented after every completed scan, 0 until the first one.
+    uint64_t Generation() const;
+
+private:
+    void Loop();
+
+    Enumerator enumerator;
+    uint32_t debounce_ms;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::shared_ptr<const DeviceList> snapshot;
+    uint64_t generation = 0;
+    bool dirty = false;
+    bool stopping = false;
+    std::thread worker;
+};
+
+} // namespace AVerMedia
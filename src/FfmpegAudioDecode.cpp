@@ -1,9 +1,21 @@
 #include "FfmpegAudioDecode.hpp"
+#include "AudioDebugTap.hpp"
+#include "RealtimeCheck.hpp"
+#include "SpscRing.hpp"
+#include "StreamParamCache.hpp"
+#include "OutputGate.hpp"
+#include "LatencyHistogram.hpp"
+#include "PipelineTrace.hpp"
+#include "Iec61937.hpp"
+#include "BackoffPolicy.hpp"
 
 #include <plugin-support.h>
 #include <util/threading.h>
-#include <util/deque.h>
 #include <util/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -14,20 +26,174 @@ extern "C" {
 #include <util/dstr.hpp>
 
 #define AVIO_BUFFER_SIZE 2560
-//#define COPY_AUDIO_DATA 1
+#define PACKET_RING_SIZE (1024 * 1024) // about 5 s of 48 kHz 16-bit stereo
+#define CPU_REPORT_INTERVAL_NS (60 * 1000000000ULL)
+#define DATA_WAIT_TIMEOUT_MS 100 // only a safety net, the capture thread wakes us
+#define IDLE_HOLD_MS 128         // longest burst repetition period in use (E-AC-3)
+#define SILENCE_CHUNK_FRAMES 1024
+#define SILENCE_BUFFER_SIZE (SILENCE_CHUNK_FRAMES * MAX_AUDIO_CHANNELS * sizeof(float))
+#define INLINE_BUDGET_PERCENT 50    // of the audio duration handed over per call
+#define INLINE_BUDGET_WINDOW 64     // calls
+#define INLINE_OVER_BUDGET_LIMIT 4  // calls over budget in a window before falling back
+#define PROBE_RETRIES 3             // failed probes in a row before backing off
+#define DEGRADED_AFTER_ERRORS 4     // packets failing in a row
+#define BACKOFF_AFTER_ERRORS 64     // packets failing in a row, degraded
+#define CODEC_CACHE_SIZE 3          // codecs a console moves between: menus, games, films
+#define CODEC_MARK_RING_SIZE 1024
+#define TIME_MARK_RING_SIZE (1024 * sizeof(TimeMark))
+#define GATE_SCAN_SIZE 4096         // stuffing looked at per step
+#define GATE_BUFFER_SIZE (IEC61937_MAX_PAYLOAD + 8) // a whole burst
 
 using namespace AVerMedia;
 
+// Decoders kept open per codec ID, so a codec change mid-stream swaps the
+// context instead of opening one. Owned by the thread that decodes.
+struct CodecCache
+{
+    struct Entry {
+        AVCodecContext *context = nullptr;
+        DecodeProfile profile = DecodeProfile::Quality;
+        uint64_t used = 0;
+    };
+    Entry entries[CODEC_CACHE_SIZE];
+    uint64_t uses = 0;
+};
+
+// Audio burst of a different data type than the one before it, at
+// `position` in the packet queue. Capture thread -> decode thread.
+struct CodecMark
+{
+    uint64_t position;
+    uint16_t type;
+};
+
+// Producer timestamp of the byte at `position` in the packet queue, see
+// OnEncodedAudioData(). Capture thread -> decode thread.
+struct TimeMark
+{
+    uint64_t position;
+    uint64_t timestamp_ns;
+};
+
+// Decoding on the capture thread, without the packet queue, the demuxer and
+// the decode thread. Owned by the capture thread while active.
+struct InlineDecode
+{
+    Iec61937Parser parser;
+    AVCodecContext *codec = nullptr;
+    uint16_t type = 0; // burst type `codec` was opened for
+    CodecCache codecs; // the ones not in use
+    DecodeProfile opened_profile = DecodeProfile::Quality;
+    std::atomic<DecodeProfile> profile{DecodeProfile::Quality};
+    std::atomic<bool> reset{false};
+    AVPacket *packet = nullptr;
+    AVFrame *frame = nullptr;
+    uint64_t clock_ns = 0;    // producer time at the end of the current call, 0 without
+    uint32_t calls = 0;       // in the current budget window
+    uint32_t over_budget = 0;
+    uint64_t worst_ns = 0;    // slowest call of the window
+    std::atomic<uint64_t> bursts{0};
+};
+
 struct AVerMedia::ffmpeg_decode
 {
     pthread_t thread;
-    struct deque packets;
-    pthread_mutex_t mutex;
+    // capture thread -> decode thread, never locks or allocates on the producer side
+    SpscRing packets{PACKET_RING_SIZE};
+    std::atomic<bool> flush{false};
+    std::atomic<uint64_t> dropped{0};
+    os_event_t *data_event = nullptr;       // packets, idle frames or a state change
+    std::atomic<bool> consumer_waiting{false};
+    // codec changes in `packets`; the decode thread ends the demuxer's stream
+    // at the first burst of a new codec and swaps in a decoder for it
+    SpscRing codec_marks{CODEC_MARK_RING_SIZE};
+    CodecMark mark = {};      // decode thread, next one when `mark_pending`
+    bool mark_pending = false;
+    bool switch_due = false;  // the demuxer stopped at `switch_type`
+    uint16_t switch_type = 0;
+    CodecCache codecs;        // decode thread, decoders not in use
+    std::atomic<uint64_t> codec_switches{0};
+    // producer timestamps in `packets`; the decode thread times its output
+    // with them instead of the time of arrival
+    SpscRing time_marks{TIME_MARK_RING_SIZE};
+    TimeMark time_mark = {};  // decode thread, the latest one passed
+    TimeMark time_next = {};  // decode thread, next one when `time_pending`
+    bool time_pending = false;
+    bool clock_captured = false; // the thread that decodes, see ffmpeg_clock()
+
+    // burst check between the queue and the demuxer, see iec61937_check();
+    // decode thread only
+    uint8_t *gate_buffer = nullptr; // GATE_BUFFER_SIZE, peeked from `packets`
+    size_t gate_pass = 0;    // checked bytes not yet handed to the demuxer
+    size_t gate_pad = 0;     // zeros to hand over before them
+    size_t demux_skip = 0;   // stuffing the demuxer skips after the last burst
+    uint16_t gate_type = 0;  // data type of the last burst handed over
+
+    // lost bursts: link frames not yet answered with silence, and the
+    // resync in progress; the thread that decodes owns `resync_begin`
+    std::atomic<uint64_t> conceal_frames{0};
+    uint64_t resync_begin = 0;
+    uint64_t resync_lost = 0; // bursts lost in the resync in progress
+    std::atomic<uint64_t> resyncs{0};
+    std::atomic<uint64_t> lost_bursts{0};
+    std::atomic<uint64_t> lost_frames{0}; // link frames
+    std::atomic<uint32_t> resync_ms{0};
+    std::atomic<uint32_t> resync_ms_max{0};
+
+    // null/pause burst filter, used by the capture thread only
+    Iec61937BurstFilter bursts;
+    uint32_t filter_rate = 0;
+    std::atomic<bool> filter_reset{false};
+    std::atomic<uint32_t> input_rate{48000};
+    // link frames of null/pause bursts not yet answered with silence
+    std::atomic<uint64_t> idle_frames{0};
+    std::atomic<uint64_t> idle_frames_total{0};
+    std::atomic<bool> idle_silence{true};
+    uint64_t silence_remainder = 0; // decode thread, sub-frame carry of the rate conversion
+    uint8_t *silence = nullptr;
+
+    // see DecodeOptions::inline_decode; the decode thread hands the stream to
+    // the capture thread by setting `inline_active`, the capture thread hands
+    // it back by clearing it
+    std::unique_ptr<InlineDecode> inline_decode;
+    std::atomic<bool> inline_wanted{false};
+    std::atomic<bool> inline_active{false};
+    std::atomic<bool> inline_failed{false}; // fell back, stays threaded until turned off
+
+    // failure handling of the decode thread, see DecoderState
+    std::atomic<DecoderState> state{DecoderState::Probing};
+    BackoffPolicy backoff{backoff_config()};
+    uint64_t backoff_until = 0;
+    std::atomic<bool> backoff_reset{false}; // a new stream, probe right away
+    uint32_t probe_attempts = 0; // failed probes since the last success or backoff
+    uint32_t error_run = 0;      // packets failing in a row
+    std::atomic<uint64_t> probe_failures{0};
+    std::atomic<uint64_t> decode_errors{0};
+    std::atomic<uint64_t> restarts{0};
+    std::atomic<uint64_t> backoffs{0};
+    std::atomic<uint64_t> recoveries{0};
+    std::atomic<uint32_t> backoff_ms{0};
+
+    static BackoffPolicy::Config backoff_config()
+    {
+        BackoffPolicy::Config config;
+        config.initial_ms = 250;
+        config.max_ms = 8000;
+        return config;
+    }
 
-    bool kill = false;
+    std::atomic<bool> kill{false};
     bool streamOpen = false;
     bool streamFound = false;
-    bool enabled = true;
+    bool cacheTried = false;
+    bool usingCache = false;      // decoder opened from cached parameters
+    bool paramsConfirmed = false; // first frame checked against the cache
+    StreamParams cached;
+    std::atomic<bool> enabled{true};
+    std::atomic<bool> gated{false};
+    std::atomic<bool> end_of_stream{false}; // no more input, see Drain()
+    bool drained = false;
+    os_event_t *drained_event = nullptr;
 
     AVIOContext *ioContext = nullptr;
     unsigned char * avio_ctx_buffer = nullptr;
@@ -41,7 +207,16 @@ struct AVerMedia::ffmpeg_decode
     uint8_t *packet_buffer = nullptr;
     size_t packet_size = 0;
 
-    obs_source_t* obsSource = nullptr;
+    std::mutex options_mutex;
+    DecodeOptions options;
+    std::atomic<uint32_t> options_generation{0};
+    DecodeProfile profile = DecodeProfile::Quality; // decode thread, the one in use
+    std::atomic<uint64_t> thread_cpu_ns{0};
+    LatencyHistogram decode_cost; // send + receive of one packet
+
+    OutputGate output;
+    FfmpegAudioDecode::AudioSink sink; // replaces `output` when set
+    AudioDebugTaps* taps = nullptr;
     obs_source_audio audio = {};
     uint64_t base_time = 0;
 };
@@ -93,45 +268,237 @@ static void print_ffmpeg_error(int error, const char* message = nullptr)
     }
 }
 
-struct pkg_data {
-	//AUDIO_SAMPLE_INFO audioInfo;
-    uint8_t* data;
-    int size;
-};
+static AVCodecID iec61937_codec_id(uint16_t type)
+{
+    switch (type) {
+    case IEC61937_TYPE_AC3:
+        return AV_CODEC_ID_AC3;
+    case IEC61937_TYPE_EAC3:
+        return AV_CODEC_ID_EAC3;
+    case IEC61937_TYPE_DTS1:
+    case IEC61937_TYPE_DTS2:
+    case IEC61937_TYPE_DTS3:
+        return AV_CODEC_ID_DTS;
+    case IEC61937_TYPE_MPEG2_AAC:
+        return AV_CODEC_ID_AAC;
+    default:
+        return AV_CODEC_ID_NONE; // left to the demuxer
+    }
+}
 
-static int read_packet(void *opaque, uint8_t *buf, int buf_size)
+// Takes the decoder for `id` out of the cache, flushed, if it was opened
+// for `profile`.
+static AVCodecContext *codec_cache_take(CodecCache &cache, AVCodecID id, DecodeProfile profile)
 {
-	auto decode = (ffmpeg_decode *)opaque;
-	//obs_log(LOG_INFO, "read_packet: buf_size=%d, %d", buf_size, decode->packets.size);
-    //if (decode->kill) return AVERROR_EOF;
-    //if (decode->packets.size <= 0) return 0;//AVERROR_UNKNOWN;
+    for (auto &entry : cache.entries) {
+        if (!entry.context || entry.context->codec_id != id)
+            continue;
+        AVCodecContext *context = entry.context;
+        entry.context = nullptr;
+        if (entry.profile != profile) {
+            avcodec_free_context(&context);
+            return nullptr;
+        }
+        avcodec_flush_buffers(context);
+        return context;
+    }
+    return nullptr;
+}
+
+// Keeps `context` for later; it replaces an older one for the same codec or
+// the least recently used.
+static void codec_cache_put(CodecCache &cache, AVCodecContext *context, DecodeProfile profile)
+{
+    if (!context)
+        return;
+    CodecCache::Entry *slot = nullptr;
+    for (auto &entry : cache.entries) {
+        if (entry.context && entry.context->codec_id == context->codec_id) {
+            slot = &entry;
+            break;
+        }
+        if (!slot || (slot->context && (!entry.context || entry.used < slot->used)))
+            slot = &entry;
+    }
+    avcodec_free_context(&slot->context);
+    slot->context = context;
+    slot->profile = profile;
+    slot->used = ++cache.uses;
+}
 
-    while(true) { // wait for data
-        pthread_mutex_lock(&decode->mutex);
-		bool kill = decode->kill;
-		size_t packageSize = decode->packets.size;
-        pthread_mutex_unlock(&decode->mutex);
+static void codec_cache_clear(CodecCache &cache)
+{
+    for (auto &entry : cache.entries)
+        avcodec_free_context(&entry.context);
+}
+
+static void ffmpeg_emit_silence(ffmpeg_decode *decode);
+
+// Sleeps until the capture thread queues more than the `have` bytes there
+// are, or idle frames, or the thread has to stop. The capture thread only
+// signals while we wait here.
+static void ffmpeg_wait_for_data(ffmpeg_decode *decode, size_t have = 0)
+{
+    decode->consumer_waiting.store(true);
+    if (decode->packets.Available() <= have && decode->idle_frames.load() == 0 && !decode->kill)
+        os_event_timedwait(decode->data_event, DATA_WAIT_TIMEOUT_MS);
+    decode->consumer_waiting.store(false, std::memory_order_relaxed);
+}
 
-        if (kill) return AVERROR_EOF;
-        if (packageSize > 0) break;
-        os_sleep_ms(1);
+static void ffmpeg_wake(ffmpeg_decode *decode)
+{
+    os_event_signal(decode->data_event);
+}
+
+// How much of `size` the demuxer may read before the next codec change.
+// 0 once it is due: the spdif demuxer cannot change codecs, so its stream
+// ends right before the first burst of the new one.
+static size_t ffmpeg_bytes_to_switch(ffmpeg_decode *decode, size_t size)
+{
+    uint64_t pos = decode->packets.ReadPosition();
+    uint16_t due = 0; // the latest one, after a flush skipped over several
+    while (true) {
+        if (!decode->mark_pending) {
+            if (decode->codec_marks.Available() < sizeof(CodecMark))
+                break;
+            decode->codec_marks.Read(&decode->mark, sizeof(CodecMark));
+            decode->mark_pending = true;
+        }
+        if (decode->mark.position > pos) {
+            size = (size_t)std::min<uint64_t>(size, decode->mark.position - pos);
+            break;
+        }
+        due = decode->mark.type;
+        decode->mark_pending = false;
     }
 
-	pkg_data *pkt;
+    // while probing there is no decoder yet and the probe sees the codec
+    AVCodecID id = iec61937_codec_id(due);
+    if (decode->decoder && id != AV_CODEC_ID_NONE && id != decode->decoder->codec_id) {
+        decode->switch_type = due;
+        return 0;
+    }
+    return size;
+}
 
-    pthread_mutex_lock(&decode->mutex);
-	deque_pop_front(&decode->packets, &pkt, sizeof(pkt));
-    pthread_mutex_unlock(&decode->mutex);
+// A burst that will not be heard: silence of its length goes out in its
+// place, so the output timeline stays continuous, and the resync it starts
+// lasts until the next decoded frame.
+static void ffmpeg_conceal(ffmpeg_decode *decode, uint64_t bursts, uint64_t link_frames)
+{
+    decode->conceal_frames += link_frames;
+    decode->lost_frames += link_frames;
+    decode->lost_bursts += bursts;
+    decode->resync_lost += bursts;
+    if (decode->resync_begin == 0) {
+        decode->resync_begin = os_gettime_ns();
+        decode->resyncs++;
+    }
+}
 
-    int size = pkt->size;
-    if (pkt->size > buf_size) size = buf_size;
-    memcpy(buf, pkt->data, size);
-    //obs_log(LOG_INFO, "  read_packet: size=%d (%d)", size, decode->packets.size);
-#ifdef COPY_AUDIO_DATA
-    bfree(pkt->data);
-#endif // COPY_AUDIO_DATA
-	delete pkt;
-    return size; //AVERROR_EOF;
+// The first frame decoded after lost bursts.
+static void ffmpeg_resynced(ffmpeg_decode *decode)
+{
+    if (decode->resync_begin == 0)
+        return;
+    uint32_t ms = (uint32_t)((os_gettime_ns() - decode->resync_begin) / 1000000);
+    uint32_t worst = decode->resync_ms_max;
+    decode->resync_ms = ms;
+    decode->resync_begin = 0;
+    if (ms > worst || decode->resyncs == 1) {
+        decode->resync_ms_max = std::max(ms, worst);
+        RealtimeExempt exempt; // a new worst case only
+        obs_log(LOG_INFO, "decoder: resynced after %u ms, %llu bursts lost", ms,
+                (unsigned long long)decode->resync_lost);
+    }
+    decode->resync_lost = 0;
+}
+
+// Decides what the demuxer gets next from the front of the queue: stuffing
+// and whole bursts pass, broken bursts are dropped up to the next sync and
+// concealed. A burst that comes before the demuxer's padding skip after the
+// last one ran out, because stuffing went missing, gets zeros in front so
+// the skip does not swallow its preamble. False if it has to wait for more.
+static bool ffmpeg_check_bursts(ffmpeg_decode *decode)
+{
+    if (!decode->gate_buffer) {
+        decode->gate_buffer = (uint8_t *)bmalloc(GATE_BUFFER_SIZE);
+    }
+    size_t size = decode->packets.Peek(decode->gate_buffer, GATE_SCAN_SIZE);
+    Iec61937Check check = iec61937_check(decode->gate_buffer, size);
+    if (check.need > size && decode->packets.Available() >= check.need) {
+        size = decode->packets.Peek(decode->gate_buffer, check.need);
+        check = iec61937_check(decode->gate_buffer, size);
+    }
+
+    if (check.skip) {
+        decode->packets.Skip(check.skip);
+        uint16_t type = check.lost_type ? check.lost_type : decode->gate_type;
+        ffmpeg_conceal(decode, 1, iec61937_burst_frames(type));
+        AVT_TRACE_INSTANT("burst_resync");
+        return true;
+    }
+    if (!check.pass)
+        return false;
+
+    decode->gate_pass = check.pass;
+    if (!check.burst) {
+        decode->demux_skip -= std::min(decode->demux_skip, check.pass);
+        return true;
+    }
+    uint16_t type = decode->gate_buffer[4] & 0x1F;
+    size_t period = (size_t)iec61937_burst_frames(type) * 4;
+    decode->gate_pad = decode->demux_skip;
+    decode->demux_skip = period > check.pass ? period - check.pass : 0;
+    decode->gate_type = type;
+    return true;
+}
+
+static int read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+	auto decode = (ffmpeg_decode *)opaque;
+    uint64_t wait_begin = 0;
+    size_t size = (size_t)buf_size;
+
+    while (true) { // wait for data
+        if (decode->kill || decode->switch_due) return AVERROR_EOF;
+
+        if (decode->flush.exchange(false)) {
+            decode->packets.Skip(decode->packets.Available());
+            decode->gate_pass = 0;
+            decode->gate_pad = 0;
+        }
+        size = ffmpeg_bytes_to_switch(decode, (size_t)buf_size);
+        if (size == 0) {
+            decode->switch_due = true;
+            return AVERROR_EOF;
+        }
+        if (decode->gate_pass || decode->gate_pad) break;
+        if (ffmpeg_check_bursts(decode)) {
+            ffmpeg_emit_silence(decode); // right away for a dropped burst
+            continue;
+        }
+        ffmpeg_emit_silence(decode);
+        if (decode->end_of_stream) {
+            // the last burst is cut short, the demuxer sees that for itself
+            decode->gate_pass = decode->packets.Available();
+            if (decode->gate_pass) continue;
+            return AVERROR_EOF;
+        }
+        if (wait_begin == 0 && PipelineTrace::Enabled()) wait_begin = os_gettime_ns();
+        ffmpeg_wait_for_data(decode, decode->packets.Available());
+    }
+    if (wait_begin) PipelineTrace::Complete("queue_wait", wait_begin, os_gettime_ns());
+
+    if (decode->gate_pad) {
+        size = std::min(size, decode->gate_pad);
+        memset(buf, 0, size);
+        decode->gate_pad -= size;
+        return (int)size;
+    }
+    size = decode->packets.Read(buf, std::min(size, decode->gate_pass));
+    decode->gate_pass -= size;
+    return (int)size;
 }
 
 static inline enum audio_format convert_sample_format(int f)
@@ -230,6 +597,96 @@ static bool ffmpeg_open_avio(ffmpeg_decode *decode)
     return ret == 0;
 }
 
+// Decoder and its options for `id` under `profile`. Options a decoder does
+// not know are left in `opts` by avcodec_open2() and ignored.
+static const AVCodec *ffmpeg_profile_decoder(AVCodecID id, DecodeProfile profile, AVDictionary **opts)
+{
+    const AVCodec *codec = nullptr;
+    if (profile == DecodeProfile::LowCpu && id == AV_CODEC_ID_AC3) {
+        codec = avcodec_find_decoder_by_name("ac3_fixed");
+    }
+    if (!codec) {
+        codec = avcodec_find_decoder(id);
+    }
+
+    if (profile != DecodeProfile::Quality) {
+        switch (id) {
+        case AV_CODEC_ID_AC3:
+        case AV_CODEC_ID_EAC3:
+            av_dict_set(opts, "drc_scale", "0", 0);
+            break;
+        case AV_CODEC_ID_DTS:
+            av_dict_set(opts, "core_only", "1", 0);
+            break;
+        default:
+            break;
+        }
+    }
+    return codec;
+}
+
+// Replaces the codec context with one for `par`, opened for the profile in use.
+static int ffmpeg_open_decoder(ffmpeg_decode *decode, const AVCodecParameters *par)
+{
+    AVDictionary *opts = nullptr;
+    const AVCodec *codec = ffmpeg_profile_decoder(par->codec_id, decode->profile, &opts);
+    if (!codec) {
+        av_dict_free(&opts);
+        obs_log(LOG_WARNING, "no decoder for %s", avcodec_get_name(par->codec_id));
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+
+    AVCodecContext *context = avcodec_alloc_context3(codec);
+    if (!context) {
+        av_dict_free(&opts);
+        return AVERROR(ENOMEM);
+    }
+    int ret = avcodec_parameters_to_context(context, par);
+    if (ret < 0) {
+        print_ffmpeg_error(ret, "avcodec_parameters_to_context");
+    } else {
+        ret = avcodec_open2(context, codec, &opts);
+        if (ret < 0) print_ffmpeg_error(ret, "avcodec_open2");
+    }
+    av_dict_free(&opts);
+    if (ret < 0) {
+        avcodec_free_context(&context);
+        return ret;
+    }
+
+    avcodec_free_context(&decode->decoder);
+    decode->decoder = context;
+    obs_log(LOG_INFO, "decoder %s, profile %s", codec->name, decode_profile_name(decode->profile));
+    return 0;
+}
+
+// Reopens the running decoder after the profile changed. The stream keeps
+// going, the new decoder starts with the next packet.
+static void ffmpeg_reopen_decoder(ffmpeg_decode *decode)
+{
+    if (!decode->decoder)
+        return;
+
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (par && avcodec_parameters_from_context(par, decode->decoder) >= 0 &&
+        ffmpeg_open_decoder(decode, par) == 0) {
+        avcodec_parameters_free(&par);
+        return;
+    }
+    avcodec_parameters_free(&par);
+    avcodec_free_context(&decode->decoder);
+    decode->usingCache = false;
+    decode->streamFound = false; // probe on the next iteration
+}
+
+// Name the stream parameter cache knows the codec by: its default decoder,
+// whichever decoder the profile picked.
+static const char *ffmpeg_codec_key(const AVCodecContext *context)
+{
+    const AVCodec *codec = avcodec_find_decoder(context->codec_id);
+    return codec ? codec->name : context->codec->name;
+}
+
 static int ffmpeg_find_stream(ffmpeg_decode *decode)
 {
     int ret;
@@ -250,92 +707,305 @@ static int ffmpeg_find_stream(ffmpeg_decode *decode)
         auto stream = decode->formatContext->streams[ret];
         obs_log(LOG_INFO, "audio stream channels = %d", stream->codecpar->ch_layout.nb_channels);
 
-        auto id = stream->codecpar->codec_id;
-        //obs_log(LOG_INFO, "avcodec_find_decoder %d", id);
-        auto codec = avcodec_find_decoder(id);
-        if (codec) obs_log(LOG_INFO, "avcodec_find_decoder: %s", codec->name);
-        decode->decoder = avcodec_alloc_context3(codec);
-        //obs_log(LOG_INFO, "avcodec_parameters_to_context");
-        ret = avcodec_parameters_to_context(decode->decoder, stream->codecpar);
-        if (ret < 0) {
-            print_ffmpeg_error(ret, "avcodec_parameters_to_context");
-            return ret;
-        }
-
-        //obs_log(LOG_INFO, "avcodec_open2");
-        ret = avcodec_open2(decode->decoder, codec, nullptr);
-        if (ret < 0) {
-            print_ffmpeg_error(ret, "avcodec_open2");
-        }
+        ret = ffmpeg_open_decoder(decode, stream->codecpar);
 
         //obs_log(LOG_INFO, "cached packets = %d", decode->packets.size);
     }
     return ret;
 }
 
+static std::string ffmpeg_device_key(ffmpeg_decode *decode)
+{
+    std::lock_guard<std::mutex> lock(decode->options_mutex);
+    return decode->options.device_key;
+}
+
+// Opens the decoder with the parameters this device delivered last time,
+// skipping avformat_find_stream_info. The first packet verifies the codec.
+static bool ffmpeg_open_cached(ffmpeg_decode *decode)
+{
+    StreamParams params;
+    if (!StreamParamCache::Lookup(ffmpeg_device_key(decode), params))
+        return false;
+
+    const AVCodec *codec = avcodec_find_decoder_by_name(params.codec.c_str());
+    AVCodecParameters *par = codec ? avcodec_parameters_alloc() : nullptr;
+    if (!par)
+        return false;
+    par->codec_type = AVMEDIA_TYPE_AUDIO;
+    par->codec_id = codec->id;
+    par->sample_rate = params.sample_rate;
+    av_channel_layout_default(&par->ch_layout, params.channels);
+
+    int ret = ffmpeg_open_decoder(decode, par);
+    avcodec_parameters_free(&par);
+    if (ret < 0) {
+        obs_log(LOG_INFO, "cached stream parameters not usable");
+        return false;
+    }
+
+    decode->cached = params;
+    decode->usingCache = true;
+    decode->paramsConfirmed = false;
+    obs_log(LOG_INFO, "stream parameters from cache: %s, %d channels, %d Hz",
+            params.codec.c_str(), params.channels, params.sample_rate);
+    return true;
+}
+
+static void ffmpeg_drop_cached(ffmpeg_decode *decode)
+{
+    avcodec_free_context(&decode->decoder);
+    decode->decoder = nullptr;
+    decode->usingCache = false;
+    decode->streamFound = false; // probe on the next iteration
+}
+
+static void ffmpeg_confirm_params(ffmpeg_decode *decode)
+{
+    decode->paramsConfirmed = true;
+
+    StreamParams actual;
+    actual.codec = ffmpeg_codec_key(decode->decoder);
+    actual.channels = decode->frame->ch_layout.nb_channels;
+    actual.sample_rate = decode->frame->sample_rate;
+
+    if (decode->usingCache && actual == decode->cached)
+        return;
+    if (decode->usingCache) {
+        obs_log(LOG_INFO, "stream parameters changed: %s, %d channels, %d Hz",
+                actual.codec.c_str(), actual.channels, actual.sample_rate);
+    }
+    StreamParamCache::Store(ffmpeg_device_key(decode), actual);
+}
+
 static int ffmpeg_decode_audio(ffmpeg_decode *decode, bool& got_frame)
 {
     int ret;
     AVPacket *pkt = av_packet_alloc();
-    ret = av_read_frame(decode->formatContext, pkt);
+    {
+        AVT_TRACE_SPAN("av_read_frame");
+        ret = av_read_frame(decode->formatContext, pkt);
+    }
     if (ret < 0) {
-        print_ffmpeg_error(ret, "av_read_frame");
-        return ret;
+        av_packet_free(&pkt);
+        return ret; // counted by the caller, which logs state changes only
     }
     //obs_log(LOG_INFO, "av_read_frame %d %d", pkt->pts, pkt->size);
+    if (decode->usingCache && !decode->paramsConfirmed) {
+        auto codecpar = decode->formatContext->streams[pkt->stream_index]->codecpar;
+        if (codecpar->codec_id != decode->decoder->codec_id) {
+            obs_log(LOG_INFO, "cached codec %s does not match the stream (%s), probing",
+                    decode->cached.codec.c_str(), avcodec_get_name(codecpar->codec_id));
+            av_packet_free(&pkt);
+            ffmpeg_drop_cached(decode);
+            return AVERROR_INVALIDDATA;
+        }
+    }
+    if (decode->taps) {
+        decode->taps->bitstream.Write(pkt->data, pkt->size);
+    }
 
+    uint64_t start = os_gettime_ns();
     ret = avcodec_send_packet(decode->decoder, pkt);
     av_packet_free(&pkt);
     if (ret < 0) {
-        print_ffmpeg_error(ret, "avcodec_send_packet");
         return ret;
     }
 
     ret = avcodec_receive_frame(decode->decoder, decode->frame);
     if (ret < 0) {
-        print_ffmpeg_error(ret, "avcodec_receive_frame");
         return ret;
     }
+    uint64_t end = os_gettime_ns();
+    decode->decode_cost.Record((end - start) / 1000);
+    if (PipelineTrace::Enabled()) PipelineTrace::Complete("decode", start, end);
     got_frame = ret == 0;
     //obs_log(LOG_INFO, "avcodec_receive_frame pkt-size=%d, samples=%d",
     //        decode->frame->pkt_size, decode->frame->nb_samples);
     return ret;
 }
 
-static void ffmpeg_push_frame(ffmpeg_decode *decode)
+// Producer time of the byte at the read position of the packet queue, 0 if
+// the producer sends no timestamps. Decode thread only.
+static uint64_t ffmpeg_capture_time(ffmpeg_decode *decode)
+{
+    uint64_t pos = decode->packets.ReadPosition();
+    while (true) {
+        if (!decode->time_pending) {
+            if (decode->time_marks.Available() < sizeof(TimeMark))
+                break;
+            decode->time_marks.Read(&decode->time_next, sizeof(TimeMark));
+            decode->time_pending = true;
+        }
+        if (decode->time_next.position > pos)
+            break;
+        decode->time_mark = decode->time_next;
+        decode->time_pending = false;
+    }
+    if (decode->time_mark.timestamp_ns == 0)
+        return 0;
+
+    // stuffing the burst filter dropped is not counted, a record is short
+    uint64_t frames = (pos - decode->time_mark.position) / 4;
+    return decode->time_mark.timestamp_ns +
+           util_mul_div64(frames, UINT64_C(1000000000), decode->input_rate);
+}
+
+// When the data decoded so far was captured: on the producer's clock if it
+// sends timestamps, else the time of arrival.
+static uint64_t ffmpeg_clock(ffmpeg_decode *decode)
+{
+    uint64_t captured = decode->inline_active.load(std::memory_order_relaxed)
+                            ? decode->inline_decode->clock_ns
+                            : ffmpeg_capture_time(decode);
+    decode->clock_captured = captured != 0;
+    return captured ? captured : os_gettime_ns();
+}
+
+// `now` is when the last sample of the `frames` was captured, see ffmpeg_clock()
+static uint64_t ffmpeg_timestamp(ffmpeg_decode *decode, uint64_t now, uint32_t frames, uint32_t rate)
+{
+    uint64_t duration = util_mul_div64(frames, UINT64_C(1000000000), rate);
+#if defined(WIN32)
+    UNUSED_PARAMETER(decode);
+#else
+    if (!decode->clock_captured) {
+        // Note: don't merge with the code below yet, or it will cause audio lagging
+        //decode->audio.timestamp = decode->frame->pts;
+        if (decode->base_time == 0) {
+            decode->base_time = now;
+        }
+        return now - decode->base_time;
+    }
+#endif // WIN32
+    return now - duration;
+}
+
+static void ffmpeg_output(ffmpeg_decode *decode, const obs_source_audio *audio)
+{
+    if (decode->gated) {
+        return;
+    }
+    AVT_TRACE_SPAN("push_frame");
+    if (decode->sink) {
+        decode->sink(audio);
+        return;
+    }
+
+    OutputGate::Use source(decode->output);
+    if (source) {
+        obs_source_output_audio(source.get(), audio);
+    } else {
+        obs_log(LOG_INFO, "obs_source_output_audio %lu %d",
+                audio->timestamp, audio->frames);
+    }
+}
+
+static void ffmpeg_push_frame(ffmpeg_decode *decode, AVFrame *frame)
 {
     //if (decode->obsSource == nullptr) return;
 
     //obs_source_audio audio = {};
     for (size_t i = 0; i < MAX_AV_PLANES; i++)
-        decode->audio.data[i] = decode->frame->data[i];
+        decode->audio.data[i] = frame->data[i];
 
-    decode->audio.samples_per_sec = decode->frame->sample_rate;
+    decode->audio.samples_per_sec = frame->sample_rate;
     //audio.format = AUDIO_FORMAT_FLOAT;
     //audio.speakers = SPEAKERS_5POINT1;
-    decode->audio.format = convert_sample_format(decode->frame->format);
+    decode->audio.format = convert_sample_format(frame->format);
     decode->audio.speakers =
-        convert_speaker_layout((uint8_t)decode->frame->ch_layout.nb_channels);
-    decode->audio.frames = decode->frame->nb_samples;
+        convert_speaker_layout((uint8_t)frame->ch_layout.nb_channels);
+    decode->audio.frames = frame->nb_samples;
+
+    if (decode->taps && decode->taps->pcm.IsActive()) {
+        auto format = (enum AVSampleFormat)frame->format;
+        size_t channels = (size_t)frame->ch_layout.nb_channels;
+        size_t bytes = (size_t)av_get_bytes_per_sample(format);
+
+        AudioDebugTap::Format tapFormat;
+        tapFormat.sample_rate = (uint32_t)frame->sample_rate;
+        tapFormat.channels = (uint16_t)channels;
+        tapFormat.bits = (uint16_t)(bytes * 8);
+        tapFormat.is_float = format == AV_SAMPLE_FMT_FLT || format == AV_SAMPLE_FMT_FLTP;
+        decode->taps->pcm.SetFormat(tapFormat);
+
+        if (av_sample_fmt_is_planar(format)) {
+            decode->taps->pcm.WritePlanar(frame->extended_data, channels,
+                                          (size_t)frame->nb_samples, bytes);
+        } else {
+            decode->taps->pcm.Write(frame->data[0], (size_t)frame->nb_samples * channels * bytes);
+        }
+    }
 
-#if defined(WIN32)
-    decode->audio.timestamp = os_gettime_ns();
-    decode->audio.timestamp -= util_mul_div64(decode->frame->nb_samples, UINT64_C(1000000000),
-                                              decode->frame->sample_rate);
-#else
-    // Note: don't merge with the above code yet, or it will cause audio lagging
-    //decode->audio.timestamp = decode->frame->pts;
-    if (decode->base_time == 0) {
-        decode->base_time = os_gettime_ns();
+    decode->audio.timestamp = ffmpeg_timestamp(decode, ffmpeg_clock(decode), decode->audio.frames,
+                                               decode->audio.samples_per_sec);
+    ffmpeg_output(decode, &decode->audio);
+}
+
+// Answers null and pause bursts, and lost bursts, with silence in the
+// format of the last decoded frame, so OBS sees no gap and the decoder is
+// not involved. Lost bursts are concealed even without idle silence.
+static void ffmpeg_emit_silence(ffmpeg_decode *decode)
+{
+    uint64_t link_frames = decode->conceal_frames.exchange(0);
+    uint64_t idle = decode->idle_frames.exchange(0);
+    if (decode->idle_silence)
+        link_frames += idle;
+    if (link_frames == 0 || decode->audio.samples_per_sec == 0)
+        return;
+
+    uint32_t rate = decode->audio.samples_per_sec;
+    uint64_t scaled = link_frames * rate + decode->silence_remainder;
+    uint64_t frames = scaled / decode->input_rate;
+    decode->silence_remainder = scaled % decode->input_rate;
+
+    if (!decode->silence) {
+        decode->silence = (uint8_t *)bzalloc(SILENCE_BUFFER_SIZE);
     }
-    decode->audio.timestamp = os_gettime_ns() - decode->base_time;
-#endif // WIN32
 
-    if (decode->obsSource) {
-        obs_source_output_audio(decode->obsSource, &decode->audio);
-    } else {
-        obs_log(LOG_INFO, "obs_source_output_audio %lu %d %d",
-                decode->audio.timestamp, decode->audio.frames, decode->frame->ch_layout.nb_channels);
+    obs_source_audio audio = decode->audio;
+    size_t planes = is_audio_planar(audio.format) ? get_audio_channels(audio.speakers) : 1;
+    for (size_t i = 0; i < MAX_AV_PLANES; i++)
+        audio.data[i] = i < planes ? decode->silence : nullptr;
+
+    // back to back, the last chunk ends now
+    uint64_t now = ffmpeg_clock(decode);
+    while (frames > 0) {
+        uint32_t chunk = (uint32_t)std::min<uint64_t>(frames, SILENCE_CHUNK_FRAMES);
+        frames -= chunk;
+        audio.frames = chunk;
+        audio.timestamp = ffmpeg_timestamp(
+            decode, now - util_mul_div64(frames, UINT64_C(1000000000), rate), chunk, rate);
+        ffmpeg_output(decode, &audio);
+    }
+}
+
+// Closes the demuxer and its AVIO context; the decoder and the output stay.
+static void ffmpeg_close_demuxer(ffmpeg_decode *decode)
+{
+    if (decode->formatContext) {
+        decode->formatContext->pb = nullptr;
+        // release context when stream is opened. or it may cause app crash
+        if (decode->streamOpen) {
+            avformat_close_input(&decode->formatContext);
+        } else {
+            avformat_free_context(decode->formatContext);
+        }
+        decode->formatContext = nullptr;
+    }
+    decode->streamOpen = false;
+    decode->switch_due = false;
+    decode->gate_pass = 0;
+    decode->gate_pad = 0;
+    decode->demux_skip = 0;
+
+    if (decode->ioContext) {
+        // avio_context_free() leaves the buffer alone, and FFmpeg may have
+        // replaced the one we passed in
+        av_freep(&decode->ioContext->buffer);
+        avio_context_free(&decode->ioContext);
+        decode->ioContext = nullptr;
+        decode->avio_ctx_buffer = nullptr;
     }
 }
 
@@ -347,6 +1017,7 @@ static void ffmpeg_decode_free(ffmpeg_decode *decode)
         avcodec_free_context(&decode->decoder);
         decode->decoder = nullptr;
     }
+    codec_cache_clear(decode->codecs);
     if (decode->frame) {
         av_frame_free(&decode->frame);
         decode->frame = nullptr;
@@ -356,40 +1027,384 @@ static void ffmpeg_decode_free(ffmpeg_decode *decode)
         decode->packet_buffer = nullptr;
     }
 
-    if (decode->formatContext) {
-        decode->formatContext->pb = nullptr;
-        // release context when stream is opened. or it may cause app crash
-        if (decode->streamOpen) {
-            avformat_close_input(&decode->formatContext);
+    ffmpeg_close_demuxer(decode);
+    decode->streamFound = false;
+    decode->cacheTried = false;
+    decode->usingCache = false;
+    decode->paramsConfirmed = false;
+
+    decode->base_time = 0;
+}
+
+// Outputs what `codec` still holds; it takes packets again after a flush.
+static void ffmpeg_drain(ffmpeg_decode *decode, AVCodecContext *codec, AVFrame *frame)
+{
+    if (codec && avcodec_send_packet(codec, nullptr) == 0) {
+        while (avcodec_receive_frame(codec, frame) == 0)
+            ffmpeg_push_frame(decode, frame);
+    }
+}
+
+// End of input: output what the decoder still holds, then idle until killed.
+static void ffmpeg_finish(ffmpeg_decode *decode)
+{
+    ffmpeg_drain(decode, decode->decoder, decode->frame);
+    decode->thread_cpu_ns = current_thread_cpu_time_ns(); // for offline runs
+    decode->drained = true;
+    os_event_signal(decode->drained_event);
+}
+
+// Hands the stream to the capture thread. Runs on the decode thread, or
+// before it starts; what is queued for the demuxer is dropped.
+static void ffmpeg_inline_start(ffmpeg_decode *decode)
+{
+    if (!decode->inline_decode) {
+        auto state = std::make_unique<InlineDecode>();
+        state->packet = av_packet_alloc();
+        state->frame = av_frame_alloc();
+        decode->inline_decode = std::move(state);
+    }
+    if (!decode->silence) {
+        decode->silence = (uint8_t *)bzalloc(SILENCE_BUFFER_SIZE);
+    }
+
+    InlineDecode &state = *decode->inline_decode;
+    state.profile = decode->profile;
+    state.reset = true;
+    decode->packets.Skip(decode->packets.Available());
+    decode->inline_active.store(true, std::memory_order_release);
+    obs_log(LOG_INFO, "decoding inline on the capture thread");
+}
+
+// Hands the stream back to the decode thread. Capture thread only.
+static void ffmpeg_inline_stop(ffmpeg_decode *decode, const char *reason)
+{
+    // the codec may have changed since the demuxer last saw the stream
+    CodecMark mark = {decode->packets.WritePosition(), decode->bursts.AudioType()};
+    if (mark.type)
+        decode->codec_marks.Write(&mark, sizeof(mark));
+    decode->inline_active.store(false, std::memory_order_release);
+
+    RealtimeExempt exempt; // once per fallback
+    ffmpeg_wake(decode);
+    obs_log(LOG_INFO, "decoding on the decode thread again: %s", reason);
+}
+
+static bool ffmpeg_inline_open(ffmpeg_decode *decode, uint16_t type)
+{
+    InlineDecode &state = *decode->inline_decode;
+    AVCodecID id = iec61937_codec_id(type);
+    if (id == AV_CODEC_ID_NONE) {
+        return false;
+    }
+
+    RealtimeExempt exempt; // on a codec or profile change only
+    if (state.codec) {
+        // kept open for when the stream changes back
+        ffmpeg_drain(decode, state.codec, state.frame);
+        if (state.codec->codec_id != id)
+            decode->codec_switches++;
+        codec_cache_put(state.codecs, state.codec, state.opened_profile);
+        state.codec = nullptr;
+    }
+    state.opened_profile = state.profile;
+    state.codec = codec_cache_take(state.codecs, id, state.opened_profile);
+    if (state.codec) {
+        state.type = type;
+        return true;
+    }
+
+    AVDictionary *opts = nullptr;
+    const AVCodec *codec = ffmpeg_profile_decoder(id, state.opened_profile, &opts);
+    state.codec = codec ? avcodec_alloc_context3(codec) : nullptr;
+    int ret = state.codec ? avcodec_open2(state.codec, codec, &opts) : AVERROR_DECODER_NOT_FOUND;
+    av_dict_free(&opts);
+    if (ret < 0) {
+        print_ffmpeg_error(ret, "avcodec_open2 (inline)");
+        avcodec_free_context(&state.codec);
+        return false;
+    }
+    state.type = type;
+    obs_log(LOG_INFO, "inline decoder %s, profile %s", codec->name,
+            decode_profile_name(state.opened_profile));
+    return true;
+}
+
+static void ffmpeg_inline_burst(ffmpeg_decode *decode, const Iec61937Parser::Burst &burst)
+{
+    InlineDecode &state = *decode->inline_decode;
+    if (!decode->inline_active.load(std::memory_order_relaxed)) {
+        return; // fell back earlier in this call
+    }
+    if (!state.codec || burst.type != state.type || state.profile != state.opened_profile) {
+        if (!ffmpeg_inline_open(decode, burst.type)) {
+            ffmpeg_inline_stop(decode, "burst type not decoded inline");
+            return;
         }
-        decode->formatContext = nullptr;
+    }
+    if (decode->taps) {
+        decode->taps->bitstream.Write(burst.data, burst.size);
     }
 
-    if (decode->ioContext) {
-        // `avio_ctx_buffer` will be freed in `avio_context_free`
-        avio_context_free(&decode->ioContext);
-        decode->ioContext = nullptr;
+    // not reference counted: FFmpeg copies the payload, the parser reuses it
+    state.packet->data = const_cast<uint8_t *>(burst.data);
+    state.packet->size = (int)burst.size;
+    state.bursts.fetch_add(1, std::memory_order_relaxed);
+
+    // FFmpeg allocates from its frame pools in here; that is the price of
+    // inline decoding and why it is opt-in and on a budget
+    RealtimeExempt exempt;
+    uint64_t start = os_gettime_ns();
+    int ret;
+    {
+        AVT_TRACE_SPAN("decode");
+        ret = avcodec_send_packet(state.codec, state.packet);
+    }
+    if (ret < 0) {
+        // corrupt burst, the next one decodes on its own
+        ffmpeg_conceal(decode, 1, iec61937_burst_frames(burst.type));
+        return;
     }
+    bool first = true;
+    while (avcodec_receive_frame(state.codec, state.frame) == 0) {
+        if (first) {
+            decode->decode_cost.Record((os_gettime_ns() - start) / 1000);
+            ffmpeg_resynced(decode);
+            first = false;
+        }
+        ffmpeg_push_frame(decode, state.frame);
+    }
+}
 
-    decode->base_time = 0;
+// Falls back to the decode thread when inline decoding takes more than its
+// share of the capture period too often.
+static void ffmpeg_inline_budget(ffmpeg_decode *decode, size_t size, uint64_t begin)
+{
+    InlineDecode &state = *decode->inline_decode;
+    uint64_t elapsed = os_gettime_ns() - begin;
+    uint64_t duration = util_mul_div64(size / 4, UINT64_C(1000000000), decode->input_rate);
+
+    state.worst_ns = std::max(state.worst_ns, elapsed);
+    if (elapsed * 100 > duration * INLINE_BUDGET_PERCENT) {
+        state.over_budget++;
+    }
+    if (state.over_budget >= INLINE_OVER_BUDGET_LIMIT) {
+        decode->inline_failed = true;
+        RealtimeExempt exempt;
+        obs_log(LOG_WARNING, "inline decoding over budget: %u of %u calls took more than %d%%, up to %.2f ms",
+                state.over_budget, state.calls + 1, INLINE_BUDGET_PERCENT, (double)state.worst_ns / 1e6);
+        ffmpeg_inline_stop(decode, "over budget");
+        return;
+    }
+    if (++state.calls == INLINE_BUDGET_WINDOW) {
+        state.calls = 0;
+        state.over_budget = 0;
+        state.worst_ns = 0;
+    }
+}
+
+// Decodes everything the inline decoder still holds, at the end of input.
+static void ffmpeg_inline_flush(ffmpeg_decode *decode)
+{
+    InlineDecode &state = *decode->inline_decode;
+    ffmpeg_drain(decode, state.codec, state.frame);
+}
+
+static void ffmpeg_inline_free(ffmpeg_decode *decode)
+{
+    if (!decode->inline_decode)
+        return;
+    InlineDecode &state = *decode->inline_decode;
+    obs_log(LOG_INFO, "inline decoding: %llu bursts", (unsigned long long)state.bursts.load());
+    avcodec_free_context(&state.codec);
+    codec_cache_clear(state.codecs);
+    av_packet_free(&state.packet);
+    av_frame_free(&state.frame);
+    decode->inline_decode.reset();
+}
+
+static void ffmpeg_apply_options(ffmpeg_decode *decode)
+{
+    DecodeOptions options;
+    {
+        std::lock_guard<std::mutex> lock(decode->options_mutex);
+        options = decode->options;
+    }
+
+    ThreadPriority applied = set_current_thread_priority(options.thread_priority);
+    if (applied != options.thread_priority) {
+        obs_log(LOG_WARNING, "ffmpeg_decode_thread: priority %s not permitted, using %s",
+                thread_priority_name(options.thread_priority), thread_priority_name(applied));
+    }
+    if (!set_current_thread_affinity(options.cpu_affinity)) {
+        obs_log(LOG_WARNING, "ffmpeg_decode_thread: failed to set CPU affinity '%s'",
+                options.cpu_list.c_str());
+    }
+    obs_log(LOG_INFO, "ffmpeg_decode_thread: priority %s, CPUs '%s'",
+            thread_priority_name(applied), options.cpu_list.empty() ? "any" : options.cpu_list.c_str());
+
+    if (options.profile != decode->profile) {
+        decode->profile = options.profile;
+        codec_cache_clear(decode->codecs);
+        ffmpeg_reopen_decoder(decode);
+        if (decode->inline_decode)
+            decode->inline_decode->profile = options.profile; // picked up with the next burst
+    }
+
+    if (!options.inline_decode) {
+        decode->inline_failed = false; // may be tried again
+    } else if (!decode->inline_active && !decode->inline_failed) {
+        ffmpeg_inline_start(decode);
+    }
+}
+
+static void ffmpeg_report_cpu_time(ffmpeg_decode *decode, uint64_t &last_report_ns, uint64_t &last_cpu_ns, bool force)
+{
+    uint64_t now = os_gettime_ns();
+    if (!force && now - last_report_ns < CPU_REPORT_INTERVAL_NS) return;
+
+    uint64_t cpu = current_thread_cpu_time_ns();
+    decode->thread_cpu_ns = cpu;
+
+    double wall_ms = (double)(now - last_report_ns) / 1000000.0;
+    double cpu_ms = (double)(cpu - last_cpu_ns) / 1000000.0;
+    obs_log(LOG_INFO, "ffmpeg_decode_thread: %.1f ms CPU in %.1f s (%.2f%%)",
+            cpu_ms, wall_ms / 1000.0, wall_ms > 0 ? cpu_ms * 100.0 / wall_ms : 0.0);
+
+    last_report_ns = now;
+    last_cpu_ns = cpu;
+}
+
+static const char *ffmpeg_error_string(int error, char *buf, size_t size)
+{
+    if (av_strerror(error, buf, size) < 0)
+        snprintf(buf, size, "error %d", error);
+    return buf;
+}
+
+static void ffmpeg_set_state(ffmpeg_decode *decode, DecoderState state)
+{
+    if (decode->state == state)
+        return;
+    obs_log(LOG_INFO, "decoder: %s -> %s", decoder_state_name(decode->state),
+            decoder_state_name(state));
+    decode->state = state;
+}
+
+// Tears down the demuxer and the codec; the next iteration probes again.
+static void ffmpeg_restart_demuxer(ffmpeg_decode *decode)
+{
+    ffmpeg_decode_free(decode);
+    ffmpeg_init_avio(decode);
+    decode->restarts++;
+}
+
+// The demuxer stopped right before a burst of another codec. Swaps the
+// decoder for one from the cache, or a new one, and opens a fresh spdif
+// demuxer on the queue, which takes no probing: it picks up the codec from
+// the first burst. The queue, the output and the thread carry on.
+static void ffmpeg_switch_codec(ffmpeg_decode *decode)
+{
+    uint64_t start = os_gettime_ns();
+    AVCodecID from = decode->decoder->codec_id;
+    AVCodecID to = iec61937_codec_id(decode->switch_type);
+
+    ffmpeg_drain(decode, decode->decoder, decode->frame);
+    codec_cache_put(decode->codecs, decode->decoder, decode->profile);
+    decode->decoder = codec_cache_take(decode->codecs, to, decode->profile);
+    bool kept = decode->decoder != nullptr;
+    if (!kept) {
+        AVCodecParameters *par = avcodec_parameters_alloc();
+        if (par) {
+            par->codec_type = AVMEDIA_TYPE_AUDIO;
+            par->codec_id = to;
+            ffmpeg_open_decoder(decode, par);
+        }
+        avcodec_parameters_free(&par);
+    }
+
+    ffmpeg_close_demuxer(decode);
+    ffmpeg_init_avio(decode);
+    decode->streamFound = decode->decoder != nullptr; // else probe the new codec
+    decode->usingCache = false;
+    decode->paramsConfirmed = false; // the first frame updates StreamParamCache
+    decode->error_run = 0;
+    decode->codec_switches++;
+    obs_log(LOG_INFO, "decoder: codec change %s -> %s, %s decoder, %.2f ms", avcodec_get_name(from),
+            avcodec_get_name(to), kept ? "cached" : "new", (double)(os_gettime_ns() - start) / 1e6);
+}
+
+static void ffmpeg_enter_backoff(ffmpeg_decode *decode, const char *reason)
+{
+    uint32_t delay = decode->backoff.NextDelayMs();
+    decode->backoff_ms = delay;
+    decode->backoffs++;
+    decode->backoff_until = os_gettime_ns() + (uint64_t)delay * 1000000;
+    decode->probe_attempts = 0;
+    decode->error_run = 0;
+    obs_log(LOG_WARNING, "decoder: %s, retrying in %u ms", reason, delay);
+    ffmpeg_set_state(decode, DecoderState::Backoff);
+}
+
+// Sleeps out the backoff without touching the input, which the capture
+// thread drops meanwhile, then probes what comes next.
+static void ffmpeg_backoff_wait(ffmpeg_decode *decode)
+{
+    if (decode->backoff_reset.exchange(false)) {
+        decode->backoff.Reset();
+        decode->backoff_until = 0;
+    }
+    uint64_t now = os_gettime_ns();
+    if (now < decode->backoff_until && !decode->end_of_stream) {
+        // only kill, Drain, SetEnabled and Reset signal while we are not waiting for data
+        os_event_timedwait(decode->data_event, (unsigned long)((decode->backoff_until - now + 999999) / 1000000));
+        return;
+    }
+
+    decode->packets.Skip(decode->packets.Available());
+    ffmpeg_restart_demuxer(decode);
+    ffmpeg_set_state(decode, DecoderState::Probing);
 }
 
-static void clean_buffer_packets(ffmpeg_decode *decode)
+static void ffmpeg_probe_failed(ffmpeg_decode *decode, const char *what, int error)
 {
-    // release all buffered data
-    while (decode->packets.size) {
-        pkg_data *pkt;
+    char err[AV_ERROR_MAX_STRING_SIZE];
+    decode->probe_failures++;
+    if (++decode->probe_attempts < PROBE_RETRIES) {
+        obs_log(LOG_WARNING, "decoder: %s failed (%s), attempt %u of %d", what,
+                ffmpeg_error_string(error, err, sizeof(err)), decode->probe_attempts, PROBE_RETRIES);
+        ffmpeg_restart_demuxer(decode);
+        return;
+    }
+    ffmpeg_enter_backoff(decode, "no decodable audio stream");
+}
 
-        pthread_mutex_lock(&decode->mutex);
-        deque_pop_front(&decode->packets, &pkt, sizeof(pkt));
-        pthread_mutex_unlock(&decode->mutex);
+static void ffmpeg_decode_failed(ffmpeg_decode *decode, int error)
+{
+    char err[AV_ERROR_MAX_STRING_SIZE];
+    decode->decode_errors++;
+    decode->error_run++;
+    ffmpeg_conceal(decode, 1, iec61937_burst_frames(decode->gate_type));
+    if (decode->state == DecoderState::Running && decode->error_run >= DEGRADED_AFTER_ERRORS) {
+        obs_log(LOG_WARNING, "decoder: %u packets failed in a row (%s)", decode->error_run,
+                ffmpeg_error_string(error, err, sizeof(err)));
+        ffmpeg_set_state(decode, DecoderState::Degraded);
+    } else if (decode->state == DecoderState::Degraded && decode->error_run >= BACKOFF_AFTER_ERRORS) {
+        ffmpeg_enter_backoff(decode, "stream keeps failing to decode");
+    }
+}
 
-#ifdef COPY_AUDIO_DATA
-        bfree(pkt->data);
-#endif // COPY_AUDIO_DATA
-        delete pkt;
+static void ffmpeg_decode_succeeded(ffmpeg_decode *decode)
+{
+    if (decode->state == DecoderState::Degraded) {
+        obs_log(LOG_INFO, "decoder: recovered after %u failed packets", decode->error_run);
+        decode->recoveries++;
+        ffmpeg_set_state(decode, DecoderState::Running);
     }
-    //circlebuf_free(&decode->packets);
+    decode->error_run = 0;
+    if (decode->backoff.Attempts())
+        decode->backoff.Reset(); // the stream is good again
+    ffmpeg_resynced(decode);
 }
 
 static void* ffmpeg_decode_thread(void *opaque)
@@ -401,67 +1416,134 @@ static void* ffmpeg_decode_thread(void *opaque)
 
     //ffmpeg_prepare_avio(decode);
     int ret;
+    uint32_t applied_generation = decode->options_generation - 1;
+    uint64_t last_report_ns = os_gettime_ns();
+    uint64_t last_cpu_ns = current_thread_cpu_time_ns();
     while (true) {
 		if (decode == nullptr) break;
-        bool kill = false;
-        pthread_mutex_lock(&decode->mutex);
-		kill = decode->kill;
-        pthread_mutex_unlock(&decode->mutex);
-        if (kill) break;
-
-        if (decode->enabled == false) {
-            os_sleep_ms(2);
+        if (decode->kill) break;
+
+        uint32_t generation = decode->options_generation;
+        if (generation != applied_generation) {
+            ffmpeg_apply_options(decode);
+            applied_generation = generation;
+        }
+        ffmpeg_report_cpu_time(decode, last_report_ns, last_cpu_ns, false);
+
+        if (decode->inline_active.load(std::memory_order_acquire)) {
+            // the capture thread decodes; it wakes us when it hands back
+            os_event_timedwait(decode->data_event, DATA_WAIT_TIMEOUT_MS);
+            continue;
+        }
+        if (decode->enabled == false || decode->drained) {
+            decode->idle_frames = 0; // nothing to be silent for
+            decode->conceal_frames = 0;
+            ffmpeg_wait_for_data(decode);
             continue;
         }
 		
+        if (decode->state == DecoderState::Backoff) {
+            ffmpeg_backoff_wait(decode);
+            continue;
+        }
+
 		if (!decode->streamOpen) {
             decode->streamOpen = ffmpeg_open_avio(decode);
+            if (!decode->streamOpen) {
+                if (decode->end_of_stream)
+                    ffmpeg_finish(decode); // not enough input to open
+                else
+                    ffmpeg_probe_failed(decode, "avformat_open_input", AVERROR_INVALIDDATA);
+                continue;
+            }
 		}
 		
+        if (decode->streamOpen && !decode->streamFound && !decode->cacheTried) {
+            decode->cacheTried = true;
+            decode->streamFound = ffmpeg_open_cached(decode);
+        }
+
         if (decode->streamOpen && !decode->streamFound) {
+            ffmpeg_set_state(decode, DecoderState::Probing);
             ret = ffmpeg_find_stream(decode);
             decode->streamFound = ret == 0;
+            if (!decode->streamFound) {
+                if (decode->end_of_stream)
+                    ffmpeg_finish(decode);
+                else
+                    ffmpeg_probe_failed(decode, "stream probe", ret);
+                continue;
+            }
 #if !defined(WIN32)
             ret = avformat_flush(decode->formatContext);
             obs_log(LOG_INFO, "avformat_flush %d", ret);
 #endif // WIN32
 		}
+        if (decode->streamFound && decode->state == DecoderState::Probing) {
+            decode->probe_attempts = 0;
+            decode->error_run = 0;
+            ffmpeg_set_state(decode, DecoderState::Running);
+        }
 
         if (decode->streamOpen && decode->streamFound) {
             bool got_frame = false;
             ret = ffmpeg_decode_audio(decode, got_frame);
-            if (ret < 0) {
-                //print_ffmpeg_error(ret, "ffmpeg_decode_audio");
+            if (ret == AVERROR_EOF && decode->switch_due) {
+                ffmpeg_switch_codec(decode);
+            } else if (ret == AVERROR_EOF && decode->end_of_stream) {
+                ffmpeg_finish(decode);
+            } else if (!decode->streamFound) {
+                // cached parameters did not match, probing next
+            } else if (ret == AVERROR(EAGAIN)) {
+                // the codec needs more packets for a frame
+            } else if (ret < 0) {
+                ffmpeg_decode_failed(decode, ret);
             } else if (got_frame) {
-                ffmpeg_push_frame(decode);
+                ffmpeg_decode_succeeded(decode);
+                if (!decode->paramsConfirmed) {
+                    ffmpeg_confirm_params(decode);
+                }
+                ffmpeg_push_frame(decode, decode->frame);
             }
         }
     }
 
     //ffmpeg_decode_free(decode);
+    if (decode) ffmpeg_report_cpu_time(decode, last_report_ns, last_cpu_ns, true);
 
     //obs_log(LOG_INFO, "ffmpeg_decode_thread %d LEAVE", tid);
     return nullptr;
 }
 
-FfmpegAudioDecode::FfmpegAudioDecode(obs_source_t* source)
+FfmpegAudioDecode::FfmpegAudioDecode(obs_source_t* source, AudioDebugTaps* taps,
+                                     const DecodeOptions& options)
+    : FfmpegAudioDecode(AudioSink(), taps, options)
+{
+    decode->output.Attach(source);
+}
+
+FfmpegAudioDecode::FfmpegAudioDecode(AudioSink sink, AudioDebugTaps* taps,
+                                     const DecodeOptions& options)
     : decode(std::make_unique<ffmpeg_decode>())
 {
-    if (pthread_mutex_init(&decode->mutex, NULL) != 0) {
-        obs_log(LOG_WARNING, "FfmpegAudioDecode: Failed to init mutex");
-        return;
-    }
+    decode->options = options;
+    decode->profile = options.profile;
+    decode->sink = std::move(sink);
 
     av_log_set_level(AV_LOG_INFO);
     av_log_set_callback(ffmpeg_log);
     avformat_network_init();
 
-    pthread_mutex_lock(&decode->mutex);
-    deque_init(&decode->packets);
     decode->kill = false;
-    pthread_mutex_unlock(&decode->mutex);
-
-    decode->obsSource = source;
+    decode->taps = taps;
+    os_event_init(&decode->drained_event, OS_EVENT_TYPE_MANUAL);
+    os_event_init(&decode->data_event, OS_EVENT_TYPE_AUTO);
+    decode->idle_silence = options.idle_silence;
+    decode->inline_wanted = options.inline_decode;
+    if (options.inline_decode) {
+        // before any input, so none of it takes the threaded path
+        ffmpeg_inline_start(decode.get());
+    }
 
     ffmpeg_init_avio(decode.get());
     pthread_create(&decode->thread, nullptr, ffmpeg_decode_thread, decode.get());
@@ -471,23 +1553,37 @@ FfmpegAudioDecode::~FfmpegAudioDecode()
 {
     //auto tid = GetCurrentThreadId();
     //obs_log(LOG_INFO, "FfmpegAudioDecode::~FfmpegAudioDecode() stop thread %d", tid);
-    pthread_mutex_lock(&decode->mutex);
     decode->kill = true;
-    pthread_mutex_unlock(&decode->mutex);
+    ffmpeg_wake(decode.get());
     pthread_join(decode->thread, nullptr);
     obs_log(LOG_INFO, "FfmpegAudioDecode::~FfmpegAudioDecode() stop thread done");
 
-    clean_buffer_packets(decode.get());
-    pthread_mutex_lock(&decode->mutex);
-    deque_free(&decode->packets);
-    pthread_mutex_unlock(&decode->mutex);
-
     ffmpeg_decode_free(decode.get());
-    decode->obsSource = nullptr;
+    os_event_destroy(decode->drained_event);
+    os_event_destroy(decode->data_event);
+    ffmpeg_inline_free(decode.get());
+    bfree(decode->silence);
+    bfree(decode->gate_buffer);
 
 	avformat_network_deinit();
 
-    pthread_mutex_destroy(&decode->mutex);
+    if (decode->dropped) {
+        obs_log(LOG_WARNING, "FfmpegAudioDecode: dropped %llu bytes, decoder too slow",
+                (unsigned long long)decode->dropped.load());
+    }
+    if (decode->idle_frames_total) {
+        obs_log(LOG_INFO, "FfmpegAudioDecode: skipped %.1f s of null/pause bursts",
+                (double)decode->idle_frames_total / decode->input_rate);
+    }
+    if (decode->lost_bursts) {
+        obs_log(LOG_INFO, "FfmpegAudioDecode: %llu bursts lost in %llu resyncs, %.1f s concealed, worst %u ms",
+                (unsigned long long)decode->lost_bursts.load(), (unsigned long long)decode->resyncs.load(),
+                (double)decode->lost_frames / decode->input_rate, decode->resync_ms_max.load());
+    }
+    if (decode->decode_cost.Count()) {
+        obs_log(LOG_INFO, "FfmpegAudioDecode: decode cost per frame %s",
+                decode->decode_cost.ToJson().c_str());
+    }
 }
 
 #if 0
@@ -507,74 +1603,106 @@ static inline void copy_data(struct ffmpeg_decode *decode, uint8_t *data, size_t
 }
 #endif
 
-void FfmpegAudioDecode::OnEncodedAudioData(unsigned char *data, size_t size, long long /*ts*/)
+void FfmpegAudioDecode::OnEncodedAudioData(unsigned char *data, size_t size, long long ts)
 {
-    //obs_log(LOG_INFO, "OnAudioData %d", size);
+    // runs on the capture thread: no allocation, no lock, no logging
+    RealtimeScope rt;
+
     if (size == 0) {
-        obs_log(LOG_WARNING, "OnAudioData empty");
         return; // don't push empty data
     }
     if (decode->enabled == false) {
         return; // drop data when decode disabled
     }
 
-	pkg_data* pkt = new pkg_data;
-    pkt->size = (int)size;
-#ifdef COPY_AUDIO_DATA
-    pkt->data = (uint8_t *)bmalloc(size);
-    memcpy(pkt->data, data, size);
-#else
-    pkt->data = data;
-#endif // COPY_AUDIO_DATA
+    ffmpeg_decode *d = decode.get();
+    if (d->state.load(std::memory_order_relaxed) == DecoderState::Backoff &&
+        !d->inline_active.load(std::memory_order_relaxed)) {
+        return; // the stream failed, the decode thread probes again after the backoff
+    }
+    if (d->filter_reset.exchange(false, std::memory_order_acquire)) {
+        d->bursts.Reset();
+    }
+    uint32_t rate = d->input_rate.load(std::memory_order_relaxed);
+    if (rate != d->filter_rate) {
+        d->filter_rate = rate;
+        d->bursts.SetHoldFrames(rate * IDLE_HOLD_MS / 1000);
+    }
 
-    pthread_mutex_lock(&decode->mutex);
-    deque_push_back(&decode->packets, &pkt, sizeof(pkt));
-    pthread_mutex_unlock(&decode->mutex);
-    //obs_log(LOG_INFO, "OnAudioData %d %d", size, decode->packets.size);
+    bool direct = d->inline_active.load(std::memory_order_acquire);
+    if (direct && !d->inline_wanted.load(std::memory_order_relaxed)) {
+        ffmpeg_inline_stop(d, "turned off");
+        direct = false;
+    }
+    uint64_t begin = 0;
+    if (direct) {
+        begin = os_gettime_ns();
+        if (d->inline_decode->reset.exchange(false, std::memory_order_acquire))
+            d->inline_decode->parser.Reset();
+        // bursts completed in this call end with it
+        d->inline_decode->clock_ns =
+            ts > 0 ? (uint64_t)ts + util_mul_div64(size / 4, UINT64_C(1000000000), rate) : 0;
+    } else if (ts > 0) {
+        TimeMark mark = {d->packets.WritePosition(), (uint64_t)ts};
+        d->time_marks.Write(&mark, sizeof(mark)); // full only while the decode thread stalls
+    }
 
-#if 0
-	int ret;
-    if (decode->decoder == nullptr) {
-        decode->codec = avcodec_find_decoder(AV_CODEC_ID_AC3);
-        decode->decoder = avcodec_alloc_context3(decode->codec);
-		
-        ret = avcodec_open2(decode->decoder, decode->codec, NULL);
-		if (ret < 0) {
-			print_ffmpeg_error(ret);
-			if (decode.decoder) {
-                avcodec_free_context(&decode->decoder);
-			}
-		} else {
-			obs_log(LOG_INFO, "avcodec_open2 ready");
-		}
-		return TRUE;
-	}
-	
-    copy_data(&decode, data, size);
-    if (!decode->frame) {
-        decode->frame = av_frame_alloc();
-	}
-    if (decode->frame) {
-		if (pbData && lLength) {
-			AVPacket *packet = av_packet_alloc();
-            packet->data = decode->packet_buffer;
-			packet->size = (int)lLength;
+    // null and pause bursts stop here, only audio bursts reach the demuxer
+    // or the inline parser
+    bool queued = false;
+    auto forward = [d, direct, &queued](const uint8_t *bytes, size_t count) {
+        if (direct && d->inline_active.load(std::memory_order_relaxed)) {
+            Iec61937Parser &parser = d->inline_decode->parser;
+            uint64_t lost = parser.Lost();
+            uint64_t lost_frames = parser.LostFrames();
+            parser.Feed(bytes, count, [d](const Iec61937Parser::Burst &burst) {
+                ffmpeg_inline_burst(d, burst);
+            });
+            if (parser.Lost() != lost)
+                ffmpeg_conceal(d, parser.Lost() - lost, parser.LostFrames() - lost_frames);
+        } else if (d->packets.Write(bytes, count)) {
+            queued = true;
+        } else {
+            d->dropped.fetch_add(count, std::memory_order_relaxed);
+            AVT_TRACE_INSTANT("packet_queue_overflow");
+        }
+    };
+    // the inline parser sees burst types itself
+    auto on_type = [d, direct](uint16_t type, size_t back) {
+        if (direct && d->inline_active.load(std::memory_order_relaxed))
+            return;
+        uint64_t end = d->packets.WritePosition();
+        CodecMark mark = {end - std::min<uint64_t>(back, end), type};
+        d->codec_marks.Write(&mark, sizeof(mark)); // full only while the decode thread stalls
+        AVT_TRACE_INSTANT("codec_change");
+    };
+    uint64_t idle = d->bursts.Feed(data, size, forward, on_type);
+    if (idle) {
+        d->idle_frames_total.fetch_add(idle, std::memory_order_relaxed);
+        if (d->idle_silence.load(std::memory_order_relaxed))
+            d->idle_frames.fetch_add(idle);
+        else
+            idle = 0;
+    }
+    if (direct && d->inline_active.load(std::memory_order_relaxed)) {
+        ffmpeg_emit_silence(d);
+        ffmpeg_inline_budget(d, size, begin);
+        return;
+    }
+    AVT_TRACE_COUNTER("packet_queue_bytes", d->packets.Available());
 
-            ret = avcodec_send_packet(decode->decoder, packet);
-			//obs_log(LOG_INFO, "avcodec_send_packet %d", ret);
+    // pairs with the flag store in ffmpeg_wait_for_data()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((queued || idle) && d->consumer_waiting.load(std::memory_order_relaxed)) {
+        RealtimeExempt exempt; // one short lock per callback at most
+        ffmpeg_wake(d);
+    }
+}
 
-			av_packet_free(&packet);
-		}
-		if (ret == 0) {
-            ret = avcodec_receive_frame(decode->decoder, decode->frame);
-			obs_log(LOG_INFO, "avcodec_receive_frame %d", ret);
-		} else {
-			obs_log(LOG_INFO, "avcodec_send_packet wrong");
-			print_ffmpeg_error(ret);
-		}
-        return; // ret == 0;
-	}
-#endif
+void FfmpegAudioDecode::SetInputRate(uint32_t sample_rate)
+{
+    if (sample_rate)
+        decode->input_rate.store(sample_rate, std::memory_order_relaxed);
 }
 
 bool FfmpegAudioDecode::decode_valid()
@@ -585,28 +1713,155 @@ bool FfmpegAudioDecode::decode_valid()
 void FfmpegAudioDecode::SetEnabled(bool enabled)
 {
     if (enabled != decode->enabled) {
-        clean_buffer_packets(decode.get()); // clear all data when state changed
+        // clear all data when state changed; only the decode thread may consume
+        decode->flush = true;
+        decode->filter_reset = true;
+        decode->idle_frames = 0;
+        decode->conceal_frames = 0;
+        decode->backoff_reset = true;
+        if (decode->inline_decode)
+            decode->inline_decode->reset = true;
     }
     decode->enabled = enabled;
+    ffmpeg_wake(decode.get());
+}
+
+void FfmpegAudioDecode::SetOutputGated(bool gated)
+{
+    decode->gated = gated;
+}
+
+void FfmpegAudioDecode::Detach()
+{
+    decode->gated = true;
+    decode->output.Detach();
+}
+
+void FfmpegAudioDecode::SetOptions(const DecodeOptions& options)
+{
+    std::lock_guard<std::mutex> lock(decode->options_mutex);
+    bool retune = !options.SameThreadTuning(decode->options) || !options.SameDecoder(decode->options);
+    decode->options = options;
+    decode->idle_silence = options.idle_silence;
+    decode->inline_wanted = options.inline_decode;
+    if (retune) {
+        decode->options_generation++; // picked up by the decode thread
+    }
+}
+
+uint64_t FfmpegAudioDecode::ThreadCpuTimeNs() const
+{
+    return decode->thread_cpu_ns;
+}
+
+size_t FfmpegAudioDecode::QueueFree() const
+{
+    return decode->packets.Free();
+}
+
+const char *AVerMedia::decoder_state_name(DecoderState state)
+{
+    switch (state) {
+    case DecoderState::Probing:
+        return "probing";
+    case DecoderState::Running:
+        return "running";
+    case DecoderState::Degraded:
+        return "degraded";
+    case DecoderState::Backoff:
+        return "backoff";
+    }
+    return "unknown";
+}
+
+std::string DecoderStats::ToJson() const
+{
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"state\":\"%s\",\"probe_failures\":%llu,\"decode_errors\":%llu,"
+             "\"restarts\":%llu,\"backoffs\":%llu,\"recoveries\":%llu,\"backoff_ms\":%u,"
+             "\"codec_switches\":%llu,\"resyncs\":%llu,\"lost_bursts\":%llu,"
+             "\"concealed_ms\":%llu,\"resync_ms\":%u,\"resync_ms_max\":%u}",
+             decoder_state_name(state), (unsigned long long)probe_failures,
+             (unsigned long long)decode_errors, (unsigned long long)restarts,
+             (unsigned long long)backoffs, (unsigned long long)recoveries, backoff_ms,
+             (unsigned long long)codec_switches, (unsigned long long)resyncs,
+             (unsigned long long)lost_bursts, (unsigned long long)concealed_ms, resync_ms,
+             resync_ms_max);
+    return json;
+}
+
+DecoderStats FfmpegAudioDecode::Stats() const
+{
+    DecoderStats stats;
+    stats.state = decode->state;
+    stats.probe_failures = decode->probe_failures;
+    stats.decode_errors = decode->decode_errors;
+    stats.restarts = decode->restarts;
+    stats.backoffs = decode->backoffs;
+    stats.recoveries = decode->recoveries;
+    stats.codec_switches = decode->codec_switches;
+    stats.backoff_ms = decode->backoff_ms;
+    stats.resyncs = decode->resyncs;
+    stats.lost_bursts = decode->lost_bursts;
+    stats.concealed_ms = util_mul_div64(decode->lost_frames, 1000, decode->input_rate);
+    stats.resync_ms = decode->resync_ms;
+    stats.resync_ms_max = decode->resync_ms_max;
+    return stats;
+}
+
+bool FfmpegAudioDecode::DecodingInline() const
+{
+    return decode->inline_active.load(std::memory_order_relaxed);
+}
+
+bool FfmpegAudioDecode::Drain(uint32_t timeout_ms)
+{
+    if (decode->inline_active.load(std::memory_order_acquire)) {
+        ffmpeg_inline_flush(decode.get()); // everything else is already out
+        return true;
+    }
+    decode->end_of_stream = true;
+    ffmpeg_wake(decode.get());
+    return os_event_timedwait(decode->drained_event, timeout_ms) == 0;
+}
+
+const LatencyHistogram &FfmpegAudioDecode::DecodeCost() const
+{
+    return decode->decode_cost;
 }
 
 void FfmpegAudioDecode::Reset()
 {
     obs_log(LOG_INFO, "FfmpegAudioDecode::Reset() stop decode thread");
-    pthread_mutex_lock(&decode->mutex);
     decode->kill = true;
-    pthread_mutex_unlock(&decode->mutex);
+    ffmpeg_wake(decode.get());
     pthread_join(decode->thread, nullptr);
     obs_log(LOG_INFO, "FfmpegAudioDecode::Reset() stop decode thread done");
 
-    clean_buffer_packets(decode.get());
-    //circlebuf_free(&decode->packets);
     ffmpeg_decode_free(decode.get());
 
-    //circlebuf_init(&decode->packets);
-    pthread_mutex_lock(&decode->mutex);
+    decode->flush = true;
+    decode->codec_marks.Skip(decode->codec_marks.Available());
+    decode->mark_pending = false;
+    decode->time_marks.Skip(decode->time_marks.Available());
+    decode->time_mark = {};
+    decode->time_pending = false;
     decode->kill = false;
-    pthread_mutex_unlock(&decode->mutex);
+    decode->end_of_stream = false;
+    decode->drained = false;
+    decode->filter_reset = true;
+    decode->idle_frames = 0;
+    if (decode->inline_decode)
+        decode->inline_decode->reset = true;
+    decode->state = DecoderState::Probing;
+    decode->backoff.Reset();
+    decode->probe_attempts = 0;
+    decode->error_run = 0;
+    decode->resync_begin = 0;
+    decode->resync_lost = 0;
+    decode->conceal_frames = 0;
+    os_event_reset(decode->drained_event);
     ffmpeg_init_avio(decode.get());
     pthread_create(&decode->thread, nullptr, ffmpeg_decode_thread, decode.get());
 }
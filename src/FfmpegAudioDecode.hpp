@@ -1,23 +1,97 @@
 #pragma once
 
 #include <obs.h>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+
+#include "DecodeOptions.hpp"
 
 namespace AVerMedia {
 
 struct ffmpeg_decode;
+struct AudioDebugTaps;
+class LatencyHistogram;
+
+// Where the decode thread stands with the stream.
+enum class DecoderState {
+    Probing,  // opening the demuxer and looking for an audio stream
+    Running,  // decoding
+    Degraded, // decoding, but the last packets failed
+    Backoff,  // probing or decoding kept failing, waiting before a retry
+};
+
+const char *decoder_state_name(DecoderState state);
+
+struct DecoderStats {
+    DecoderState state = DecoderState::Probing;
+    uint64_t probe_failures = 0; // failed demuxer opens and stream probes
+    uint64_t decode_errors = 0;  // packets the codec rejected
+    uint64_t restarts = 0;       // demuxer torn down and probed again
+    uint64_t backoffs = 0;
+    uint64_t recoveries = 0;     // Degraded back to Running
+    uint32_t backoff_ms = 0;     // last delay
+    uint64_t codec_switches = 0; // decoders swapped at a codec change in the stream
+    uint64_t resyncs = 0;        // times bursts were lost and decoding picked up again
+    uint64_t lost_bursts = 0;    // corrupted, cut short or rejected by the codec
+    uint64_t concealed_ms = 0;   // silence output in place of lost bursts
+    uint32_t resync_ms = 0;      // from the first lost burst to the next frame, last
+    uint32_t resync_ms_max = 0;
+
+    // {"state":"running","probe_failures":0,...}
+    std::string ToJson() const;
+};
 
 class FfmpegAudioDecode
 {
 
 public:
-    FfmpegAudioDecode(obs_source_t* source);
+    using AudioSink = std::function<void(const struct obs_source_audio*)>;
+
+    FfmpegAudioDecode(obs_source_t* source, AudioDebugTaps* taps = nullptr,
+                      const DecodeOptions& options = {});
+    // Hands decoded frames to `sink` on the decode thread instead of
+    // outputting them to a source, e.g. to fan out a shared capture.
+    FfmpegAudioDecode(AudioSink sink, AudioDebugTaps* taps = nullptr,
+                      const DecodeOptions& options = {});
     ~FfmpegAudioDecode();
 
+    // `ts` is when the first byte was captured, on the os_gettime_ns() clock,
+    // or 0 to time the decoded audio on arrival.
     void OnEncodedAudioData(unsigned char *data, size_t size, long long ts);
+    // Sample rate of the captured link, e.g. 192000 for E-AC-3 over HDMI.
+    // Converts the length of null and pause bursts to output silence.
+    void SetInputRate(uint32_t sample_rate);
     void SetEnabled(bool enabled);
+    // Keeps parsing and decoding but stops handing audio to OBS, so the
+    // stream stays in sync and output resumes with the next frame.
+    void SetOutputGated(bool gated);
+    // Stops all output to the OBS source for good. Once this returns the
+    // source may be destroyed while the decoder is torn down elsewhere.
+    void Detach();
+    void SetOptions(const DecodeOptions& options);
     void Reset();
 
+    DecoderStats Stats() const;
+    // CPU time of the decode thread, refreshed about once a minute and
+    // when drained
+    uint64_t ThreadCpuTimeNs() const;
+    // Wall time of decoding each packet, from sending it to the codec to
+    // receiving the frame.
+    const LatencyHistogram &DecodeCost() const;
+
+    // For offline use, where input comes faster than real time: bytes
+    // OnEncodedAudioData() can take without dropping, and a way to wait for
+    // the decoder to output everything queued and what the codec buffers.
+    size_t QueueFree() const;
+    // Marks the end of the input; false if not drained within `timeout_ms`.
+    bool Drain(uint32_t timeout_ms);
+
+    // True while bursts are decoded on the capture thread, false once
+    // inline decoding fell back to the decode thread or is off.
+    bool DecodingInline() const;
+
 private:
     bool decode_valid();
 
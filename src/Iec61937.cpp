@@ -0,0 +1,193 @@
+#include "Iec61937.hpp"
+
+namespace AVerMedia {
+
+static inline uint16_t read_word(const uint8_t *data, size_t index)
+{
+    return (uint16_t)(data[2 * index] | (data[2 * index + 1] << 8));
+}
+
+uint32_t iec61937_burst_frames(uint16_t type)
+{
+    switch (type) {
+    case IEC61937_TYPE_AC3:
+        return 1536;
+    case IEC61937_TYPE_MPEG2_AAC:
+        return 1024;
+    case IEC61937_TYPE_DTS1:
+        return 512;
+    case IEC61937_TYPE_DTS2:
+        return 1024;
+    case IEC61937_TYPE_DTS3:
+        return 2048;
+    case IEC61937_TYPE_EAC3:
+        return 6144;
+    default:
+        return 0;
+    }
+}
+
+size_t iec61937_payload_bytes(uint16_t info, uint16_t length)
+{
+    switch (info & 0x1F) {
+    case IEC61937_TYPE_EAC3:
+    case 17: // DTS type IV
+    case 22: // MAT (TrueHD)
+        return length;
+    default:
+        return (length + 7) / 8;
+    }
+}
+
+bool iec61937_valid_header(uint16_t info, uint16_t length)
+{
+    uint16_t type = info & 0x1F;
+    if (type == IEC61937_TYPE_NULL || type == IEC61937_TYPE_PAUSE)
+        return false;
+
+    // the preamble and the payload fit the repetition period
+    size_t payload = iec61937_payload_bytes(info, length);
+    uint32_t frames = iec61937_burst_frames(type);
+    size_t limit = frames ? (size_t)frames * 4 : IEC61937_MAX_PAYLOAD + 8;
+    return payload > 0 && payload + 8 <= limit;
+}
+
+size_t iec61937_find_burst(const uint8_t *data, size_t count, size_t from, size_t to)
+{
+    to = std::min(to, count);
+    for (size_t i = from; i < to && i + 3 < count; i++) {
+        if (read_word(data, i) == IEC61937_PA && read_word(data, i + 1) == IEC61937_PB &&
+            iec61937_valid_header(read_word(data, i + 2), read_word(data, i + 3)))
+            return i;
+    }
+    return to;
+}
+
+Iec61937Check iec61937_check(const uint8_t *data, size_t size)
+{
+    Iec61937Check check;
+    const size_t count = size / 2;
+
+    // stuffing up to the next Pa Pb, or up to a Pa that ends the data
+    size_t sync = 0;
+    while (sync < count &&
+           !(read_word(data, sync) == IEC61937_PA &&
+             (sync + 1 == count || read_word(data, sync + 1) == IEC61937_PB)))
+        sync++;
+    if (sync > 0) {
+        check.pass = sync * 2;
+        return check;
+    }
+    if (count < 4) {
+        check.need = 8;
+        return check;
+    }
+
+    uint16_t info = read_word(data, 2);
+    uint16_t length = read_word(data, 3);
+    if (!iec61937_valid_header(info, length)) {
+        size_t next = iec61937_find_burst(data, count, 2, count);
+        if (next == count && count > 3)
+            next = count - 3; // might be the start of the next preamble
+        check.skip = next * 2;
+        return check;
+    }
+
+    size_t words = 4 + (iec61937_payload_bytes(info, length) + 1) / 2;
+    size_t next = iec61937_find_burst(data, count, 4, words);
+    if (next < std::min(words, count)) {
+        check.skip = next * 2;
+        check.lost_type = info & 0x1F;
+        return check;
+    }
+    if (count < words) {
+        check.need = words * 2; // not all there yet
+        return check;
+    }
+
+    check.pass = words * 2;
+    check.burst = true;
+    return check;
+}
+
+void Iec61937Detector::Feed(const int16_t *samples, size_t frames, uint32_t sample_rate)
+{
+    const uint16_t *words = reinterpret_cast<const uint16_t *>(samples);
+    size_t count = frames * 2;
+
+    // frame index of the last preamble in this buffer, if any
+    size_t last_sync = count;
+    uint16_t previous = last_word;
+    for (size_t i = 0; i < count; i++) {
+        if (previous == IEC61937_PA && words[i] == IEC61937_PB) {
+            last_sync = i;
+            bursts++;
+        }
+        previous = words[i];
+    }
+    if (count)
+        last_word = words[count - 1];
+
+    if (last_sync < count)
+        frames_since = frames - last_sync / 2;
+    else
+        frames_since += frames;
+
+    uint64_t hold_frames = (uint64_t)sample_rate * hold_ms / 1000;
+    non_pcm = frames_since <= hold_frames;
+}
+
+void Iec61937Detector::Reset()
+{
+    last_word = 0;
+    frames_since = ~0ULL >> 1;
+    bursts = 0;
+    non_pcm = false;
+}
+
+uint64_t Iec61937BurstFilter::ReportIdle()
+{
+    uint64_t frames = idle_words / 2;
+    if (reported_frames == 0 && frames < hold_frames)
+        return 0;
+
+    uint64_t added = frames - reported_frames;
+    reported_frames = frames;
+    return added;
+}
+
+uint64_t Iec61937BurstFilter::EndIdle()
+{
+    // a gap shorter than the hold is never reported
+    uint64_t frames = ReportIdle();
+    idle = false;
+    idle_words = 0;
+    reported_frames = 0;
+    return frames;
+}
+
+void Iec61937BurstFilter::Reset()
+{
+    idle = false;
+    matched = 0;
+    idle_words = 0;
+    reported_frames = 0;
+    audio_type = 0;
+}
+
+void Iec61937Parser::Lose(uint16_t type)
+{
+    lost++;
+    lost_frames += iec61937_burst_frames(type);
+}
+
+void Iec61937Parser::Reset()
+{
+    state = State::Sync;
+    matched = 0;
+    last_type = 0;
+    expected = 0;
+    filled = 0;
+}
+
+} // namespace AVerMedia
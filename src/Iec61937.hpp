@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace AVerMedia {
+
+// IEC 61937 carries compressed audio over a PCM link as data bursts in
+// 16-bit stereo. Every burst starts with the sync words Pa and Pb, followed
+// by the burst info Pc and the payload length Pd.
+constexpr uint16_t IEC61937_PA = 0xF872;
+constexpr uint16_t IEC61937_PB = 0x4E1F;
+
+// Data types (Pc bits 0-4) that carry no audio. A source sends them while
+// the player is paused or in a menu.
+constexpr uint16_t IEC61937_TYPE_NULL = 0;
+constexpr uint16_t IEC61937_TYPE_PAUSE = 3;
+
+// Audio data types this plugin decodes without the spdif demuxer.
+constexpr uint16_t IEC61937_TYPE_AC3 = 1;
+constexpr uint16_t IEC61937_TYPE_MPEG2_AAC = 7;
+constexpr uint16_t IEC61937_TYPE_DTS1 = 11;
+constexpr uint16_t IEC61937_TYPE_DTS2 = 12;
+constexpr uint16_t IEC61937_TYPE_DTS3 = 13;
+constexpr uint16_t IEC61937_TYPE_EAC3 = 21;
+
+// TrueHD needs 61440 bytes, everything else fits well below
+constexpr size_t IEC61937_MAX_PAYLOAD = 65536;
+
+// Repetition period of an audio data type in frames of the stereo link: a
+// burst and the stuffing after it take this long. 0 where it is not fixed
+// or not known here.
+uint32_t iec61937_burst_frames(uint16_t type);
+
+// Pd is the payload length in bits, except for the types that need more
+// than 65535 bits, where it is in bytes
+size_t iec61937_payload_bytes(uint16_t info, uint16_t length);
+
+// Whether the burst info Pc and length Pd of a preamble make sense: an audio
+// data type and a payload that fits its repetition period. A burst whose
+// header took a bit error fails this.
+bool iec61937_valid_header(uint16_t info, uint16_t length);
+
+// Word index of the first preamble in words [from, to) of `data` whose
+// header passes iec61937_valid_header() and lies within the `count` words
+// there are; `to` if there is none.
+size_t iec61937_find_burst(const uint8_t *data, size_t count, size_t from, size_t to);
+
+// Checks the front of a queued bitstream before the spdif demuxer reads it,
+// so the demuxer only gets whole bursts with a valid header and the
+// stuffing between them. A corrupted header and a burst cut short by the
+// next one are skipped straight to the next sync; without that the demuxer
+// reads the next burst as payload and loses that one too.
+struct Iec61937Check {
+    size_t pass = 0;        // stuffing up to the next preamble, or one whole burst
+    size_t skip = 0;        // a broken burst, up to the next preamble
+    bool burst = false;     // `pass` starts with a preamble
+    uint16_t lost_type = 0; // data type of the skipped burst, 0 if its header was bad
+    size_t need = 0;        // nothing to pass or skip yet: bytes it takes to tell
+};
+
+// `data` is 16-bit stereo in little-endian byte order. Neither passes nor
+// skips anything while there is not enough data yet to tell.
+Iec61937Check iec61937_check(const uint8_t *data, size_t size);
+
+// Tells a bitstream from plain PCM by looking for burst preambles in the
+// captured samples. This is the in-band counterpart of asking the vendor SDK
+// for the audio format, for devices where the SDK is not available.
+class Iec61937Detector
+{
+public:
+    // A stream counts as a bitstream until no preamble was seen for
+    // `hold_ms`. The longest repetition period in use, E-AC-3 at 6144
+    // frames, is 128 ms at 48 kHz.
+    explicit Iec61937Detector(uint32_t hold_ms = 250) : hold_ms(hold_ms) {}
+
+    // `samples` is interleaved 16-bit stereo in host byte order.
+    void Feed(const int16_t *samples, size_t frames, uint32_t sample_rate);
+    void Reset();
+
+    bool IsNonPcm() const { return non_pcm; }
+    uint64_t BurstsSeen() const { return bursts; }
+
+private:
+    const uint32_t hold_ms;
+    uint16_t last_word = 0;     // carries a Pa that ends one buffer
+    uint64_t frames_since = ~0ULL >> 1;
+    uint64_t bursts = 0;
+    bool non_pcm = false;
+};
+
+// Splits a captured bitstream into audio bursts, which go on to the spdif
+// demuxer, and null or pause bursts with the stuffing that follows them,
+// which are dropped and only counted. The demuxer resyncs on the next audio
+// burst by itself, so the decoder never sees the idle stretch.
+class Iec61937BurstFilter
+{
+public:
+    // Idle stretches shorter than `hold_frames` count as gaps inside the
+    // stream and are never reported.
+    explicit Iec61937BurstFilter(uint32_t hold_frames = 6144) : hold_frames(hold_frames) {}
+
+    void SetHoldFrames(uint32_t frames) { hold_frames = frames; }
+
+    // `data` is 16-bit stereo in little-endian byte order. Calls
+    // forward(const uint8_t *bytes, size_t size) with the bytes to keep, in
+    // order, and returns how many frames became idle in this call.
+    template<typename Forward> uint64_t Feed(const uint8_t *data, size_t size, Forward &&forward)
+    {
+        return Feed(data, size, std::forward<Forward>(forward), [](uint16_t, size_t) {});
+    }
+
+    // Also calls on_type(uint16_t type, size_t back) before forwarding an
+    // audio burst whose data type differs from the one before it, the first
+    // after a Reset() included. `back` is how many bytes of its preamble went
+    // out with the previous call already.
+    template<typename Forward, typename OnType>
+    uint64_t Feed(const uint8_t *data, size_t size, Forward &&forward, OnType &&on_type);
+    void Reset();
+
+    bool IsIdle() const { return idle; }
+    uint64_t IdleBursts() const { return idle_bursts; }
+    uint16_t AudioType() const { return audio_type; } // 0 before the first audio burst
+
+private:
+    uint64_t EndIdle();
+    uint64_t ReportIdle();
+
+    uint32_t hold_frames;
+    bool idle = false;
+    int matched = 0;             // preamble words seen: 1 after Pa, 2 after Pb
+    uint64_t idle_words = 0;     // dropped in the current idle stretch
+    uint64_t reported_frames = 0;
+    uint64_t idle_bursts = 0;
+    uint16_t audio_type = 0;
+};
+
+template<typename Forward, typename OnType>
+uint64_t Iec61937BurstFilter::Feed(const uint8_t *data, size_t size, Forward &&forward, OnType &&on_type)
+{
+    // a preamble whose Pa and Pb ended the previous call
+    static const uint8_t preamble[4] = {IEC61937_PA & 0xFF, IEC61937_PA >> 8,
+                                        IEC61937_PB & 0xFF, IEC61937_PB >> 8};
+
+    const size_t count = size / 2;
+    size_t start = 0; // first word not yet forwarded or counted as idle
+    uint64_t frames = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint16_t word = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+        if (matched < 2) {
+            if (word == IEC61937_PB && matched == 1)
+                matched = 2;
+            else
+                matched = word == IEC61937_PA ? 1 : 0;
+            continue;
+        }
+
+        // `word` is Pc, the burst starts two words earlier
+        matched = 0;
+        uint16_t type = word & 0x1F;
+        bool idle_type = type == IEC61937_TYPE_NULL || type == IEC61937_TYPE_PAUSE;
+        size_t burst = i >= 2 ? i - 2 : 0;
+
+        if (idle_type) {
+            idle_bursts++;
+            if (!idle) {
+                if (burst > start)
+                    forward(data + start * 2, (burst - start) * 2);
+                start = burst;
+                idle = true;
+            }
+        } else if (idle) {
+            idle_words += burst - start;
+            frames += EndIdle();
+            if (type != audio_type)
+                on_type(type, (size_t)0);
+            if (i < 2)
+                forward(preamble, (2 - i) * 2); // dropped with the idle stretch
+            start = burst;
+        } else if (type != audio_type) {
+            if (burst > start)
+                forward(data + start * 2, (burst - start) * 2);
+            on_type(type, i < 2 ? (2 - i) * 2 : (size_t)0);
+            start = burst;
+        }
+        if (!idle_type)
+            audio_type = type;
+    }
+
+    if (!idle) {
+        if (size > start * 2)
+            forward(data + start * 2, size - start * 2);
+        return frames;
+    }
+
+    idle_words += count - start;
+    return frames + ReportIdle();
+}
+
+// Cuts a bitstream into burst payloads without the spdif demuxer, so a burst
+// can be decoded on the thread that captured it. Feed() never blocks and never
+// allocates; payloads are byte swapped into bitstream order, the way the
+// demuxer hands them to the decoder.
+class Iec61937Parser
+{
+public:
+    static constexpr size_t MAX_PAYLOAD = IEC61937_MAX_PAYLOAD;
+
+    struct Burst {
+        uint16_t type; // Pc bits 0-4
+        const uint8_t *data;
+        size_t size;
+    };
+
+    Iec61937Parser() : payload(new uint8_t[MAX_PAYLOAD]) {}
+
+    // `data` is 16-bit stereo in little-endian byte order. Calls
+    // on_burst(const Burst &) for every complete audio burst; the payload is
+    // only valid during the call. Null and pause bursts are skipped, and so
+    // are bursts with a corrupted header or cut short by the next preamble:
+    // parsing picks up at the next sync and the burst counts as lost.
+    template<typename OnBurst> void Feed(const uint8_t *data, size_t size, OnBurst &&on_burst);
+    void Reset();
+
+    uint64_t Bursts() const { return bursts; }
+    uint64_t Lost() const { return lost; }
+    // link frames the lost bursts would have covered, by the type of the
+    // burst or, with a corrupted header, of the one before it
+    uint64_t LostFrames() const { return lost_frames; }
+
+private:
+    enum class State { Sync, Info, Length, Payload };
+
+    void Lose(uint16_t type);
+
+    std::unique_ptr<uint8_t[]> payload;
+    State state = State::Sync;
+    int matched = 0; // 1 after Pa
+    uint16_t info = 0;
+    uint16_t last_type = 0; // of the last complete burst
+    size_t expected = 0; // payload bytes of the current burst
+    size_t filled = 0;
+    uint64_t bursts = 0;
+    uint64_t lost = 0;
+    uint64_t lost_frames = 0;
+};
+
+template<typename OnBurst>
+void Iec61937Parser::Feed(const uint8_t *data, size_t size, OnBurst &&on_burst)
+{
+    const size_t count = size / 2;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t word = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+        switch (state) {
+        case State::Sync:
+            if (word == IEC61937_PB && matched == 1) {
+                state = State::Info;
+                matched = 0;
+            } else {
+                matched = word == IEC61937_PA ? 1 : 0;
+            }
+            break;
+        case State::Info:
+            info = word;
+            state = State::Length;
+            break;
+        case State::Length: {
+            uint16_t type = info & 0x1F;
+            state = State::Sync;
+            if (type == IEC61937_TYPE_NULL || type == IEC61937_TYPE_PAUSE)
+                break;
+            if (!iec61937_valid_header(info, word)) {
+                Lose(last_type);
+                break;
+            }
+            expected = iec61937_payload_bytes(info, word);
+            filled = 0;
+            state = State::Payload;
+            break;
+        }
+        case State::Payload: {
+            // the rest of the payload, or of this buffer, in one go
+            size_t words = std::min((expected - filled + 1) / 2, count - i);
+            size_t cut = iec61937_find_burst(data, count, i, i + words);
+            if (cut < i + words) {
+                // the next burst starts inside this one; resync on its Pa
+                Lose(info & 0x1F);
+                state = State::Sync;
+                matched = 1;
+                i = cut;
+                break;
+            }
+            const uint8_t *src = data + 2 * i;
+            uint8_t *dst = payload.get() + filled;
+            for (size_t n = 0; n < words; n++) {
+                dst[2 * n] = src[2 * n + 1];
+                dst[2 * n + 1] = src[2 * n];
+            }
+            filled += words * 2;
+            i += words - 1;
+            if (filled >= expected) {
+                bursts++;
+                last_type = info & 0x1F;
+                state = State::Sync;
+                on_burst(Burst{(uint16_t)(info & 0x1F), payload.get(), expected});
+            }
+            break;
+        }
+        }
+    }
+}
+
+} // namespace AVerMedia
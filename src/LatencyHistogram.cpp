@@ -0,0 +1,91 @@
+#include "LatencyHistogram.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace AVerMedia {
+
+static int bucket_index(uint64_t us)
+{
+    int index = 0;
+    while (us > 1 && index < LatencyHistogram::BUCKETS - 1) {
+        us >>= 1;
+        index++;
+    }
+    return index;
+}
+
+void LatencyHistogram::Record(uint64_t us)
+{
+    buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+    last_us.store(us, std::memory_order_relaxed);
+
+    uint64_t cur = min_us.load(std::memory_order_relaxed);
+    while (us < cur && !min_us.compare_exchange_weak(cur, us, std::memory_order_relaxed))
+        ;
+    cur = max_us.load(std::memory_order_relaxed);
+    while (us > cur && !max_us.compare_exchange_weak(cur, us, std::memory_order_relaxed))
+        ;
+
+    count.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto &bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    sum_us.store(0, std::memory_order_relaxed);
+    min_us.store(UINT64_MAX, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+    last_us.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_release);
+}
+
+uint64_t LatencyHistogram::MinUs() const
+{
+    uint64_t value = min_us.load(std::memory_order_relaxed);
+    return value == UINT64_MAX ? 0 : value;
+}
+
+uint64_t LatencyHistogram::MeanUs() const
+{
+    uint64_t n = Count();
+    return n ? sum_us.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::PercentileUs(double p) const
+{
+    uint64_t total = 0;
+    uint64_t counts[BUCKETS];
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (!total)
+        return 0;
+
+    uint64_t rank = (uint64_t)((p / 100.0) * (double)(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t upper = (UINT64_C(1) << (i + 1)) - 1;
+            return upper < MaxUs() ? upper : MaxUs();
+        }
+    }
+    return MaxUs();
+}
+
+std::string LatencyHistogram::ToJson() const
+{
+    char json[256];
+    snprintf(json, sizeof(json),
+             "{\"count\":%" PRIu64 ",\"last_us\":%" PRIu64 ",\"min_us\":%" PRIu64
+             ",\"mean_us\":%" PRIu64 ",\"p50_us\":%" PRIu64 ",\"p95_us\":%" PRIu64
+             ",\"max_us\":%" PRIu64 "}",
+             Count(), LastUs(), MinUs(), MeanUs(), PercentileUs(50), PercentileUs(95), MaxUs());
+    return json;
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace AVerMedia {
+
+// Lock-free log2 histogram of durations in microseconds. Record() may be
+// called from any thread, including real-time ones; readers get a
+// consistent-enough view for diagnostics.
+class LatencyHistogram
+{
+public:
+    static constexpr int BUCKETS = 32; // bucket n holds [2^n, 2^(n+1)) us
+
+    void Record(uint64_t us);
+    void Reset();
+
+    uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+    uint64_t MinUs() const;
+    uint64_t MaxUs() const { return max_us.load(std::memory_order_relaxed); }
+    uint64_t MeanUs() const;
+    uint64_t LastUs() const { return last_us.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the p-th percentile, p in [0, 100].
+    uint64_t PercentileUs(double p) const;
+
+    // {"count":..,"last_us":..,"min_us":..,"mean_us":..,"p50_us":..,"p95_us":..,"max_us":..}
+    std::string ToJson() const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum_us{0};
+    std::atomic<uint64_t> min_us{UINT64_MAX};
+    std::atomic<uint64_t> max_us{0};
+    std::atomic<uint64_t> last_us{0};
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,438 @@
+#include "AVerMediaAlsaSource.hpp"
+
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/util_uint64.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "PipelineTrace.hpp"
+#include "RealtimeCheck.hpp"
+
+#ifdef ENABLE_FFMPEG_DECODE
+#include "FfmpegAudioDecode.hpp"
+#endif // ENABLE_FFMPEG_DECODE
+
+#define DEVICE_ID          "device_id"
+#define CHANNELS           2
+#define BYTES_PER_FRAME    (CHANNELS * sizeof(int16_t))
+#define PERIOD_FRAMES      1024
+#define PERIODS            4
+#define WAIT_TIMEOUT_MS    500
+
+namespace AVerMedia {
+
+static bool alsa_success(int err, const char *device, const char *what)
+{
+    if (err >= 0)
+        return true;
+    obs_log(LOG_WARNING, "alsa: [%s] %s failed: %s", device, what, snd_strerror(err));
+    return false;
+}
+
+static void get_decoder_stats_proc(void *data, calldata_t *cd)
+{
+    auto source = reinterpret_cast<AlsaSource *>(data);
+    calldata_set_string(cd, "json", source->DecoderStatsJson().c_str());
+}
+
+AlsaSource::AlsaSource(obs_data_t *settings, obs_source_t *source)
+    : obsSource(source), sourceGate(source)
+{
+    os_event_init(&stopEvent, OS_EVENT_TYPE_MANUAL);
+    os_event_init(&wakeEvent, OS_EVENT_TYPE_AUTO);
+
+    deviceId = obs_data_get_string(settings, DEVICE_ID);
+    taps.Update(settings);
+    decodeOptions = DecodeOptions::FromSettings(settings);
+    decodeOptions.device_key = deviceId;
+
+    proc_handler_t *ph = obs_source_get_proc_handler(source);
+    proc_handler_add(ph, "void get_decoder_stats(out string json)", get_decoder_stats_proc, this);
+
+    Start();
+}
+
+AlsaSource::~AlsaSource()
+{
+    Stop();
+    os_event_destroy(stopEvent);
+    os_event_destroy(wakeEvent);
+}
+
+std::vector<AlsaSource::DeviceInfo> AlsaSource::GetDevices()
+{
+    std::vector<DeviceInfo> result;
+
+    void **hints = nullptr;
+    if (!alsa_success(snd_device_name_hint(-1, "pcm", &hints), "pcm", "device name hint"))
+        return result;
+
+    for (void **hint = hints; *hint; hint++) {
+        char *name = snd_device_name_get_hint(*hint, "NAME");
+        char *desc = snd_device_name_get_hint(*hint, "DESC");
+        char *ioid = snd_device_name_get_hint(*hint, "IOID");
+
+        bool capture = !ioid || strcmp(ioid, "Input") == 0;
+        if (name && capture && strncmp(name, "hw:", 3) == 0) {
+            std::string label = desc ? desc : name;
+            for (char &c : label) {
+                if (c == '\n')
+                    c = ' ';
+            }
+            result.push_back({name, label});
+        }
+
+        free(name);
+        free(desc);
+        free(ioid);
+    }
+
+    snd_device_name_free_hint(hints);
+    return result;
+}
+
+void AlsaSource::Update(obs_data_t *settings)
+{
+    std::string id = obs_data_get_string(settings, DEVICE_ID);
+
+    // debug taps and decoder options apply in place, only a different device
+    // needs the capture restarted
+    taps.Update(settings);
+    {
+        DecodeOptions options = DecodeOptions::FromSettings(settings);
+        options.device_key = id;
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        decodeOptions = options;
+#ifdef ENABLE_FFMPEG_DECODE
+        if (decode)
+            decode->SetOptions(options);
+#endif // ENABLE_FFMPEG_DECODE
+    }
+
+    if (id == deviceId)
+        return;
+
+    Stop();
+    deviceId = id;
+    Start();
+}
+
+void AlsaSource::Detach()
+{
+    sourceGate.Detach();
+    GetCaptureSessionRegistry().Leave(this);
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decodeMutex);
+    if (decode)
+        decode->Detach();
+#endif // ENABLE_FFMPEG_DECODE
+}
+
+std::string AlsaSource::DecoderStatsJson()
+{
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decodeMutex);
+    if (decode)
+        return decode->Stats().ToJson();
+#endif // ENABLE_FFMPEG_DECODE
+    return "{}";
+}
+
+void AlsaSource::Start()
+{
+    if (deviceId.empty())
+        return;
+
+    os_event_reset(stopEvent);
+    backoff.Reset();
+    thread = std::thread(&AlsaSource::CaptureLoop, this);
+}
+
+void AlsaSource::Stop()
+{
+    if (thread.joinable()) {
+        os_event_signal(stopEvent);
+        os_event_signal(wakeEvent);
+        thread.join();
+    }
+
+#ifdef ENABLE_FFMPEG_DECODE
+    FfmpegAudioDecode *oldDecode;
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        oldDecode = decode;
+        decode = nullptr;
+        session.reset();
+    }
+    delete oldDecode;
+#endif // ENABLE_FFMPEG_DECODE
+}
+
+void AlsaSource::CaptureLoop()
+{
+    os_set_thread_name("AVerMedia ALSA capture");
+
+    while (os_event_try(stopEvent) == EAGAIN) {
+        if (!pcm) {
+            if (!JoinSession()) {
+                // woken when the capturing source leaves, or on stop
+                os_event_wait(wakeEvent);
+                continue;
+            }
+            if (!Open()) {
+                os_event_timedwait(wakeEvent, backoff.NextDelayMs());
+                continue;
+            }
+            backoff.Reset();
+        }
+
+        bool ok = mmapAccess ? CaptureMmap() : CaptureRead();
+        if (!ok) {
+            obs_log(LOG_WARNING, "alsa: [%s] capture lost, reopening", deviceId.c_str());
+            Close();
+        }
+    }
+
+    Close();
+    GetCaptureSessionRegistry().Leave(this);
+    if (overruns)
+        obs_log(LOG_INFO, "alsa: [%s] %llu overruns", deviceId.c_str(),
+                (unsigned long long)overruns);
+}
+
+bool AlsaSource::Open()
+{
+    const char *device = deviceId.c_str();
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_uframes_t bufferFrames;
+    unsigned int rate = sampleRate;
+    int err;
+
+    err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_CAPTURE, 0);
+    if (!alsa_success(err, device, "open")) {
+        pcm = nullptr;
+        return false;
+    }
+
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(pcm, hw);
+
+    // mmap lets us hand the period straight from the DMA buffer to the
+    // detector and the packet ring; plugins that cannot map fall back to reads
+    mmapAccess = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!mmapAccess) {
+        err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (!alsa_success(err, device, "set access"))
+            goto fail;
+    }
+
+    // a bitstream has to arrive bit-exact: 16-bit stereo, no conversion
+    err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16_LE);
+    if (!alsa_success(err, device, "set format S16_LE"))
+        goto fail;
+    err = snd_pcm_hw_params_set_channels(pcm, hw, CHANNELS);
+    if (!alsa_success(err, device, "set channels"))
+        goto fail;
+    err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, nullptr);
+    if (!alsa_success(err, device, "set rate"))
+        goto fail;
+
+    periodFrames = PERIOD_FRAMES;
+    snd_pcm_hw_params_set_period_size_near(pcm, hw, &periodFrames, nullptr);
+    bufferFrames = periodFrames * PERIODS;
+    snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &bufferFrames);
+
+    err = snd_pcm_hw_params(pcm, hw);
+    if (!alsa_success(err, device, "apply hw params"))
+        goto fail;
+    snd_pcm_hw_params_get_period_size(hw, &periodFrames, nullptr);
+
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(pcm, sw);
+    snd_pcm_sw_params_set_avail_min(pcm, sw, periodFrames);
+    err = snd_pcm_sw_params(pcm, sw);
+    if (!alsa_success(err, device, "apply sw params"))
+        goto fail;
+
+    if (!mmapAccess)
+        readBuffer.resize(periodFrames * CHANNELS);
+
+    err = snd_pcm_start(pcm);
+    if (!alsa_success(err, device, "start"))
+        goto fail;
+
+    sampleRate = rate;
+    detector.Reset();
+    nonPcm = false;
+    obs_log(LOG_INFO, "alsa: [%s] capturing %u Hz, period %lu frames, %s access", device, rate,
+            (unsigned long)periodFrames, mmapAccess ? "mmap" : "read");
+    return true;
+
+fail:
+    Close();
+    return false;
+}
+
+void AlsaSource::Close()
+{
+    if (!pcm)
+        return;
+    snd_pcm_drop(pcm);
+    snd_pcm_close(pcm);
+    pcm = nullptr;
+}
+
+bool AlsaSource::Recover(int err)
+{
+    if (err == -EPIPE)
+        overruns++;
+
+    // an unplugged device reports ENODEV, reopen it rather than recover
+    if (err == -ENODEV || err == -EBADFD)
+        return false;
+
+    err = snd_pcm_recover(pcm, err, 1);
+    if (err == 0)
+        err = snd_pcm_start(pcm);
+    return alsa_success(err, deviceId.c_str(), "recover");
+}
+
+bool AlsaSource::CaptureMmap()
+{
+    int ready = snd_pcm_wait(pcm, WAIT_TIMEOUT_MS);
+    if (ready < 0)
+        return Recover(ready);
+    if (ready == 0)
+        return true; // nothing yet, check for stop and wait again
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+    if (avail < 0)
+        return Recover((int)avail);
+
+    snd_pcm_uframes_t remaining = (snd_pcm_uframes_t)avail;
+    while (remaining > 0) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = remaining;
+
+        int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+        if (err < 0)
+            return Recover(err);
+
+        const uint8_t *base = (const uint8_t *)areas[0].addr + areas[0].first / 8 +
+                              offset * (areas[0].step / 8);
+        Process((const int16_t *)base, frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, frames);
+        if (committed < 0 || (snd_pcm_uframes_t)committed != frames)
+            return Recover(committed < 0 ? (int)committed : -EPIPE);
+        remaining -= frames;
+    }
+    return true;
+}
+
+bool AlsaSource::CaptureRead()
+{
+    snd_pcm_sframes_t frames = snd_pcm_readi(pcm, readBuffer.data(), periodFrames);
+    if (frames == -EAGAIN)
+        return true;
+    if (frames < 0)
+        return Recover((int)frames);
+
+    Process(readBuffer.data(), (snd_pcm_uframes_t)frames);
+    return true;
+}
+
+void AlsaSource::Process(const int16_t *samples, snd_pcm_uframes_t frames)
+{
+    AVT_TRACE_SPAN("capture");
+    if (taps.raw.IsActive()) {
+        AudioDebugTap::Format format;
+        format.sample_rate = sampleRate;
+        format.channels = CHANNELS;
+        format.bits = 16;
+        taps.raw.SetFormat(format);
+        taps.raw.Write(samples, frames * BYTES_PER_FRAME);
+    }
+
+    detector.Feed(samples, frames, sampleRate);
+
+#ifdef ENABLE_FFMPEG_DECODE
+    bool wasNonPcm = nonPcm;
+    nonPcm = detector.IsNonPcm();
+
+    if (nonPcm && decode == nullptr) { /* having packets, create decoder now */
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        if (!sourceGate.Attached())
+            return; // being destroyed
+        std::shared_ptr<CaptureSession> shared = session;
+        uint64_t generation = sessionGeneration;
+        decode = new FfmpegAudioDecode(
+            [shared, generation](const struct obs_source_audio *audio) {
+                if (shared)
+                    shared->Output(generation, audio);
+            },
+            &taps, decodeOptions);
+    }
+    if (decode && nonPcm != wasNonPcm)
+        decode->SetEnabled(nonPcm); // drops what is left of the old stream
+
+    if (nonPcm) {
+        RealtimeScope rt;
+        decode->SetInputRate(sampleRate);
+        decode->OnEncodedAudioData((unsigned char *)samples, frames * BYTES_PER_FRAME, 0);
+        return;
+    }
+#endif // ENABLE_FFMPEG_DECODE
+
+    // steady state from here on: nothing below may allocate, lock or log
+    RealtimeScope rt;
+    struct obs_source_audio audio = {};
+    audio.data[0] = (const uint8_t *)samples;
+    audio.frames = (uint32_t)frames;
+    audio.speakers = SPEAKERS_STEREO;
+    audio.format = AUDIO_FORMAT_16BIT;
+    audio.samples_per_sec = sampleRate;
+    audio.timestamp = os_gettime_ns() - util_mul_div64(frames, UINT64_C(1000000000), sampleRate);
+
+    if (session)
+        session->Output(sessionGeneration, &audio);
+}
+
+bool AlsaSource::JoinSession()
+{
+    auto membership = GetCaptureSessionRegistry().Join(
+        deviceId, this, [this](const struct obs_source_audio *audio) { OutputAudio(audio); },
+        [this]() { os_event_signal(wakeEvent); });
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        session = membership.session;
+        sessionGeneration = membership.generation;
+    }
+
+    // Detach() may have run while joining
+    if (!sourceGate.Attached()) {
+        GetCaptureSessionRegistry().Leave(this);
+        return false;
+    }
+    if (!membership.leader)
+        obs_log(LOG_INFO, "alsa: [%s] sharing the capture of another source", deviceId.c_str());
+    return membership.leader;
+}
+
+// sink of this source in its capture session, on the leader's capture or
+// decode thread
+void AlsaSource::OutputAudio(const struct obs_source_audio *audio)
+{
+    OutputGate::Use source(sourceGate);
+    if (source) {
+        AVT_TRACE_SPAN("obs_source_output_audio");
+        RealtimeExempt exempt; // libobs locks, out of our hands
+        obs_source_output_audio(source.get(), audio);
+    }
+}
+
+} // namespace AVerMedia
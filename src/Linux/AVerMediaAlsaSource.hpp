@@ -0,0 +1,92 @@
+#pragma once
+
+#include <obs.hpp>
+#include <util/threading.h>
+#include <alsa/asoundlib.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioDebugTap.hpp"
+#include "BackoffPolicy.hpp"
+#include "CaptureSession.hpp"
+#include "DecodeOptions.hpp"
+#include "Iec61937.hpp"
+#include "OutputGate.hpp"
+
+namespace AVerMedia {
+
+class FfmpegAudioDecode;
+
+// Captures an AVerMedia card through ALSA; on Linux the cards show up as USB
+// Audio Class devices. There is no vendor SDK for Linux, so a bitstream is
+// recognised by its IEC 61937 preambles instead of asking the device, then
+// handled by the same FfmpegAudioDecode pipeline as on the other platforms.
+class AlsaSource
+{
+public:
+    struct DeviceInfo {
+        std::string id;
+        std::string name;
+    };
+
+    AlsaSource(obs_data_t *settings, obs_source_t *source);
+    ~AlsaSource();
+
+    // hw: capture devices only, plug devices may resample and corrupt a
+    // bitstream
+    static std::vector<DeviceInfo> GetDevices();
+
+    void Update(obs_data_t *settings);
+    // Cuts every path to the obs_source_t; called by the destroy callback
+    // before the rest of the teardown is deferred.
+    void Detach();
+    // DecoderStats of the running decoder, "{}" without one
+    std::string DecoderStatsJson();
+
+private:
+    void Start();
+    void Stop();
+    void CaptureLoop();
+
+    bool Open();
+    void Close();
+    bool CaptureMmap();
+    bool CaptureRead();
+    bool Recover(int err);
+    void Process(const int16_t *samples, snd_pcm_uframes_t frames);
+
+    bool JoinSession(); // true if this source captures
+    void OutputAudio(const struct obs_source_audio *audio);
+
+    obs_source_t *obsSource = nullptr;
+    OutputGate sourceGate;
+    std::string deviceId; // only changed while the capture thread is stopped
+
+    // capture thread only
+    snd_pcm_t *pcm = nullptr;
+    bool mmapAccess = false;
+    uint32_t sampleRate = 48000;
+    snd_pcm_uframes_t periodFrames = 0;
+    std::vector<int16_t> readBuffer; // RW access fallback
+    Iec61937Detector detector;
+    bool nonPcm = false;
+    uint64_t overruns = 0;
+    BackoffPolicy backoff;
+
+    std::thread thread;
+    os_event_t *stopEvent = nullptr;
+    os_event_t *wakeEvent = nullptr; // retry now, e.g. promoted to capture
+
+    AudioDebugTaps taps;
+    std::mutex decodeMutex; // decoder creation/removal, decodeOptions, session
+    DecodeOptions decodeOptions;
+    FfmpegAudioDecode *decode = nullptr;
+    std::shared_ptr<CaptureSession> session;
+    uint64_t sessionGeneration = 0;
+};
+
+} // namespace AVerMedia
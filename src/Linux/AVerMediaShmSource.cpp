@@ -0,0 +1,461 @@
+#include "AVerMediaShmSource.hpp"
+
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/util_uint64.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PipelineTrace.hpp"
+#include "RealtimeCheck.hpp"
+
+#ifdef ENABLE_FFMPEG_DECODE
+#include "FfmpegAudioDecode.hpp"
+#endif // ENABLE_FFMPEG_DECODE
+
+#define SHM_NAME           "shm_name"
+#define WAIT_TIMEOUT_MS    100
+#define IDLE_CHECK_NS      1000000000ULL // check for a dead producer once a second
+
+namespace AVerMedia {
+
+static_assert(sizeof(avt_shm_header) == 192, "avt_shm_header layout is shared with producers");
+static_assert(sizeof(avt_shm_record) == AVT_SHM_ALIGN, "records keep payloads aligned");
+
+static enum speaker_layout speakers_from_channels(uint32_t channels)
+{
+    switch (channels) {
+    case 1: return SPEAKERS_MONO;
+    case 2: return SPEAKERS_STEREO;
+    case 3: return SPEAKERS_2POINT1;
+    case 4: return SPEAKERS_4POINT0;
+    case 5: return SPEAKERS_4POINT1;
+    case 6: return SPEAKERS_5POINT1;
+    case 8: return SPEAKERS_7POINT1;
+    default: return SPEAKERS_UNKNOWN;
+    }
+}
+
+static bool process_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static void get_decoder_stats_proc(void *data, calldata_t *cd)
+{
+    auto source = reinterpret_cast<ShmSource *>(data);
+    calldata_set_string(cd, "json", source->DecoderStatsJson().c_str());
+}
+
+ShmSource::ShmSource(obs_data_t *settings, obs_source_t *source)
+    : obsSource(source), sourceGate(source)
+{
+    os_event_init(&stopEvent, OS_EVENT_TYPE_MANUAL);
+    os_event_init(&wakeEvent, OS_EVENT_TYPE_AUTO);
+
+    shmName = obs_data_get_string(settings, SHM_NAME);
+    taps.Update(settings);
+    decodeOptions = DecodeOptions::FromSettings(settings);
+    decodeOptions.device_key = shmName;
+
+    proc_handler_t *ph = obs_source_get_proc_handler(source);
+    proc_handler_add(ph, "void get_decoder_stats(out string json)", get_decoder_stats_proc, this);
+
+    Start();
+}
+
+ShmSource::~ShmSource()
+{
+    Stop();
+    os_event_destroy(stopEvent);
+    os_event_destroy(wakeEvent);
+}
+
+void ShmSource::Update(obs_data_t *settings)
+{
+    std::string name = obs_data_get_string(settings, SHM_NAME);
+
+    taps.Update(settings);
+    {
+        DecodeOptions options = DecodeOptions::FromSettings(settings);
+        options.device_key = name;
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        decodeOptions = options;
+#ifdef ENABLE_FFMPEG_DECODE
+        if (decode)
+            decode->SetOptions(options);
+#endif // ENABLE_FFMPEG_DECODE
+    }
+
+    if (name == shmName)
+        return;
+
+    Stop();
+    shmName = name;
+    Start();
+}
+
+void ShmSource::Detach()
+{
+    sourceGate.Detach();
+    GetCaptureSessionRegistry().Leave(this);
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decodeMutex);
+    if (decode)
+        decode->Detach();
+#endif // ENABLE_FFMPEG_DECODE
+}
+
+std::string ShmSource::DecoderStatsJson()
+{
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decodeMutex);
+    if (decode)
+        return decode->Stats().ToJson();
+#endif // ENABLE_FFMPEG_DECODE
+    return "{}";
+}
+
+void ShmSource::Start()
+{
+    if (shmName.empty())
+        return;
+
+    os_event_reset(stopEvent);
+    backoff.Reset();
+    missingLogged = false;
+    thread = std::thread(&ShmSource::ConsumeLoop, this);
+}
+
+void ShmSource::Stop()
+{
+    if (thread.joinable()) {
+        os_event_signal(stopEvent);
+        os_event_signal(wakeEvent);
+        thread.join();
+    }
+
+#ifdef ENABLE_FFMPEG_DECODE
+    FfmpegAudioDecode *oldDecode;
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        oldDecode = decode;
+        decode = nullptr;
+        session.reset();
+    }
+    delete oldDecode;
+#endif // ENABLE_FFMPEG_DECODE
+}
+
+void ShmSource::ConsumeLoop()
+{
+    os_set_thread_name("AVerMedia shm ingest");
+
+    while (os_event_try(stopEvent) == EAGAIN) {
+        if (!ring) {
+            if (!JoinSession()) {
+                // woken when the consuming source leaves, or on stop
+                os_event_wait(wakeEvent);
+                continue;
+            }
+            if (!Attach()) {
+                os_event_timedwait(wakeEvent, backoff.NextDelayMs());
+                continue;
+            }
+            backoff.Reset();
+        }
+
+        if (!Drain()) {
+            obs_log(LOG_WARNING, "shm: [%s] ring is corrupt, reattaching", shmName.c_str());
+            Release();
+            continue;
+        }
+
+        // Sleep on the futex until the producer commits. It only issues the
+        // wake syscall while we announce that we are waiting.
+        __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        uint32_t seq = __atomic_load_n(&ring->wake_seq, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+            avt_shm_futex_wait(&ring->wake_seq, seq, WAIT_TIMEOUT_MS);
+        __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+
+        uint64_t now = os_gettime_ns();
+        if (now - lastDataNs >= IDLE_CHECK_NS && now - lastCheckNs >= IDLE_CHECK_NS) {
+            lastCheckNs = now;
+            if (ProducerGone()) {
+                obs_log(LOG_INFO, "shm: [%s] producer went away", shmName.c_str());
+                Release();
+            }
+        }
+    }
+
+    Release();
+    GetCaptureSessionRegistry().Leave(this);
+}
+
+bool ShmSource::Attach()
+{
+    const char *name = shmName.c_str();
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        if (!missingLogged)
+            obs_log(LOG_INFO, "shm: [%s] waiting for the producer: %s", name, strerror(errno));
+        missingLogged = true;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(avt_shm_header)) {
+        close(fd);
+        return false; // producer is still setting it up
+    }
+
+    void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        obs_log(LOG_WARNING, "shm: [%s] mmap failed: %s", name, strerror(errno));
+        return false;
+    }
+
+    ring = (avt_shm_header *)mapped;
+    mappedSize = (size_t)st.st_size;
+    ringInode = st.st_ino;
+
+    // the producer publishes the magic after the rest of the header
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != AVT_SHM_MAGIC) {
+        Release();
+        return false;
+    }
+
+    uint64_t capacity = ring->capacity;
+    format = ring->format;
+    sampleRate = ring->sample_rate;
+    channels = ring->channels;
+    speakers = speakers_from_channels(channels);
+
+    const char *invalid = nullptr;
+    if (ring->version != AVT_SHM_VERSION)
+        invalid = "unsupported version";
+    else if (ring->header_size < sizeof(avt_shm_header) || ring->header_size % AVT_SHM_ALIGN)
+        invalid = "bad header size";
+    else if (capacity < 4096 || (capacity & (capacity - 1)) ||
+             ring->header_size + capacity > mappedSize)
+        invalid = "bad capacity";
+    else if (format > AVT_SHM_FORMAT_IEC61937 || sampleRate < 8000 || sampleRate > 384000)
+        invalid = "bad format";
+    else if (speakers == SPEAKERS_UNKNOWN || (format == AVT_SHM_FORMAT_IEC61937 && channels != 2))
+        invalid = "bad channel count";
+    if (invalid) {
+        obs_log(LOG_WARNING, "shm: [%s] %s", name, invalid);
+        Release();
+        return false;
+    }
+
+    // single consumer: take over only from a consumer that is gone
+    int32_t self = (int32_t)getpid();
+    int32_t owner = 0;
+    while (!__atomic_compare_exchange_n(&ring->consumer_pid, &owner, self, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if (owner == self || process_alive(owner)) {
+            obs_log(LOG_WARNING, "shm: [%s] already consumed by process %d", name, owner);
+            munmap(ring, mappedSize);
+            ring = nullptr;
+            return false;
+        }
+    }
+
+    // start at the newest record, whatever queued up before is stale
+    __atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+
+    detector.Reset();
+    nonPcm = format == AVT_SHM_FORMAT_IEC61937;
+    lastDataNs = lastCheckNs = os_gettime_ns();
+    missingLogged = false;
+    obs_log(LOG_INFO, "shm: [%s] attached to producer %d, %u Hz, %u channels, %s, %llu KiB", name,
+            ring->producer_pid, sampleRate, channels,
+            format == AVT_SHM_FORMAT_PCM        ? "pcm"
+            : format == AVT_SHM_FORMAT_IEC61937 ? "iec61937"
+                                                : "auto",
+            (unsigned long long)(capacity / 1024));
+    return true;
+}
+
+void ShmSource::Release()
+{
+    if (!ring)
+        return;
+
+    int32_t self = (int32_t)getpid();
+    __atomic_compare_exchange_n(&ring->consumer_pid, &self, 0, false, __ATOMIC_RELEASE,
+                                __ATOMIC_RELAXED);
+    if (records)
+        obs_log(LOG_INFO, "shm: [%s] detached after %llu records, %llu discontinuities, "
+                "%llu dropped by the producer", shmName.c_str(), (unsigned long long)records,
+                (unsigned long long)discontinuities,
+                (unsigned long long)__atomic_load_n(&ring->records_dropped, __ATOMIC_RELAXED));
+
+    munmap(ring, mappedSize);
+    ring = nullptr;
+    mappedSize = 0;
+    records = 0;
+    discontinuities = 0;
+}
+
+bool ShmSource::ProducerGone()
+{
+    if (!process_alive(ring->producer_pid))
+        return true;
+
+    // a restarted producer unlinks the old object and creates a new one
+    int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return true;
+    struct stat st;
+    bool replaced = fstat(fd, &st) != 0 || st.st_ino != ringInode;
+    close(fd);
+    return replaced;
+}
+
+bool ShmSource::Drain()
+{
+    const uint64_t capacity = ring->capacity;
+    const uint8_t *data = avt_shm_data(ring);
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (head - tail > capacity)
+        return false;
+
+    while (tail != head) {
+        uint64_t offset = tail & (capacity - 1);
+        // copy the record header, the payload is used in place
+        avt_shm_record record;
+        memcpy(&record, data + offset, sizeof(record));
+        uint64_t bytes = avt_shm_record_bytes(record.size);
+        if (bytes > capacity - offset || bytes > head - tail)
+            return false;
+
+        if (!(record.flags & AVT_SHM_RECORD_PAD))
+            Process(&record, data + offset + sizeof(record));
+
+        tail += bytes;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+void ShmSource::Process(const avt_shm_record *record, const uint8_t *payload)
+{
+    AVT_TRACE_SPAN("capture");
+    const size_t frameBytes = channels * sizeof(int16_t);
+    const size_t frames = record->size / frameBytes;
+    if (frames == 0)
+        return;
+
+    records++;
+    lastDataNs = os_gettime_ns();
+    if (record->flags & AVT_SHM_RECORD_DISCONTINUITY)
+        discontinuities++;
+
+    if (taps.raw.IsActive()) {
+        AudioDebugTap::Format tapFormat;
+        tapFormat.sample_rate = sampleRate;
+        tapFormat.channels = (uint16_t)channels;
+        tapFormat.bits = 16;
+        taps.raw.SetFormat(tapFormat);
+        taps.raw.Write(payload, frames * frameBytes);
+    }
+
+#ifdef ENABLE_FFMPEG_DECODE
+    bool wasNonPcm = nonPcm;
+    if (format == AVT_SHM_FORMAT_AUTO && channels == 2) {
+        detector.Feed((const int16_t *)payload, frames, sampleRate);
+        nonPcm = detector.IsNonPcm();
+    }
+
+    if (nonPcm && decode == nullptr) { /* having packets, create decoder now */
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        if (!sourceGate.Attached())
+            return; // being destroyed
+        std::shared_ptr<CaptureSession> shared = session;
+        uint64_t generation = sessionGeneration;
+        decode = new FfmpegAudioDecode(
+            [shared, generation](const struct obs_source_audio *audio) {
+                if (shared)
+                    shared->Output(generation, audio);
+            },
+            &taps, decodeOptions);
+    }
+    if (decode && nonPcm != wasNonPcm)
+        decode->SetEnabled(nonPcm); // drops what is left of the old stream
+
+    if (nonPcm) {
+        RealtimeScope rt;
+        decode->SetInputRate(sampleRate);
+        decode->OnEncodedAudioData((unsigned char *)payload, frames * frameBytes,
+                                   (long long)record->timestamp_ns);
+        return;
+    }
+#endif // ENABLE_FFMPEG_DECODE
+
+    // steady state from here on: nothing below may allocate, lock or log
+    RealtimeScope rt;
+    struct obs_source_audio audio = {};
+    audio.data[0] = payload;
+    audio.frames = (uint32_t)frames;
+    audio.speakers = speakers;
+    audio.format = AUDIO_FORMAT_16BIT;
+    audio.samples_per_sec = sampleRate;
+    // producers stamp with CLOCK_MONOTONIC, the clock behind os_gettime_ns()
+    audio.timestamp = record->timestamp_ns
+                          ? record->timestamp_ns
+                          : os_gettime_ns() - util_mul_div64(frames, UINT64_C(1000000000), sampleRate);
+
+    if (session)
+        session->Output(sessionGeneration, &audio);
+}
+
+bool ShmSource::JoinSession()
+{
+    // one consumer per ring: sources on the same name share it
+    auto membership = GetCaptureSessionRegistry().Join(
+        "shm:" + shmName, this,
+        [this](const struct obs_source_audio *audio) { OutputAudio(audio); },
+        [this]() { os_event_signal(wakeEvent); });
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        session = membership.session;
+        sessionGeneration = membership.generation;
+    }
+
+    // Detach() may have run while joining
+    if (!sourceGate.Attached()) {
+        GetCaptureSessionRegistry().Leave(this);
+        return false;
+    }
+    if (!membership.leader)
+        obs_log(LOG_INFO, "shm: [%s] sharing the ring of another source", shmName.c_str());
+    return membership.leader;
+}
+
+// sink of this source in its capture session, on the leader's consumer or
+// decode thread
+void ShmSource::OutputAudio(const struct obs_source_audio *audio)
+{
+    OutputGate::Use source(sourceGate);
+    if (source) {
+        AVT_TRACE_SPAN("obs_source_output_audio");
+        RealtimeExempt exempt; // libobs locks, out of our hands
+        obs_source_output_audio(source.get(), audio);
+    }
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <obs.hpp>
+#include <util/threading.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "AudioDebugTap.hpp"
+#include "BackoffPolicy.hpp"
+#include "CaptureSession.hpp"
+#include "DecodeOptions.hpp"
+#include "Iec61937.hpp"
+#include "OutputGate.hpp"
+#include "avt-shm-ring.h"
+
+namespace AVerMedia {
+
+class FfmpegAudioDecode;
+
+// Takes audio from a capture helper process through a POSIX shared memory
+// ring (avt-shm-ring.h) instead of opening a device. Payloads are handed to
+// the decoder or OBS straight from the mapping. A restarted producer is
+// picked up by reattaching to the same name.
+class ShmSource
+{
+public:
+    ShmSource(obs_data_t *settings, obs_source_t *source);
+    ~ShmSource();
+
+    void Update(obs_data_t *settings);
+    // Cuts every path to the obs_source_t; called by the destroy callback
+    // before the rest of the teardown is deferred.
+    void Detach();
+    // DecoderStats of the running decoder, "{}" without one
+    std::string DecoderStatsJson();
+
+private:
+    void Start();
+    void Stop();
+    void ConsumeLoop();
+
+    bool Attach();
+    void Release();
+    bool ProducerGone();
+    // false if the ring is corrupt and has to be reattached
+    bool Drain();
+    void Process(const avt_shm_record *record, const uint8_t *payload);
+
+    bool JoinSession(); // true if this source consumes the ring
+    void OutputAudio(const struct obs_source_audio *audio);
+
+    obs_source_t *obsSource = nullptr;
+    OutputGate sourceGate;
+    std::string shmName; // only changed while the consumer thread is stopped
+
+    // consumer thread only
+    avt_shm_header *ring = nullptr;
+    size_t mappedSize = 0;
+    ino_t ringInode = 0;
+    uint32_t format = AVT_SHM_FORMAT_AUTO;
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    enum speaker_layout speakers = SPEAKERS_UNKNOWN;
+    Iec61937Detector detector;
+    bool nonPcm = false;
+    uint64_t records = 0;
+    uint64_t lastDataNs = 0;
+    uint64_t lastCheckNs = 0;
+    bool missingLogged = false; // the producer is not there yet
+    uint64_t discontinuities = 0;
+    BackoffPolicy backoff{BackoffPolicy::Config{100, 2000}}; // producers restart quickly
+
+    std::thread thread;
+    os_event_t *stopEvent = nullptr;
+    os_event_t *wakeEvent = nullptr; // retry now, e.g. promoted to consume
+
+    AudioDebugTaps taps;
+    std::mutex decodeMutex; // decoder creation/removal, decodeOptions, session
+    DecodeOptions decodeOptions;
+    FfmpegAudioDecode *decode = nullptr;
+    std::shared_ptr<CaptureSession> session;
+    uint64_t sessionGeneration = 0;
+};
+
+} // namespace AVerMedia
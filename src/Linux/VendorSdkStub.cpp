@@ -0,0 +1,63 @@
+// The vendor SDK and DeviceOpener ship as Windows and macOS binaries only.
+// Linux sources detect the stream format in-band (see Iec61937.hpp), so this
+// stub only has to let the common code load and unload the SDK: initialize()
+// fails and WaitVendorSdkReady() reports the SDK as unavailable.
+
+#include "AVerMediaVendorSdkLoader.h"
+
+namespace AVerMedia {
+
+struct VendorSdk::VendorSdkPrivate {};
+
+VendorSdk::VendorSdk(const char *) {}
+
+VendorSdk::~VendorSdk() {}
+
+int VendorSdk::initialize()
+{
+    return -1;
+}
+
+int VendorSdk::uninitialize()
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::setDevice(const char *, const char *, int, int)
+{
+    return -1;
+}
+
+int VendorSdk::setPort(int, const char *)
+{
+    return -1;
+}
+
+int VendorSdk::closePort()
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::getAudioFormat(int *)
+{
+    return -1;
+}
+
+int VendorSdk::getNonPcmOnOff(unsigned int *)
+{
+    return -1;
+}
+
+int VendorSdk::setNonPcmOnOff(int)
+{
+    return -1;
+}
+
+int VendorSdk::getSerialNum(unsigned char *, unsigned int, unsigned int *resultLen)
+{
+    if (resultLen)
+        *resultLen = 0;
+    return -1;
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,105 @@
+#include <obs-module.h>
+#include <plugin-support.h>
+
+#include "AVerMediaAlsaSource.hpp"
+#include "SourceReaper.hpp"
+#include "DeviceRegistry.hpp"
+
+#define TEXT_DEVICE        obs_module_text("Device")
+
+static AVerMedia::DeviceList enumerate_devices()
+{
+    AVerMedia::DeviceList result;
+    for (const auto &device : AVerMedia::AlsaSource::GetDevices())
+        result.push_back({device.id, device.name});
+    return result;
+}
+
+static AVerMedia::DeviceRegistry g_deviceRegistry(enumerate_devices);
+
+static const char *avt_alsa_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return obs_module_text("AVerMedia.DolbyAudio.DisplayName");
+}
+
+static void avt_alsa_destroy(void *data)
+{
+    obs_log(LOG_INFO, "avt_alsa_destroy");
+    auto alsa = reinterpret_cast<AVerMedia::AlsaSource*>(data);
+
+    // the source is gone once this returns, the capture and decode threads
+    // are joined in the background
+    alsa->Detach();
+    AVerMedia::GetSourceReaper().Defer("avt_alsa_source", [alsa]() { delete alsa; });
+}
+
+static void *avt_alsa_create(obs_data_t *settings, obs_source_t *source)
+{
+    obs_log(LOG_INFO, "avt_alsa_create");
+    return new AVerMedia::AlsaSource(settings, source);
+}
+
+static void avt_alsa_update(void *data, obs_data_t *settings)
+{
+    obs_log(LOG_INFO, "avt_alsa_update");
+    reinterpret_cast<AVerMedia::AlsaSource*>(data)->Update(settings);
+}
+
+static void avt_alsa_get_defaults(obs_data_t *settings)
+{
+    AVerMedia::DecodeOptions::GetDefaults(settings);
+    AVerMedia::AudioDebugTaps::GetDefaults(settings);
+}
+
+static obs_properties_t *avt_alsa_get_properties(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    obs_properties_t *props = obs_properties_create();
+
+    // editable, so any PCM from asoundrc works too, e.g. a file plugin
+    // replaying a recorded bitstream
+    obs_property_t *property =
+            obs_properties_add_list(props, "device_id", TEXT_DEVICE,
+                                    OBS_COMBO_TYPE_EDITABLE, OBS_COMBO_FORMAT_STRING);
+
+    auto devices = g_deviceRegistry.Snapshot();
+    for (const auto &device : *devices) {
+        obs_log(LOG_INFO, "device_id: %s", device.id.c_str());
+        obs_log(LOG_INFO, "device_name: %s", device.name.c_str());
+
+        obs_property_list_add_string(property, device.name.c_str(), device.id.c_str());
+    }
+    // ALSA has no hotplug notification without udev: rescan in the
+    // background, the next time the properties open they show the result
+    g_deviceRegistry.Invalidate();
+
+    AVerMedia::DecodeOptions::AddProperties(props);
+    AVerMedia::AudioDebugTaps::AddProperties(props);
+    return props;
+}
+
+extern "C" {
+void RegisterAVerMediaAlsaInput()
+{
+    struct obs_source_info avt_alsa_input = {};
+    avt_alsa_input.id = "avt_alsa_source";
+    avt_alsa_input.type = OBS_SOURCE_TYPE_INPUT;
+    avt_alsa_input.output_flags = OBS_SOURCE_AUDIO;
+    avt_alsa_input.get_name = avt_alsa_getname;
+    avt_alsa_input.create = avt_alsa_create;
+    avt_alsa_input.destroy = avt_alsa_destroy;
+    avt_alsa_input.update = avt_alsa_update;
+    avt_alsa_input.get_defaults = avt_alsa_get_defaults;
+    avt_alsa_input.get_properties = avt_alsa_get_properties;
+    avt_alsa_input.icon_type = OBS_ICON_TYPE_AUDIO_INPUT;
+    obs_register_source(&avt_alsa_input);
+
+    g_deviceRegistry.Start();
+}
+
+void UnregisterAVerMediaAlsaInput()
+{
+    g_deviceRegistry.Stop();
+}
+} // extern "C"
@@ -0,0 +1,76 @@
+#include <obs-module.h>
+#include <plugin-support.h>
+
+#include "AVerMediaShmSource.hpp"
+#include "SourceReaper.hpp"
+
+#define TEXT_SHM_NAME      obs_module_text("ShmName")
+#define TEXT_SHM_NAME_DESC obs_module_text("ShmName.Description")
+
+static const char *avt_shm_getname(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return obs_module_text("AVerMedia.DolbyAudio.ShmDisplayName");
+}
+
+static void avt_shm_destroy(void *data)
+{
+    obs_log(LOG_INFO, "avt_shm_destroy");
+    auto shm = reinterpret_cast<AVerMedia::ShmSource*>(data);
+
+    // the source is gone once this returns, the consumer and decode threads
+    // are joined in the background
+    shm->Detach();
+    AVerMedia::GetSourceReaper().Defer("avt_shm_source", [shm]() { delete shm; });
+}
+
+static void *avt_shm_create(obs_data_t *settings, obs_source_t *source)
+{
+    obs_log(LOG_INFO, "avt_shm_create");
+    return new AVerMedia::ShmSource(settings, source);
+}
+
+static void avt_shm_update(void *data, obs_data_t *settings)
+{
+    obs_log(LOG_INFO, "avt_shm_update");
+    reinterpret_cast<AVerMedia::ShmSource*>(data)->Update(settings);
+}
+
+static void avt_shm_get_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_string(settings, "shm_name", AVT_SHM_DEFAULT_NAME);
+    AVerMedia::DecodeOptions::GetDefaults(settings);
+    AVerMedia::AudioDebugTaps::GetDefaults(settings);
+}
+
+static obs_properties_t *avt_shm_get_properties(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    obs_properties_t *props = obs_properties_create();
+
+    obs_property_t *property =
+            obs_properties_add_text(props, "shm_name", TEXT_SHM_NAME, OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(property, TEXT_SHM_NAME_DESC);
+
+    AVerMedia::DecodeOptions::AddProperties(props);
+    AVerMedia::AudioDebugTaps::AddProperties(props);
+    return props;
+}
+
+extern "C" {
+void RegisterAVerMediaShmInput()
+{
+    struct obs_source_info avt_shm_input = {};
+    avt_shm_input.id = "avt_shm_source";
+    avt_shm_input.type = OBS_SOURCE_TYPE_INPUT;
+    avt_shm_input.output_flags = OBS_SOURCE_AUDIO;
+    avt_shm_input.get_name = avt_shm_getname;
+    avt_shm_input.create = avt_shm_create;
+    avt_shm_input.destroy = avt_shm_destroy;
+    avt_shm_input.update = avt_shm_update;
+    avt_shm_input.get_defaults = avt_shm_get_defaults;
+    avt_shm_input.get_properties = avt_shm_get_properties;
+    avt_shm_input.icon_type = OBS_ICON_TYPE_AUDIO_INPUT;
+    obs_register_source(&avt_shm_input);
+}
+} // extern "C"
@@ -0,0 +1,175 @@
+/*
+ * Shared-memory audio ring between an out-of-process capture helper (the
+ * producer) and avt_shm_source (the consumer). Plain C so producers do not
+ * need the plugin's C++ headers; see tools/shm-producer for an example.
+ *
+ * The POSIX shared memory object holds an avt_shm_header followed by
+ * `capacity` bytes of ring data. The ring is a sequence of records, each an
+ * avt_shm_record followed by its payload padded to AVT_SHM_ALIGN bytes.
+ * Records never wrap: when a record does not fit before the end of the data
+ * the producer fills the rest with a padding record and starts over at 0.
+ * `head` and `tail` are byte counters that only grow; a position in the data
+ * is counter & (capacity - 1).
+ *
+ * Payloads are interleaved signed 16-bit little-endian samples, either PCM
+ * or an IEC 61937 bitstream in 16-bit stereo, as described by `format`.
+ * Timestamps are CLOCK_MONOTONIC nanoseconds of the first sample.
+ *
+ * Exactly one producer and one consumer; the consumer claims the ring by
+ * storing its pid in `consumer_pid`.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVT_SHM_MAGIC          0x4d485341u /* "ASHM" */
+#define AVT_SHM_VERSION        1u
+#define AVT_SHM_ALIGN          16u
+#define AVT_SHM_DEFAULT_NAME   "/avt-capture"
+
+enum avt_shm_format {
+	AVT_SHM_FORMAT_AUTO = 0,     /* PCM or IEC 61937, told apart by preambles */
+	AVT_SHM_FORMAT_PCM = 1,
+	AVT_SHM_FORMAT_IEC61937 = 2, /* requires 2 channels */
+};
+
+enum avt_shm_record_flags {
+	AVT_SHM_RECORD_PAD = 1u << 0,           /* skip to the start of the data */
+	AVT_SHM_RECORD_DISCONTINUITY = 1u << 1, /* samples were lost before this one */
+};
+
+struct avt_shm_record {
+	uint32_t size;  /* payload bytes, without padding */
+	uint32_t flags;
+	uint64_t timestamp_ns;
+};
+
+/* producer and consumer owned fields sit on separate cache lines */
+struct avt_shm_header {
+	/* written once by the producer before it publishes `magic` */
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t format;
+	uint32_t sample_rate;
+	uint32_t channels;
+	uint64_t capacity; /* power of two, multiple of AVT_SHM_ALIGN */
+	int32_t producer_pid;
+	uint32_t reserved0;
+	uint8_t pad0[24];
+
+	/* producer */
+	uint64_t head;
+	uint64_t records_dropped; /* ring was full */
+	uint32_t wake_seq;        /* futex word, bumped on every commit */
+	uint8_t pad1[44];
+
+	/* consumer */
+	uint64_t tail;
+	int32_t consumer_pid;
+	uint32_t consumer_waiting;
+	uint8_t pad2[48];
+};
+
+#define AVT_SHM_HEADER_SIZE ((uint32_t)sizeof(struct avt_shm_header))
+
+static inline uint64_t avt_shm_record_bytes(uint32_t size)
+{
+	return sizeof(struct avt_shm_record) + (((uint64_t)size + AVT_SHM_ALIGN - 1) & ~(uint64_t)(AVT_SHM_ALIGN - 1));
+}
+
+static inline uint8_t *avt_shm_data(struct avt_shm_header *h)
+{
+	return (uint8_t *)h + h->header_size;
+}
+
+#ifdef __linux__
+static inline void avt_shm_futex_wake(uint32_t *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void avt_shm_futex_wait(uint32_t *word, uint32_t expected, uint32_t timeout_ms)
+{
+	struct timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+	syscall(SYS_futex, word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+#endif
+
+/*
+ * Producer: returns where to put `size` payload bytes, or NULL if the ring
+ * is full. Nothing is visible to the consumer before avt_shm_commit().
+ */
+static inline void *avt_shm_reserve(struct avt_shm_header *h, uint32_t size)
+{
+	uint64_t need = avt_shm_record_bytes(size);
+	uint64_t head = h->head;
+	uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+	uint64_t offset = head & (h->capacity - 1);
+	uint64_t contiguous = h->capacity - offset;
+	uint64_t pad = contiguous < need ? contiguous : 0;
+
+	if (need > h->capacity / 2 || head + pad + need - tail > h->capacity) {
+		__atomic_add_fetch(&h->records_dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	if (pad) {
+		struct avt_shm_record *rec = (struct avt_shm_record *)(avt_shm_data(h) + offset);
+		rec->size = (uint32_t)(pad - sizeof(struct avt_shm_record));
+		rec->flags = AVT_SHM_RECORD_PAD;
+		rec->timestamp_ns = 0;
+		__atomic_store_n(&h->head, head + pad, __ATOMIC_RELEASE);
+		offset = 0;
+	}
+	return avt_shm_data(h) + offset + sizeof(struct avt_shm_record);
+}
+
+/* Producer: publishes the record reserved last with `size` payload bytes. */
+static inline void avt_shm_commit(struct avt_shm_header *h, uint32_t size, uint32_t flags,
+				  uint64_t timestamp_ns)
+{
+	uint64_t head = h->head;
+	struct avt_shm_record *rec =
+		(struct avt_shm_record *)(avt_shm_data(h) + (head & (h->capacity - 1)));
+	rec->size = size;
+	rec->flags = flags;
+	rec->timestamp_ns = timestamp_ns;
+	__atomic_store_n(&h->head, head + avt_shm_record_bytes(size), __ATOMIC_RELEASE);
+
+	__atomic_add_fetch(&h->wake_seq, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	if (__atomic_load_n(&h->consumer_waiting, __ATOMIC_SEQ_CST))
+		avt_shm_futex_wake(&h->wake_seq);
+#endif
+}
+
+static inline int avt_shm_write(struct avt_shm_header *h, const void *data, uint32_t size,
+				uint32_t flags, uint64_t timestamp_ns)
+{
+	void *dst = avt_shm_reserve(h, size);
+	if (!dst)
+		return 0;
+	memcpy(dst, data, size);
+	avt_shm_commit(h, size, flags, timestamp_ns);
+	return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
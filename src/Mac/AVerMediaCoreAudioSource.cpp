@@ -1,9 +1,16 @@
 #include "AVerMediaCoreAudioSource.h"
 
 #include "audio-device-enum.h"
+#include "AudioInterleave.hpp"
+#include "RealtimeCheck.hpp"
+#include "VendorSdkLoader.hpp"
+#include "VendorSdkScheduler.hpp"
+#include "CaptureSession.hpp"
+#include "PipelineTrace.hpp"
 #include <plugin-support.h>
 #include <mach/mach_time.h>
 #include <util/dstr.h>
+#include <util/platform.h>
 #include <util/apple/cfstring-utils.h>
 #include <media-io/audio-io.h>
 
@@ -149,12 +156,22 @@ static void *reconnect_thread(void *param)
 {
     AVerMedia::CoreAudioSource *ca = reinterpret_cast<AVerMedia::CoreAudioSource*>(param);
 
-    ca->reconnecting = true;
+    while (true) {
+        // resets are requested from other threads, the policy is ours alone
+        if (ca->backoff_reset.exchange(false))
+            ca->backoff.Reset();
+        uint32_t delay = ca->backoff.NextDelayMs();
+        bool woken = os_event_timedwait(ca->wake_event, delay) == 0;
+        if (os_event_try(ca->exit_event) == 0)
+            break;
 
-    while (os_event_timedwait(ca->exit_event, ca->retry_time) ==
-           ETIMEDOUT) {
-        if (ca->coreaudio_init())
+        if (ca->coreaudio_init()) {
+            obs_log(LOG_INFO, "coreaudio: reconnected after %u attempts",
+                    ca->backoff.Attempts());
             break;
+        }
+        if (woken)
+            obs_log(LOG_DEBUG, "coreaudio: device list changed, device still missing");
     }
 
     obs_log(LOG_DEBUG, "coreaudio: exit the reconnect thread");
@@ -162,6 +179,19 @@ static void *reconnect_thread(void *param)
     return NULL;
 }
 
+static OSStatus devices_changed_callback(AudioObjectID, UInt32,
+                                         const AudioObjectPropertyAddress *, void *data)
+{
+    AVerMedia::CoreAudioSource *ca = reinterpret_cast<AVerMedia::CoreAudioSource*>(data);
+    os_event_signal(ca->wake_event);
+    return noErr;
+}
+
+static const AudioObjectPropertyAddress devices_address = {
+    kAudioHardwarePropertyDevices,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMain};
+
 static bool find_device_id_by_uid(AVerMedia::CoreAudioSource *ca)
 {
     if (!ca->device_uid) {
@@ -230,7 +260,7 @@ notification_callback(AudioObjectID id, UInt32 num_addresses,
 
     ca->coreaudio_stop();
     ca->coreaudio_uninit();
-    ca->retry_time = 2000;
+    ca->backoff_reset = true;
 
     obs_log(LOG_INFO,
          "coreaudio: device '%s' disconnected or changed.  "
@@ -261,6 +291,7 @@ static OSStatus input_callback(void *data,
                                UInt32 frames, AudioBufferList *ignored_buffers)
 {
     AVerMedia::CoreAudioSource *ca = reinterpret_cast<AVerMedia::CoreAudioSource*>(data);
+    AVT_TRACE_SPAN("capture");
 
     OSStatus stat = AudioUnitRender(ca->unit, action_flags, ts_data, bus_num, frames,
                            ca->buf_list);
@@ -272,57 +303,39 @@ static OSStatus input_callback(void *data,
     // obs_log(LOG_INFO, "ca->format %d", ca->format);
 
 
-    if (ca->format == AUDIO_FORMAT_32BIT_PLANAR && ca->buf_list->mNumberBuffers >= 2) {
-        // 假設每個音頻樣本是一個 Float32 值 //SInt32
-#if 0
-        {
-            SInt32 *buffer = (SInt32*)malloc(ca->buf_list->mBuffers[0].mDataByteSize * 2);
-            SInt32 *left = (SInt32 *)ca->buf_list->mBuffers[2].mData;
-            SInt32 *right = (SInt32 *)ca->buf_list->mBuffers[3].mData;
-
-            for (UInt32 i = 0; i < ca->buf_list->mBuffers[0].mDataByteSize / sizeof(SInt32); i++) {
-                buffer[i * 2] = left[i];
-                buffer[i * 2 + 1] = right[i];
-            }
-
-            if (ca->log_file2 != nullptr) {
-                fwrite(buffer, sizeof(SInt32), ca->buf_list->mBuffers[0].mDataByteSize * 2 / sizeof(SInt32), ca->log_file2);
-            }
-            free(buffer);
-        }
-#endif
-        SInt32 *left = nullptr;
-        SInt32 *right = nullptr;
-
-        if (ca->buf_list->mNumberBuffers == 4) {
-            // obs_log(LOG_INFO, "ca->buf_list->mNumberBuffers == 4");
-            left = (SInt32 *)ca->buf_list->mBuffers[2].mData;
-            right = (SInt32 *)ca->buf_list->mBuffers[3].mData;
-        }
-        else {
-            left = (SInt32 *)ca->buf_list->mBuffers[0].mData;
-            right = (SInt32 *)ca->buf_list->mBuffers[1].mData;
-        }
+    if (ca->interleave_stereo) {
+#ifdef ENABLE_FFMPEG_DECODE
+        AVerMedia::VendorSdkScheduler::FormatState *state =
+            ca->formatState.load(std::memory_order_acquire);
+        bool nonPcm = state && state->IsNonPcm();
+        // created by the device switch or the format probe, never here
+        AVerMedia::FfmpegAudioDecode *decode = ca->decode.load(std::memory_order_acquire);
+        if (nonPcm && decode == nullptr)
+            return noErr; // a bitstream without its decoder yet, don't pass it on as PCM
+#endif // end ENABLE_FFMPEG_DECODE
 
-        for (UInt32 i = 0; i < ca->buf_list->mBuffers[0].mDataByteSize / sizeof(SInt32); i++) {
-            ca->buffer4Ffmpeg[i * 2] = left[i] >> 16;
-            ca->buffer4Ffmpeg[i * 2 + 1] = right[i] >> 16;
-        }
-        if (ca->log_file != nullptr) {
-            obs_log(LOG_INFO, "fwrite %lu", ca->buf_list->mBuffers[0].mDataByteSize / sizeof(int16_t));
-            fwrite(ca->buffer4Ffmpeg, sizeof(int16_t), ca->buf_list->mBuffers[0].mDataByteSize / sizeof(int16_t), ca->log_file);
+        // steady state from here on: nothing below may allocate, lock or log
+        AVerMedia::RealtimeScope rt;
+        UInt32 count = ca->buf_list->mBuffers[0].mDataByteSize / sizeof(SInt32);
+        const SInt32 *left = (const SInt32 *)ca->buf_list->mBuffers[ca->left_buffer].mData;
+        const SInt32 *right = (const SInt32 *)ca->buf_list->mBuffers[ca->right_buffer].mData;
+
+        AVerMedia::interleave_s32p_to_s16(left, right, ca->buffer4Ffmpeg, count);
+        if (ca->taps.raw.IsActive()) {
+            AVerMedia::AudioDebugTap::Format format;
+            format.sample_rate = ca->sample_rate;
+            format.channels = 2;
+            format.bits = 16;
+            ca->taps.raw.SetFormat(format);
+            ca->taps.raw.Write(ca->buffer4Ffmpeg, count * 2 * sizeof(int16_t));
         }
 
 #ifdef ENABLE_FFMPEG_DECODE
 //        obs_log(LOG_INFO, "AudioDShowInput::OnAudioData %d %d %d %d",
 //                audioInfo.dwSamplingRate, audioInfo.dwChannels, audioInfo.dwBitsPerSample, lLength);
-        if (ca->deviceOpener.IsAudioFormatNonPcm()) {
-            if (ca->decode == nullptr) { /* having packets, create decoder now */
-                obs_log(LOG_INFO, "ca->obsSource %p", ca->obsSource);
-                ca->decode = new AVerMedia::FfmpegAudioDecode(ca->obsSource);
-            }
-
-            ca->decode->OnEncodedAudioData((unsigned char*)ca->buffer4Ffmpeg, ca->buffer4FfmpegSize, 0);
+        if (nonPcm) {
+            decode->SetInputRate(ca->sample_rate);
+            decode->OnEncodedAudioData((unsigned char*)ca->buffer4Ffmpeg, count * 2 * sizeof(int16_t), 0);
             return noErr;
         }
 #endif // end ENABLE_FFMPEG_DECODE
@@ -349,12 +362,8 @@ static OSStatus input_callback(void *data,
         else
             audio.timestamp = ts_data->mHostTime;
 
-        if (ca->obsSource != nullptr) {
-            obs_source_output_audio(ca->obsSource, &audio);
-        }
-        else {
-            obs_log(LOG_INFO, "ca->source is nullptr");
-        }
+        if (ca->session)
+            ca->session->Output(ca->session_generation, &audio);
     }
 
     UNUSED_PARAMETER(ignored_buffers);
@@ -363,8 +372,14 @@ static OSStatus input_callback(void *data,
 
 namespace AVerMedia {
 
+static void get_decoder_stats_proc(void *data, calldata_t *cd)
+{
+    auto source = reinterpret_cast<CoreAudioSource *>(data);
+    calldata_set_string(cd, "json", source->DecoderStatsJson().c_str());
+}
+
 CoreAudioSource::CoreAudioSource(VendorSdk* sdk, obs_data_t *settings, obs_source_t *source)
-    : obsSource(source)
+    : obsSource(source), sourceGate(source)
 {
     obs_log(LOG_INFO, "CoreAudioSource obsSource %p", obsSource);
     if (os_event_init(&exit_event, OS_EVENT_TYPE_MANUAL) != 0) {
@@ -373,7 +388,15 @@ CoreAudioSource::CoreAudioSource(VendorSdk* sdk, obs_data_t *settings, obs_sourc
              "semephore: %d",
              errno);
     }
-    deviceOpener.SetVendorSdk(sdk);
+    if (os_event_init(&wake_event, OS_EVENT_TYPE_AUTO) != 0) {
+        obs_log(LOG_ERROR,
+             "[coreaudio_create] failed to create "
+             "wake event: %d",
+             errno);
+    }
+    AudioObjectAddPropertyListener(kAudioObjectSystemObject, &devices_address,
+                                   devices_changed_callback, this);
+    vendorSdk = sdk;
 
 #if defined(TEST_PROJECT)
     // device_uid = bstrdup("AppleUSBAudioEngine:AVerMedia:Live Gamer EXTREME 3:5312657500803:3");
@@ -388,28 +411,25 @@ CoreAudioSource::CoreAudioSource(VendorSdk* sdk, obs_data_t *settings, obs_sourc
 #endif // end TEST_PROJECT
 
 
-    deviceOpener.SetLogHandler([=](int log_level, const char* message){
-        if (log_level == DeviceOpener::LEVEL_ERROR) {
-            obs_log(LOG_ERROR, message);
-        }
-        else {
-            obs_log(LOG_INFO, message);
-        }
-    });
-
-    coreaudio_try_init();
+    taps.Update(settings);
+    decodeOptions = DecodeOptions::FromSettings(settings);
+    decodeOptions.device_key = device_uid;
 
-    // log_file = fopen("/Users/mattgu/Downloads/_______capture1.raw", "wb");
+    proc_handler_t *ph = obs_source_get_proc_handler(source);
+    proc_handler_add(ph, "void get_decoder_stats(out string json)", get_decoder_stats_proc, this);
 
-    // log_file2 = fopen("/Users/mattgu/Downloads/_______capture2.raw", "wb");
+    coreaudio_try_init();
 }
 
 CoreAudioSource::~CoreAudioSource()
 {
     obs_log(LOG_INFO, "CoreAudioSource::~CoreAudioSource 1");
+    AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &devices_address,
+                                      devices_changed_callback, this);
     coreaudio_shutdown();
 
     os_event_destroy(exit_event);
+    os_event_destroy(wake_event);
 
     bfree(device_name);
     bfree(device_uid);
@@ -441,33 +461,110 @@ std::unordered_map<std::string, std::string> CoreAudioSource::getDevices()
 
 void CoreAudioSource::Update(obs_data_t *settings)
 {
+    const char *uid = obs_data_get_string(settings, "device_id");
+
+    // debug taps and decoder options apply in place, only a different
+    // device needs the audio unit rebuilt
+    taps.Update(settings);
+    {
+        DecodeOptions options = DecodeOptions::FromSettings(settings);
+        options.device_key = uid;
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        decodeOptions = options;
+#ifdef ENABLE_FFMPEG_DECODE
+        if (FfmpegAudioDecode *current = decode.load())
+            current->SetOptions(options);
+#endif // ENABLE_FFMPEG_DECODE
+    }
+
+    bool sameDevice = device_uid && strcmp(device_uid, uid) == 0;
+    if (sameDevice && (au_initialized || reconnecting || follower)) {
+        obs_log(LOG_INFO, "CoreAudioSource::Update, device unchanged, no restart");
+        return;
+    }
+
     coreaudio_shutdown();
 
     bfree(device_uid);
-    device_uid = bstrdup(obs_data_get_string(settings, "device_id"));
+    device_uid = bstrdup(uid);
 
     coreaudio_try_init();
 }
 
-void CoreAudioSource::coreaudio_shutdown()
+void CoreAudioSource::Detach()
 {
-    deviceOpener.StopChecking();
+    sourceGate.Detach();
+    GetCaptureSessionRegistry().Leave(this);
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (FfmpegAudioDecode *current = decode.load())
+        current->Detach();
+#endif // ENABLE_FFMPEG_DECODE
+}
 
+std::string CoreAudioSource::DecoderStatsJson()
+{
 #ifdef ENABLE_FFMPEG_DECODE
-    if (decode) {
-        obs_log(LOG_INFO, "CoreAudioSource::coreaudio_shutdown, delete decoder");
-        delete decode;
-        decode = nullptr;
-    }
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (FfmpegAudioDecode *current = decode.load())
+        return current->Stats().ToJson();
 #endif // ENABLE_FFMPEG_DECODE
+    return "{}";
+}
+
+// sink of this source in its capture session, on the leader's audio or
+// decode thread
+void CoreAudioSource::OutputAudio(const struct obs_source_audio *audio)
+{
+    OutputGate::Use source(sourceGate);
+    if (source) {
+        AVT_TRACE_SPAN("obs_source_output_audio");
+        RealtimeExempt exempt; // libobs locks, out of our hands
+        obs_source_output_audio(source.get(), audio);
+    }
+}
+
+void CoreAudioSource::coreaudio_shutdown()
+{
+    // no promotion may start a reconnect thread once the join below is done
+    GetCaptureSessionRegistry().Leave(this);
 
     if (reconnecting) {
         os_event_signal(exit_event);
+        os_event_signal(wake_event);
         pthread_join(this->reconnect_thread, NULL);
         os_event_reset(exit_event);
     }
+    GetCaptureSessionRegistry().Leave(this); // the reconnect thread may have joined
+    follower = false;
+
+    // after the join: a reconnect registers the probe again, and the probe
+    // creates decoders for this source
+    GetVendorSdkScheduler().UnregisterProbe(this);
+    formatState = nullptr;
+    deviceOpener = nullptr;
+
+    // input_callback uses the decoder without the lock and the probe that
+    // creates one is gone; neither may happen past this point
+    coreaudio_stop();
+
+#ifdef ENABLE_FFMPEG_DECODE
+    FfmpegAudioDecode *oldDecode;
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        oldDecode = decode.exchange(nullptr);
+    }
+    if (oldDecode) {
+        obs_log(LOG_INFO, "CoreAudioSource::coreaudio_shutdown, delete decoder");
+        delete oldDecode;
+    }
+#endif // ENABLE_FFMPEG_DECODE
 
     coreaudio_uninit();
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        session.reset();
+    }
 
     if (unit)
         AudioComponentInstanceDispose(unit);
@@ -493,6 +590,7 @@ void CoreAudioSource::coreaudio_uninit()
     }
 
     au_initialized = false;
+    interleave_stereo = false;
 
     buf_list_free(buf_list);
     buf_list = NULL;
@@ -511,12 +609,11 @@ void CoreAudioSource::coreaudio_try_init()
              "uid: %s, waiting for connection",
              device_uid);
 
-        retry_time = 2000;
-
         if (no_devices)
-            obs_log(LOG_INFO, "coreaudio: no device found");
-        else
-            coreaudio_begin_reconnect();
+            obs_log(LOG_INFO, "coreaudio: no device found, waiting for it to appear");
+
+        backoff_reset = true;
+        coreaudio_begin_reconnect();
     }
 }
 
@@ -532,6 +629,8 @@ bool CoreAudioSource::coreaudio_init()
         return false;
     if (!coreaudio_get_device_name(this))
         return false;
+    if (!coreaudio_join_session())
+        return true; // another source captures the device and shares its audio
     if (!coreaudio_init_unit())
         return false;
 
@@ -569,9 +668,7 @@ bool CoreAudioSource::coreaudio_init()
     param.name = convertCharToWString(device_name);
     param.path = convertCharToWString(device_uid);
 
-    deviceOpener.StopChecking();
-    deviceOpener.SwitchDeviceThenDetectAudioFormat(param);
-    deviceOpener.StartChecking();
+    coreaudio_switch_sdk(param);
 
     return au_initialized;
 
@@ -580,6 +677,97 @@ fail:
     return false;
 }
 
+bool CoreAudioSource::coreaudio_join_session()
+{
+    auto membership = GetCaptureSessionRegistry().Join(
+        device_uid, this, [this](const struct obs_source_audio *audio) { OutputAudio(audio); },
+        [this]() {
+            // the capturing source went away, take over without a backoff delay
+            backoff_reset = true;
+            coreaudio_begin_reconnect();
+            os_event_signal(wake_event);
+        });
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        session = membership.session;
+        session_generation = membership.generation;
+    }
+
+    // Detach() may have run while joining
+    if (!sourceGate.Attached()) {
+        GetCaptureSessionRegistry().Leave(this);
+        follower = false;
+        return false;
+    }
+
+    follower = !membership.leader;
+    if (follower)
+        obs_log(LOG_INFO, "coreaudio: sharing the capture of '%s'", device_uid);
+    return membership.leader;
+}
+
+void CoreAudioSource::coreaudio_switch_sdk(const DeviceOpenerParam &param)
+{
+    VendorSdkScheduler &scheduler = GetVendorSdkScheduler();
+    scheduler.UnregisterProbe(this);
+    formatState = nullptr;
+    deviceOpener = nullptr;
+
+    std::string deviceKey = device_uid;
+    std::shared_ptr<SharedDeviceOpener> opener = SharedDeviceOpener::Acquire(vendorSdk, deviceKey, param);
+    VendorSdkScheduler::FormatState *state = scheduler.GetFormatState(deviceKey);
+    auto switchDevice = [opener, state]() {
+        state->Publish(opener->SwitchThenDetect(), os_gettime_ns());
+    };
+    if (WaitVendorSdkReady(VENDOR_SDK_READY_TIMEOUT_MS)) {
+        // queued behind the SDK work of every other source; waited for, so
+        // it may create the decoder before input_callback sees the format
+        scheduler.Submit("switch:" + deviceKey, [this, opener, state]() {
+            bool nonPcm = opener->SwitchThenDetect();
+            if (nonPcm)
+                coreaudio_create_decoder();
+            state->Publish(nonPcm, os_gettime_ns());
+        }).wait();
+    } else {
+        // keep capturing, switch as soon as the SDK is up
+        SubmitWhenVendorSdkReady("switch:" + deviceKey, switchDevice);
+    }
+
+    // polled on the scheduler thread, once per device and TTL; after a late
+    // SDK start the probe picks the format up once it is switched
+    deviceOpener = opener;
+    formatState = state;
+    scheduler.RegisterProbe(deviceKey, this, [this, opener]() {
+        // coreaudio_shutdown() unregisters, which waits for a running probe
+        bool nonPcm = opener->Detect();
+        if (nonPcm)
+            coreaudio_create_decoder();
+        return nonPcm;
+    });
+}
+
+// Off the audio thread, before the format snapshot reports the bitstream:
+// input_callback only picks the decoder up and never waits for decode_mutex.
+void CoreAudioSource::coreaudio_create_decoder()
+{
+#ifdef ENABLE_FFMPEG_DECODE
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (decode.load() || !sourceGate.Attached())
+        return; // already there or being destroyed
+
+    std::shared_ptr<CaptureSession> shared = session;
+    uint64_t generation = session_generation;
+    decode.store(new FfmpegAudioDecode(
+                     [shared, generation](const struct obs_source_audio *audio) {
+                         if (shared)
+                             shared->Output(generation, audio);
+                     },
+                     &taps, decodeOptions),
+                 std::memory_order_release);
+    obs_log(LOG_INFO, "coreaudio: bitstream on '%s', decoder created", device_uid);
+#endif // ENABLE_FFMPEG_DECODE
+}
+
 bool CoreAudioSource::coreaudio_init_unit()
 {
     AudioComponentDescription desc = {
@@ -605,12 +793,16 @@ void CoreAudioSource::coreaudio_begin_reconnect()
     if (reconnecting)
         return;
 
+    // set before the thread runs so a second notification cannot start another
+    reconnecting = true;
     int ret = pthread_create(&this->reconnect_thread, NULL, ::reconnect_thread, this);
-    if (ret != 0)
+    if (ret != 0) {
+        reconnecting = false;
         obs_log(LOG_WARNING,
              "[coreaudio_begin_reconnect] failed to "
              "create thread, error code: %d",
              ret);
+    }
 }
 
 bool CoreAudioSource::coreaudio_start()
@@ -786,6 +978,14 @@ bool CoreAudioSource::coreaudio_init_buffer()
     buffer4Ffmpeg = (int16_t *)malloc(bufferSizeBytes);
     memset(buffer4Ffmpeg, 0, bufferSizeBytes);
 
+    // pick the planes to interleave once, instead of on every callback.
+    // 4-channel devices carry the bitstream on the second stereo pair.
+    interleave_stereo = format == AUDIO_FORMAT_32BIT_PLANAR && inputBuffer->mNumberBuffers >= 2;
+    left_buffer = inputBuffer->mNumberBuffers == 4 ? 2 : 0;
+    right_buffer = left_buffer + 1;
+    obs_log(LOG_INFO, "interleave kernel %s, buffers %u/%u", interleave_kernel_name(),
+            (unsigned int)left_buffer, (unsigned int)right_buffer);
+
     buf_list = inputBuffer;
     return true;
 
@@ -7,8 +7,17 @@
 #include <CoreAudio/CoreAudio.h>
 #include <unordered_map>
 #include <string>
+#include <mutex>
+#include <atomic>
 
 #include "AVerMediaDeviceOpener.h"
+#include "AudioDebugTap.hpp"
+#include "DecodeOptions.hpp"
+#include "BackoffPolicy.hpp"
+#include "VendorSdkScheduler.hpp"
+#include "SharedDeviceOpener.hpp"
+#include "OutputGate.hpp"
+#include "CaptureSession.hpp"
 
 namespace AVerMedia {
 
@@ -36,18 +45,32 @@ struct CoreAudioSource
 
     pthread_t reconnect_thread = nullptr;
     os_event_t *exit_event = nullptr;
+    os_event_t *wake_event = nullptr; // device list changed, retry now
     volatile bool reconnecting;
-    unsigned long retry_time;
+    BackoffPolicy backoff; // reconnect thread only
+    std::atomic<bool> backoff_reset{false}; // consumed by the reconnect thread
 
     obs_source_t *obsSource = nullptr;
-    FILE *log_file = nullptr;
-    FILE *log_file2 = nullptr;
+    OutputGate sourceGate; // obsSource for the audio and decode threads
+    AudioDebugTaps taps;
+    DecodeOptions decodeOptions;
 
     int16_t *buffer4Ffmpeg = nullptr;
     int buffer4FfmpegSize = 0;
-    FfmpegAudioDecode* decode = nullptr;
+    bool interleave_stereo = false;
+    UInt32 left_buffer = 0;
+    UInt32 right_buffer = 1;
+    std::atomic<FfmpegAudioDecode*> decode{nullptr}; // created under decode_mutex, off the audio thread
+    std::mutex decode_mutex; // decoder creation/removal and decodeOptions
+    // set before the unit starts, cleared after it stopped
+    std::shared_ptr<CaptureSession> session;
+    uint64_t session_generation = 0;
+    bool follower = false; // another source captures this device for us
     std::string sdkLibPath;
-    DeviceOpener deviceOpener;
+    VendorSdk *vendorSdk = nullptr;
+    std::shared_ptr<SharedDeviceOpener> deviceOpener;
+    // format snapshot of the switched device, read instead of the SDK
+    std::atomic<VendorSdkScheduler::FormatState*> formatState{nullptr};
     
     CoreAudioSource(VendorSdk* sdk, obs_data_t *settings, obs_source_t *source);
     ~CoreAudioSource();
@@ -55,12 +78,21 @@ struct CoreAudioSource
     static std::unordered_map<std::string, std::string> getDevices();
 
     void Update(obs_data_t *settings);
+    // Cuts every path to obsSource; called by the destroy callback before the
+    // rest of the teardown is deferred.
+    void Detach();
+    // DecoderStats of the running decoder, "{}" without one
+    std::string DecoderStatsJson();
+    void OutputAudio(const struct obs_source_audio *audio);
 
     void coreaudio_shutdown();
     void coreaudio_uninit();
     void coreaudio_try_init();
     bool coreaudio_init();
     bool coreaudio_init_unit();
+    void coreaudio_switch_sdk(const DeviceOpenerParam &param);
+    void coreaudio_create_decoder();
+    bool coreaudio_join_session();
     void coreaudio_begin_reconnect();
 
     bool coreaudio_start();
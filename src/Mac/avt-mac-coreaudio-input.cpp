@@ -2,13 +2,34 @@
 #include <plugin-support.h>
 
 #include "AVerMediaCoreAudioSource.h"
-#include "AVerMediaVendorSdkLoader.h"
-#include <thread>
-#include <chrono>
+#include "VendorSdkLoader.hpp"
+#include "SourceReaper.hpp"
+#include "DeviceRegistry.hpp"
 
 #define TEXT_DEVICE        obs_module_text("Device")
 
-static AVerMedia::VendorSdk* g_vendorSdk = nullptr;
+static AVerMedia::DeviceList enumerate_devices()
+{
+    AVerMedia::DeviceList result;
+    for (const auto& [deviceId, deviceName] : AVerMedia::CoreAudioSource::getDevices()) {
+        result.push_back({deviceId, deviceName});
+    }
+    return result;
+}
+
+static AVerMedia::DeviceRegistry g_deviceRegistry(enumerate_devices);
+
+static const AudioObjectPropertyAddress devices_address = {
+    kAudioHardwarePropertyDevices,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMain};
+
+static OSStatus devices_changed(AudioObjectID, UInt32, const AudioObjectPropertyAddress *,
+                                void *data)
+{
+    reinterpret_cast<AVerMedia::DeviceRegistry*>(data)->Invalidate();
+    return noErr;
+}
 
 static const char *avt_coreaudio_getname(void *unused)
 {
@@ -19,13 +40,18 @@ static const char *avt_coreaudio_getname(void *unused)
 static void avt_coreaudio_destroy(void *data)
 {
     obs_log(LOG_INFO, "avt_coreaudio_destroy");
-    delete reinterpret_cast<AVerMedia::CoreAudioSource*>(data);
+    auto ca = reinterpret_cast<AVerMedia::CoreAudioSource*>(data);
+
+    // the source is gone once this returns, the audio unit, reconnect and
+    // decode threads are stopped in the background
+    ca->Detach();
+    AVerMedia::GetSourceReaper().Defer("avt_coreaudio_source", [ca]() { delete ca; });
 }
 
 static void *avt_coreaudio_create(obs_data_t *settings, obs_source_t *source)
 {
     obs_log(LOG_INFO, "avt_coreaudio_create");
-    return new AVerMedia::CoreAudioSource(g_vendorSdk, settings, source);;
+    return new AVerMedia::CoreAudioSource(AVerMedia::GetVendorSdk(), settings, source);;
 }
 
 static void avt_coreaudio_update(void *data, obs_data_t *settings)
@@ -37,7 +63,8 @@ static void avt_coreaudio_update(void *data, obs_data_t *settings)
 static void avt_coreaudio_get_default(obs_data_t *settings)
 {
     obs_log(LOG_INFO, "avt_coreaudio_get_default");
-    UNUSED_PARAMETER(settings);
+    AVerMedia::DecodeOptions::GetDefaults(settings);
+    AVerMedia::AudioDebugTaps::GetDefaults(settings);
 }
 
 static obs_properties_t *avt_coreaudio_get_properties(void *unused)
@@ -51,13 +78,16 @@ static obs_properties_t *avt_coreaudio_get_properties(void *unused)
             obs_properties_add_list(props, "device_id", TEXT_DEVICE,
                                     OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 
-	auto devices = AVerMedia::CoreAudioSource::getDevices();
-    for (const auto& [deviceId, deviceName] : devices) {
-        obs_log(LOG_INFO, "device_id: %s", deviceId.c_str());
-        obs_log(LOG_INFO, "device_name: %s", deviceName.c_str());
+	auto devices = g_deviceRegistry.Snapshot();
+    for (const auto& entry : *devices) {
+        obs_log(LOG_INFO, "device_id: %s", entry.id.c_str());
+        obs_log(LOG_INFO, "device_name: %s", entry.name.c_str());
 
-        obs_property_list_add_string(property, deviceName.c_str(), deviceId.c_str());
+        obs_property_list_add_string(property, entry.name.c_str(), entry.id.c_str());
     }
+
+    AVerMedia::DecodeOptions::AddProperties(props);
+    AVerMedia::AudioDebugTaps::AddProperties(props);
 	return props;
 }
 
@@ -76,30 +106,20 @@ void RegisterAVerMediaCoreAudioInput()
     avt_coreaudio_input.get_properties = avt_coreaudio_get_properties;
     avt_coreaudio_input.icon_type = OBS_ICON_TYPE_AUDIO_INPUT;
     obs_register_source(&avt_coreaudio_input);
+
+    g_deviceRegistry.Start();
+
+    OSStatus stat = AudioObjectAddPropertyListener(kAudioObjectSystemObject, &devices_address,
+                                                   devices_changed, &g_deviceRegistry);
+    if (stat != noErr)
+        obs_log(LOG_WARNING, "coreaudio: failed to watch device changes: %d", (int)stat);
 }
-void LoadVendorSdk()
-{
-    obs_log(LOG_INFO, "LoadVendorSdk");
-    if (g_vendorSdk == nullptr) {
-        obs_log(LOG_INFO, "LoadVendorSdk g_vendorSdk == nullptr");
-		auto mod = obs_current_module();
-		auto path = obs_get_module_data_path(mod);
-        obs_log(LOG_INFO, "LoadVendorSdk path: %s", path);
-		g_vendorSdk = new AVerMedia::VendorSdk(path);
-		g_vendorSdk->initialize();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-	}
-}
-void UnloadVendorSdk()
+
+void UnregisterAVerMediaCoreAudioInput()
 {
-    obs_log(LOG_INFO, "UnloadVendorSdk");
-	if (g_vendorSdk != nullptr) {
-		g_vendorSdk->closePort();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-		g_vendorSdk->uninitialize();
-		delete g_vendorSdk;
-		g_vendorSdk = nullptr;
-	}
+    AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &devices_address,
+                                      devices_changed, &g_deviceRegistry);
+    g_deviceRegistry.Stop();
 }
 } // extern "C"
 
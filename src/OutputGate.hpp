@@ -0,0 +1,59 @@
+#pragma once
+
+#include <obs.h>
+
+#include <atomic>
+#include <thread>
+
+namespace AVerMedia {
+
+// Guards an obs_source_t that is used from capture and decode threads while
+// OBS may destroy it at any time. Callers hold a Use for the duration of one
+// call into libobs. Detach() clears the source and returns once no Use is
+// left, so nothing touches the source afterwards. Taking a Use never locks.
+class OutputGate
+{
+public:
+    explicit OutputGate(obs_source_t *source = nullptr) : source(source) {}
+
+    OutputGate(const OutputGate &) = delete;
+    OutputGate &operator=(const OutputGate &) = delete;
+
+    class Use
+    {
+    public:
+        explicit Use(OutputGate &gate) : gate(gate)
+        {
+            gate.users.fetch_add(1);
+            source = gate.source.load();
+        }
+        ~Use() { gate.users.fetch_sub(1); }
+
+        Use(const Use &) = delete;
+        Use &operator=(const Use &) = delete;
+
+        obs_source_t *get() const { return source; }
+        explicit operator bool() const { return source != nullptr; }
+
+    private:
+        OutputGate &gate;
+        obs_source_t *source;
+    };
+
+    void Attach(obs_source_t *new_source) { source.store(new_source); }
+    bool Attached() const { return source.load() != nullptr; }
+
+    // Users only ever hold the gate for one libobs call, so this spins briefly.
+    void Detach()
+    {
+        source.store(nullptr);
+        while (users.load() != 0)
+            std::this_thread::yield();
+    }
+
+private:
+    std::atomic<obs_source_t *> source;
+    std::atomic<int> users{0};
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,310 @@
+#include "PipelineTrace.hpp"
+#include "RealtimeCheck.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <callback/proc.h>
+#include <util/dstr.hpp>
+#include <util/util.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace AVerMedia {
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    uint64_t ts_ns;
+    int64_t value; // duration in ns for spans
+    char phase;    // 'X' span, 'i' instant, 'C' counter
+};
+
+// Written by its thread only; read by the exporter without stopping it.
+struct TraceBuffer {
+    uint32_t tid = 0;
+    std::string thread_name;
+    std::unique_ptr<TraceEvent[]> events;
+    size_t capacity = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> cleared{0}; // events before this belong to an older recording
+    std::atomic<bool> retired{false}; // thread exited
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    size_t events_per_thread = PipelineTrace::DEFAULT_EVENTS_PER_THREAD;
+    uint32_t next_tid = 1;
+};
+
+TraceRegistry &registry()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+// marks the buffer retired when its thread exits
+struct ThreadSlot {
+    TraceBuffer *buffer = nullptr;
+    ~ThreadSlot()
+    {
+        if (buffer)
+            buffer->retired.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadSlot slot;
+
+std::string current_thread_name(uint32_t tid)
+{
+#ifndef _WIN32
+    char name[64] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && name[0])
+        return name;
+#endif
+    return "thread " + std::to_string(tid);
+}
+
+TraceBuffer *thread_buffer()
+{
+    if (slot.buffer)
+        return slot.buffer;
+
+    // once per thread and only while tracing
+    RealtimeExempt exempt;
+    auto buffer = std::make_unique<TraceBuffer>();
+    TraceRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    buffer->tid = reg.next_tid++;
+    buffer->thread_name = current_thread_name(buffer->tid);
+    buffer->capacity = reg.events_per_thread;
+    buffer->events.reset(new TraceEvent[buffer->capacity]);
+    slot.buffer = buffer.get();
+    reg.buffers.push_back(std::move(buffer));
+    return slot.buffer;
+}
+
+void record(const char *name, uint64_t ts_ns, int64_t value, char phase)
+{
+    TraceBuffer *buffer = thread_buffer();
+    uint64_t n = buffer->written.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[n % buffer->capacity];
+    event.name = name;
+    event.ts_ns = ts_ns;
+    event.value = value;
+    event.phase = phase;
+    buffer->written.store(n + 1, std::memory_order_release);
+}
+
+void append_json_string(std::string &out, const char *str)
+{
+    out += '"';
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            out += '\\';
+            out += *str;
+        } else if ((unsigned char)*str >= 0x20) {
+            out += *str;
+        }
+    }
+    out += '"';
+}
+
+void append_event(std::string &out, uint32_t tid, const TraceEvent &event)
+{
+    char buf[160];
+    out += out.back() == '[' ? "\n{\"name\":" : ",\n{\"name\":";
+    append_json_string(out, event.name);
+
+    // microseconds with nanosecond precision
+    double ts = (double)event.ts_ns / 1000.0;
+    switch (event.phase) {
+    case 'X':
+        snprintf(buf, sizeof(buf),
+                 ",\"cat\":\"avt\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", tid,
+                 ts, (double)event.value / 1000.0);
+        break;
+    case 'C':
+        snprintf(buf, sizeof(buf),
+                 ",\"cat\":\"avt\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                 "\"args\":{\"value\":%" PRId64 "}}",
+                 tid, ts, event.value);
+        break;
+    default:
+        snprintf(buf, sizeof(buf),
+                 ",\"cat\":\"avt\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", tid,
+                 ts);
+        break;
+    }
+    out += buf;
+}
+
+std::string default_trace_path()
+{
+    BPtr<char> dir = obs_module_config_path("traces");
+    os_mkdirs(dir);
+    BPtr<char> stamp = os_generate_formatted_filename("json", false, "trace-%CCYY-%MM-%DD_%hh-%mm-%ss");
+
+    DStr path;
+    dstr_printf(path, "%s/%s", dir.Get(), stamp.Get());
+    return std::string(path->array);
+}
+
+} // namespace
+
+std::atomic<bool> PipelineTrace::enabled{false};
+
+void PipelineTrace::Start(size_t events_per_thread)
+{
+    TraceRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    reg.events_per_thread = std::max<size_t>(events_per_thread, 1024);
+    // nobody writes into the buffers of exited threads any more
+    reg.buffers.erase(std::remove_if(reg.buffers.begin(), reg.buffers.end(),
+                                     [](const std::unique_ptr<TraceBuffer> &buffer) {
+                                         return buffer->retired.load(std::memory_order_acquire);
+                                     }),
+                      reg.buffers.end());
+    for (auto &buffer : reg.buffers)
+        buffer->cleared.store(buffer->written.load(std::memory_order_acquire));
+
+    enabled.store(true, std::memory_order_relaxed);
+    obs_log(LOG_INFO, "PipelineTrace: recording, %zu events per thread", reg.events_per_thread);
+}
+
+void PipelineTrace::Stop()
+{
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+void PipelineTrace::Complete(const char *name, uint64_t begin_ns, uint64_t end_ns)
+{
+    record(name, begin_ns, (int64_t)(end_ns - begin_ns), 'X');
+}
+
+void PipelineTrace::Instant(const char *name)
+{
+    record(name, os_gettime_ns(), 0, 'i');
+}
+
+void PipelineTrace::Counter(const char *name, int64_t value)
+{
+    record(name, os_gettime_ns(), value, 'C');
+}
+
+std::string PipelineTrace::ExportJson()
+{
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::vector<TraceEvent> events;
+
+    TraceRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto &buffer : reg.buffers) {
+        uint64_t end = buffer->written.load(std::memory_order_acquire);
+        uint64_t begin = buffer->cleared.load(std::memory_order_relaxed);
+        if (end > buffer->capacity)
+            begin = std::max(begin, end - buffer->capacity);
+
+        events.clear();
+        for (uint64_t n = begin; n < end; n++)
+            events.push_back(buffer->events[n % buffer->capacity]);
+
+        // the thread kept recording while we copied; drop what it overwrote,
+        // including the slot of the event it may be writing right now
+        uint64_t now = buffer->written.load(std::memory_order_acquire);
+        size_t skip = 0;
+        if (now >= buffer->capacity && now - buffer->capacity + 1 > begin)
+            skip = (size_t)std::min<uint64_t>(now - buffer->capacity + 1 - begin, events.size());
+
+        if (skip == events.size())
+            continue;
+
+        char meta[64];
+        snprintf(meta, sizeof(meta), "\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                 buffer->tid);
+        out += out.back() == '[' ? "\n{\"name\":\"thread_name\"," : ",\n{\"name\":\"thread_name\",";
+        out += meta;
+        append_json_string(out, buffer->thread_name.c_str());
+        out += "}}";
+
+        for (size_t i = skip; i < events.size(); i++)
+            append_event(out, buffer->tid, events[i]);
+    }
+
+    out += "\n]}\n";
+    return out;
+}
+
+bool PipelineTrace::WriteJson(const char *path)
+{
+    std::string json = ExportJson();
+    if (!os_quick_write_utf8_file(path, json.c_str(), json.size(), false)) {
+        obs_log(LOG_WARNING, "PipelineTrace: failed to write %s", path);
+        return false;
+    }
+    obs_log(LOG_INFO, "PipelineTrace: wrote %s", path);
+    return true;
+}
+
+} // namespace AVerMedia
+
+using namespace AVerMedia;
+
+static void trace_start_proc(void *, calldata_t *cd)
+{
+    long long events = calldata_int(cd, "events_per_thread");
+    PipelineTrace::Start(events > 0 ? (size_t)events : PipelineTrace::DEFAULT_EVENTS_PER_THREAD);
+}
+
+static void trace_stop_proc(void *, calldata_t *)
+{
+    PipelineTrace::Stop();
+}
+
+static void trace_dump_proc(void *, calldata_t *cd)
+{
+    const char *path = calldata_string(cd, "path");
+    std::string target = path && *path ? path : default_trace_path();
+    calldata_set_string(cd, "written", PipelineTrace::WriteJson(target.c_str()) ? target.c_str() : "");
+}
+
+extern "C" {
+
+void StartPipelineTrace()
+{
+    // global procs, e.g. for scripts:
+    //   avt_trace_start(events_per_thread = 0) / avt_trace_stop()
+    //   avt_trace_dump(path = "") -> written, empty path for the config dir
+    proc_handler_t *ph = obs_get_proc_handler();
+    proc_handler_add(ph, "void avt_trace_start(in int events_per_thread)", trace_start_proc, nullptr);
+    proc_handler_add(ph, "void avt_trace_stop()", trace_stop_proc, nullptr);
+    proc_handler_add(ph, "void avt_trace_dump(in string path, out string written)",
+                     trace_dump_proc, nullptr);
+
+    // AVT_TRACE=1 records from the start and writes the trace on unload
+    const char *env = getenv("AVT_TRACE");
+    if (env && *env && strcmp(env, "0") != 0)
+        PipelineTrace::Start();
+}
+
+void StopPipelineTrace()
+{
+    if (!PipelineTrace::Enabled())
+        return;
+    PipelineTrace::Stop();
+    PipelineTrace::WriteJson(default_trace_path().c_str());
+}
+
+} // extern "C"
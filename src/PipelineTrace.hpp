@@ -0,0 +1,88 @@
+#pragma once
+
+#include <util/platform.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace AVerMedia {
+
+// Timeline of the audio pipeline for glitch hunting: capture callbacks, the
+// decoder's queue waits, av_read_frame, decoding and the hand-over to OBS.
+// Events go into a fixed-size ring per thread, so recording never locks or
+// allocates after a thread's first event, and are exported on demand in the
+// Chrome trace event format, which Perfetto and chrome://tracing both open.
+// While tracing is off every trace point is a single relaxed load.
+//
+// Event names must be string literals; only the pointer is recorded.
+class PipelineTrace
+{
+public:
+    static constexpr size_t DEFAULT_EVENTS_PER_THREAD = 32768;
+
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Starts a new recording; earlier events are discarded. The size only
+    // applies to threads that record their first event afterwards.
+    static void Start(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+    static void Stop();
+
+    // Everything recorded since Start(), also while still recording.
+    static std::string ExportJson();
+    static bool WriteJson(const char *path);
+
+    static void Complete(const char *name, uint64_t begin_ns, uint64_t end_ns);
+    static void Instant(const char *name);
+    static void Counter(const char *name, int64_t value);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+        : name(PipelineTrace::Enabled() ? name : nullptr), begin(this->name ? os_gettime_ns() : 0)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (name)
+            PipelineTrace::Complete(name, begin, os_gettime_ns());
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    uint64_t begin;
+};
+
+} // namespace AVerMedia
+
+#define AVT_TRACE_CONCAT_(a, b) a##b
+#define AVT_TRACE_CONCAT(a, b) AVT_TRACE_CONCAT_(a, b)
+
+// Records the enclosing scope as a span.
+#define AVT_TRACE_SPAN(name) AVerMedia::TraceSpan AVT_TRACE_CONCAT(avt_trace_span_, __LINE__)(name)
+
+#define AVT_TRACE_INSTANT(name)                          \
+    do {                                                 \
+        if (AVerMedia::PipelineTrace::Enabled())         \
+            AVerMedia::PipelineTrace::Instant(name);     \
+    } while (false)
+
+#define AVT_TRACE_COUNTER(name, value)                           \
+    do {                                                         \
+        if (AVerMedia::PipelineTrace::Enabled())                 \
+            AVerMedia::PipelineTrace::Counter(name, (int64_t)(value)); \
+    } while (false)
+
+extern "C" {
+void StartPipelineTrace();
+void StopPipelineTrace();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Marks code that runs on a real-time capture thread in steady state.
+ *
+ * Normal builds compile this away. With ENABLE_RT_CHECK the scopes call into
+ * the rt-check shim (tools/rt-check), which is LD_PRELOADed into the test
+ * process and reports every allocation, blocking lock or log call made while
+ * a scope is open. The hooks are weak, so a checked build still runs without
+ * the shim.
+ */
+
+#if defined(ENABLE_RT_CHECK) && !defined(_WIN32)
+extern "C" {
+void avt_rt_check_enter(void) __attribute__((weak));
+void avt_rt_check_leave(void) __attribute__((weak));
+void avt_rt_check_exempt_begin(void) __attribute__((weak));
+void avt_rt_check_exempt_end(void) __attribute__((weak));
+}
+#define RT_CHECK_CALL(hook) \
+    do {                    \
+        if (hook)           \
+            hook();         \
+    } while (false)
+#else
+#define RT_CHECK_CALL(hook) \
+    do {                    \
+    } while (false)
+#endif
+
+namespace AVerMedia {
+
+class RealtimeScope
+{
+public:
+    RealtimeScope() { RT_CHECK_CALL(avt_rt_check_enter); }
+    ~RealtimeScope() { RT_CHECK_CALL(avt_rt_check_leave); }
+
+    RealtimeScope(const RealtimeScope &) = delete;
+    RealtimeScope &operator=(const RealtimeScope &) = delete;
+};
+
+// For calls we cannot make real-time safe ourselves, e.g. into libobs.
+class RealtimeExempt
+{
+public:
+    RealtimeExempt() { RT_CHECK_CALL(avt_rt_check_exempt_begin); }
+    ~RealtimeExempt() { RT_CHECK_CALL(avt_rt_check_exempt_end); }
+
+    RealtimeExempt(const RealtimeExempt &) = delete;
+    RealtimeExempt &operator=(const RealtimeExempt &) = delete;
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,96 @@
+#include "SharedDeviceOpener.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+
+#include "AVerMediaVendorSdkLoader.h"
+#include "VendorSdkLoader.hpp"
+#include "VendorSdkScheduler.hpp"
+
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <objbase.h>
+#endif
+
+#define AUDIO_FORMAT_PCM 0 // getAudioFormat() value of an LPCM input
+
+namespace AVerMedia {
+
+static std::mutex g_openersMutex;
+static std::unordered_map<std::string, std::weak_ptr<SharedDeviceOpener>> g_openers;
+
+std::shared_ptr<SharedDeviceOpener> SharedDeviceOpener::Acquire(VendorSdk *sdk, const std::string &device_key,
+                                                                const DeviceOpenerParam &param)
+{
+    std::lock_guard<std::mutex> lock(g_openersMutex);
+    std::shared_ptr<SharedDeviceOpener> opener = g_openers[device_key].lock();
+    if (!opener) {
+        opener.reset(new SharedDeviceOpener(sdk, device_key, param));
+        g_openers[device_key] = opener;
+    }
+
+    // drop the entries of devices nobody captures any more
+    for (auto it = g_openers.begin(); it != g_openers.end();)
+        it = it->second.expired() ? g_openers.erase(it) : std::next(it);
+    return opener;
+}
+
+SharedDeviceOpener::SharedDeviceOpener(VendorSdk *sdk_, const std::string &device_key_,
+                                       const DeviceOpenerParam &param_)
+    : sdk(sdk_), device_key(device_key_), param(param_)
+{
+    opener.SetVendorSdk(sdk);
+    opener.SetLogHandler([](int log_level, const char *message) {
+        obs_log(log_level == DeviceOpener::LEVEL_ERROR ? LOG_ERROR : LOG_DEBUG, "%s", message);
+    });
+}
+
+bool SharedDeviceOpener::SwitchThenDetect()
+{
+    // a probe registered before the SDK came up
+    if (!IsVendorSdkReady())
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+#ifdef _WIN32
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+    opener.SwitchDeviceThenDetectAudioFormat(param);
+    bool non_pcm = opener.IsAudioFormatNonPcm();
+#ifdef _WIN32
+    if (SUCCEEDED(hr))
+        CoUninitialize();
+#endif
+    GetVendorSdkScheduler().SetCurrentDevice(device_key);
+    return non_pcm;
+}
+
+bool SharedDeviceOpener::Detect()
+{
+    if (!IsVendorSdkReady())
+        return false;
+
+    if (GetVendorSdkScheduler().IsCurrentDevice(device_key)) {
+        bool non_pcm;
+        if (QueryFormat(non_pcm))
+            return non_pcm;
+        // e.g. the device was replugged, a full switch sorts it out
+    }
+    return SwitchThenDetect();
+}
+
+bool SharedDeviceOpener::QueryFormat(bool &non_pcm)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned int enabled = 0;
+    int format = AUDIO_FORMAT_PCM;
+    if (!sdk || sdk->getNonPcmOnOff(&enabled) != VendorSdk::ERROR_OK ||
+        sdk->getAudioFormat(&format) != VendorSdk::ERROR_OK)
+        return false;
+
+    non_pcm = enabled && format != AUDIO_FORMAT_PCM;
+    return true;
+}
+
+} // namespace AVerMedia
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "AVerMediaDeviceOpener.h"
+
+namespace AVerMedia {
+
+// One DeviceOpener per capture device, shared by every source on it. The
+// vendor SDK keeps a single "current device", so the opener is only used
+// from the VendorSdkScheduler thread: the initial switch is a command, the
+// format polling afterwards is the device's probe.
+class SharedDeviceOpener
+{
+public:
+    // Returns the opener of `device_key`, creating it on first use. It stays
+    // alive as long as a source or a queued probe holds it.
+    static std::shared_ptr<SharedDeviceOpener> Acquire(VendorSdk *sdk, const std::string &device_key,
+                                                       const DeviceOpenerParam &param);
+
+    // Makes the device current and queries its audio format over the SDK.
+    // Returns whether it delivers a bitstream, false while the SDK is not up.
+    bool SwitchThenDetect();
+
+    // For the probe: only queries the format while the device is still the
+    // SDK's current one, switches again if another device took over.
+    bool Detect();
+
+private:
+    SharedDeviceOpener(VendorSdk *sdk, const std::string &device_key, const DeviceOpenerParam &param);
+
+    bool QueryFormat(bool &non_pcm);
+
+    VendorSdk *sdk;
+    const std::string device_key;
+    DeviceOpener opener;
+    DeviceOpenerParam param;
+    std::mutex mutex; // the scheduler serializes calls, this only guards misuse
+};
+
+} // namespace AVerMedia
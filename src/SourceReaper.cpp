@@ -0,0 +1,120 @@
+#include "SourceReaper.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+namespace AVerMedia {
+
+SourceReaper::~SourceReaper()
+{
+    Stop();
+}
+
+void SourceReaper::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable())
+        return;
+    stopping = false;
+    worker = std::thread(&SourceReaper::Loop, this);
+}
+
+void SourceReaper::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable())
+            return;
+        stopping = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+void SourceReaper::Defer(const char *what, std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (worker.joinable() && !stopping) {
+            jobs.push_back({what, std::move(job)});
+            cond.notify_all();
+            return;
+        }
+    }
+
+    // not running (module unloading): tear down on the caller as before
+    job();
+}
+
+void SourceReaper::Drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (std::this_thread::get_id() == worker.get_id())
+        return;
+    idle.wait(lock, [this] { return jobs.empty() && !busy; });
+}
+
+size_t SourceReaper::Pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size() + (busy ? 1 : 0);
+}
+
+void SourceReaper::Loop()
+{
+    os_set_thread_name("AVerMedia source reaper");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            break; // stopping, and nothing left to tear down
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+
+        uint64_t start = os_gettime_ns();
+        job.run();
+        obs_log(LOG_INFO, "SourceReaper: %s torn down in %llu ms", job.what.c_str(),
+                (unsigned long long)(os_gettime_ns() - start) / 1000000);
+
+        lock.lock();
+        busy = false;
+        if (jobs.empty())
+            idle.notify_all();
+    }
+    idle.notify_all();
+}
+
+SourceReaper &GetSourceReaper()
+{
+    static SourceReaper reaper;
+    return reaper;
+}
+
+} // namespace AVerMedia
+
+using namespace AVerMedia;
+
+extern "C" {
+
+void StartSourceReaper()
+{
+    GetSourceReaper().Start();
+}
+
+void StopSourceReaper()
+{
+    // sources still being torn down use the vendor SDK and the device
+    // registries, so this has to finish before either goes away
+    size_t pending = GetSourceReaper().Pending();
+    if (pending)
+        obs_log(LOG_INFO, "SourceReaper: waiting for %zu source(s) to tear down", pending);
+    GetSourceReaper().Stop();
+}
+
+} // extern "C"
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace AVerMedia {
+
+// Runs source teardown on a background thread. OBS destroys sources on its
+// UI or graphics thread, and joining capture, decode and DirectShow threads
+// there stalls the whole UI. A destroy callback detaches the source from
+// OBS first (see OutputGate), then hands the rest to the reaper.
+class SourceReaper
+{
+public:
+    SourceReaper() = default;
+    ~SourceReaper();
+
+    void Start();
+    // Finishes every queued job, then joins. Jobs deferred afterwards run
+    // inline on the caller.
+    void Stop();
+
+    void Defer(const char *what, std::function<void()> job);
+    // Blocks until everything queued so far has run.
+    void Drain();
+
+    size_t Pending();
+
+private:
+    struct Job {
+        std::string what;
+        std::function<void()> run;
+    };
+
+    void Loop();
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable idle;
+    std::deque<Job> jobs;
+    bool busy = false;
+    bool stopping = false;
+    std::thread worker;
+};
+
+// Process-wide instance, running while the module is loaded.
+SourceReaper &GetSourceReaper();
+
+} // namespace AVerMedia
+
+extern "C" {
+void StartSourceReaper();
+void StopSourceReaper();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace AVerMedia {
+
+// Lock-free byte ring for exactly one producer thread and one consumer
+// thread. Neither side allocates, locks or blocks, so the producer side can
+// be called from a real-time audio callback.
+class SpscRing
+{
+public:
+    SpscRing() = default;
+    explicit SpscRing(size_t capacity) { Allocate(capacity); }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Not thread safe; call before either side starts using the ring.
+    void Allocate(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        buffer.reset(new uint8_t[size]);
+        mask = size - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    bool IsAllocated() const { return buffer != nullptr; }
+    size_t Capacity() const { return buffer ? mask + 1 : 0; }
+
+    size_t Available() const
+    {
+        return (size_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed));
+    }
+
+    size_t Free() const
+    {
+        return Capacity() - (size_t)(head.load(std::memory_order_relaxed) -
+                                     tail.load(std::memory_order_acquire));
+    }
+
+    // Bytes written and read since Allocate(), to refer to a position in the
+    // stream. Producer and consumer side respectively.
+    uint64_t WritePosition() const { return head.load(std::memory_order_relaxed); }
+    uint64_t ReadPosition() const { return tail.load(std::memory_order_relaxed); }
+
+    // Producer side. Writes all of `data` or nothing, so the consumer never
+    // sees half of a sample frame.
+    bool Write(const void *data, size_t size)
+    {
+        if (!buffer || size > Free())
+            return false;
+
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        CopyIn(pos, (const uint8_t *)data, size);
+        head.store(pos + size, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Reads up to `size` bytes and returns how many were read.
+    size_t Read(void *out, size_t size)
+    {
+        size_t avail = Available();
+        if (size > avail)
+            size = avail;
+        if (size == 0)
+            return 0;
+
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        CopyOut(pos, (uint8_t *)out, size);
+        tail.store(pos + size, std::memory_order_release);
+        return size;
+    }
+
+    // Consumer side. Copies up to `size` bytes without consuming them.
+    size_t Peek(void *out, size_t size) const
+    {
+        size_t avail = Available();
+        if (size > avail)
+            size = avail;
+        if (size)
+            CopyOut(tail.load(std::memory_order_relaxed), (uint8_t *)out, size);
+        return size;
+    }
+
+    // Consumer side. Drops up to `size` bytes.
+    size_t Skip(size_t size)
+    {
+        size_t avail = Available();
+        if (size > avail)
+            size = avail;
+        tail.store(tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        return size;
+    }
+
+private:
+    void CopyIn(uint64_t pos, const uint8_t *src, size_t size)
+    {
+        size_t offset = (size_t)(pos & mask);
+        size_t first = mask + 1 - offset;
+        if (first > size)
+            first = size;
+        memcpy(buffer.get() + offset, src, first);
+        memcpy(buffer.get(), src + first, size - first);
+    }
+
+    void CopyOut(uint64_t pos, uint8_t *dst, size_t size) const
+    {
+        size_t offset = (size_t)(pos & mask);
+        size_t first = mask + 1 - offset;
+        if (first > size)
+            first = size;
+        memcpy(dst, buffer.get() + offset, first);
+        memcpy(dst + first, buffer.get(), size - first);
+    }
+
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t mask = 0;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+} // namespace AVerMedia
@@ -0,0 +1,84 @@
+#include "StreamParamCache.hpp"
+
+#include <obs-module.h>
+#include <obs.hpp>
+#include <plugin-support.h>
+#include <util/platform.h>
+#include <util/util.hpp>
+
+#include <mutex>
+
+#define CACHE_FILE "stream-params.json"
+
+namespace AVerMedia {
+namespace StreamParamCache {
+
+static std::mutex cache_mutex;
+static OBSDataAutoRelease cache; // loaded on first use
+
+static obs_data_t *get_cache()
+{
+    if (!cache) {
+        BPtr<char> path = obs_module_config_path(CACHE_FILE);
+        obs_data_t *data = path ? obs_data_create_from_json_file_safe(path, "bak") : nullptr;
+        cache = data ? data : obs_data_create();
+    }
+    return cache;
+}
+
+static void save_cache()
+{
+    BPtr<char> dir = obs_module_config_path("");
+    BPtr<char> path = obs_module_config_path(CACHE_FILE);
+    if (!dir || !path)
+        return;
+
+    os_mkdirs(dir);
+    if (!obs_data_save_json_safe(cache, path, "tmp", "bak"))
+        obs_log(LOG_WARNING, "StreamParamCache: failed to save %s", (const char *)path);
+}
+
+bool Lookup(const std::string &device_key, StreamParams &params)
+{
+    if (device_key.empty())
+        return false;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    OBSDataAutoRelease entry = obs_data_get_obj(get_cache(), device_key.c_str());
+    if (!entry)
+        return false;
+
+    StreamParams found;
+    found.codec = obs_data_get_string(entry, "codec");
+    found.channels = (int)obs_data_get_int(entry, "channels");
+    found.sample_rate = (int)obs_data_get_int(entry, "sample_rate");
+    if (!found.IsValid())
+        return false;
+
+    params = found;
+    return true;
+}
+
+void Store(const std::string &device_key, const StreamParams &params)
+{
+    if (device_key.empty() || !params.IsValid())
+        return;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    OBSDataAutoRelease entry = obs_data_create();
+    obs_data_set_string(entry, "codec", params.codec.c_str());
+    obs_data_set_int(entry, "channels", params.channels);
+    obs_data_set_int(entry, "sample_rate", params.sample_rate);
+    obs_data_set_obj(get_cache(), device_key.c_str(), entry);
+    save_cache();
+}
+
+void Forget(const std::string &device_key)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    obs_data_erase(get_cache(), device_key.c_str());
+    save_cache();
+}
+
+} // namespace StreamParamCache
+} // namespace AVerMedia
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+namespace AVerMedia {
+
+// Last confirmed bitstream parameters of a device, so the next activation can
+// open the decoder without probing.
+struct StreamParams {
+    std::string codec; // FFmpeg decoder name, e.g. "ac3"
+    int channels = 0;
+    int sample_rate = 0;
+
+    bool IsValid() const { return !codec.empty() && channels > 0 && sample_rate > 0; }
+    bool operator==(const StreamParams &other) const
+    {
+        return codec == other.codec && channels == other.channels &&
+               sample_rate == other.sample_rate;
+    }
+    bool operator!=(const StreamParams &other) const { return !(*this == other); }
+};
+
+// Process-wide cache persisted as stream-params.json in the module config
+// directory, keyed by the encoded DirectShow device id or the CoreAudio UID.
+namespace StreamParamCache {
+
+bool Lookup(const std::string &device_key, StreamParams &params);
+void Store(const std::string &device_key, const StreamParams &params);
+void Forget(const std::string &device_key);
+
+} // namespace StreamParamCache
+
+} // namespace AVerMedia
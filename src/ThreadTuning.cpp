@@ -0,0 +1,204 @@
+#include "ThreadTuning.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include <cstdlib>
+
+namespace AVerMedia {
+
+const char *thread_priority_name(ThreadPriority priority)
+{
+    switch (priority) {
+    case ThreadPriority::Normal:
+        return "normal";
+    case ThreadPriority::High:
+        return "high";
+    case ThreadPriority::RealtimeRR:
+        return "realtime-rr";
+    case ThreadPriority::RealtimeFifo:
+        return "realtime-fifo";
+    }
+    return "unknown";
+}
+
+#if defined(_WIN32)
+
+static bool apply_priority(ThreadPriority priority)
+{
+    int value = THREAD_PRIORITY_NORMAL;
+    switch (priority) {
+    case ThreadPriority::Normal:
+        value = THREAD_PRIORITY_NORMAL;
+        break;
+    case ThreadPriority::High:
+        value = THREAD_PRIORITY_ABOVE_NORMAL;
+        break;
+    case ThreadPriority::RealtimeRR:
+        value = THREAD_PRIORITY_HIGHEST;
+        break;
+    case ThreadPriority::RealtimeFifo:
+        value = THREAD_PRIORITY_TIME_CRITICAL;
+        break;
+    }
+    return SetThreadPriority(GetCurrentThread(), value) != 0;
+}
+
+#else
+
+static bool apply_nice(int nice_value)
+{
+#if defined(__linux__)
+    // on Linux the nice value is per thread when addressed by tid
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice_value) == 0;
+#else
+    (void)nice_value;
+    return false;
+#endif
+}
+
+static bool apply_priority(ThreadPriority priority)
+{
+    sched_param param = {};
+    switch (priority) {
+    case ThreadPriority::Normal:
+        param.sched_priority = 0;
+        if (pthread_setschedparam(pthread_self(), SCHED_OTHER, &param) != 0)
+            return false;
+        apply_nice(0);
+        return true;
+    case ThreadPriority::High:
+        // nice has no effect while the thread is still SCHED_RR/FIFO
+        param.sched_priority = 0;
+        if (pthread_setschedparam(pthread_self(), SCHED_OTHER, &param) != 0)
+            return false;
+        return apply_nice(-5);
+    case ThreadPriority::RealtimeRR:
+        param.sched_priority = sched_get_priority_min(SCHED_RR) + 1;
+        return pthread_setschedparam(pthread_self(), SCHED_RR, &param) == 0;
+    case ThreadPriority::RealtimeFifo:
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+    return false;
+}
+
+#endif
+
+ThreadPriority set_current_thread_priority(ThreadPriority priority)
+{
+    int level = (int)priority;
+    for (; level > (int)ThreadPriority::Normal; level--) {
+        if (apply_priority((ThreadPriority)level))
+            return (ThreadPriority)level;
+    }
+    apply_priority(ThreadPriority::Normal);
+    return ThreadPriority::Normal;
+}
+
+bool set_current_thread_affinity(uint64_t mask)
+{
+#if defined(_WIN32)
+    if (mask == 0) {
+        DWORD_PTR process_mask, system_mask;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(), process_mask) != 0;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+#elif defined(__linux__)
+    // the mask the thread had before we first pinned it, e.g. from taskset
+    thread_local bool saved = false;
+    thread_local cpu_set_t original;
+    if (mask == 0) {
+        if (!saved)
+            return true;
+        return pthread_setaffinity_np(pthread_self(), sizeof(original), &original) == 0;
+    }
+    if (!saved) {
+        if (sched_getaffinity(0, sizeof(original), &original) != 0)
+            return false;
+        saved = true;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    for (long cpu = 0; cpu < cpus && cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+        if (mask & (UINT64_C(1) << cpu))
+            CPU_SET((int)cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // macOS only offers affinity hints between threads, not CPU pinning
+    return mask == 0;
+#endif
+}
+
+uint64_t parse_cpu_list(const std::string &list)
+{
+    uint64_t mask = 0;
+    const char *p = list.c_str();
+
+    while (*p) {
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (!*p)
+            break;
+
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            return 0;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1)
+                return 0;
+            p = end;
+        }
+        if (first < 0 || last > 63 || first > last)
+            return 0;
+        for (long cpu = first; cpu <= last; cpu++)
+            mask |= UINT64_C(1) << cpu;
+
+        while (*p == ' ')
+            p++;
+        if (*p && *p != ',')
+            return 0;
+    }
+    return mask;
+}
+
+uint64_t current_thread_cpu_time_ns()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit_time, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit_time, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 100;
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+} // namespace AVerMedia
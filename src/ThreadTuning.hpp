@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace AVerMedia {
+
+enum class ThreadPriority {
+    Normal = 0,
+    High = 1,         // nice -5 / THREAD_PRIORITY_ABOVE_NORMAL
+    RealtimeRR = 2,   // SCHED_RR / THREAD_PRIORITY_HIGHEST
+    RealtimeFifo = 3, // SCHED_FIFO / THREAD_PRIORITY_TIME_CRITICAL
+};
+
+const char *thread_priority_name(ThreadPriority priority);
+
+// Applies `priority` to the calling thread. When the OS refuses (no
+// CAP_SYS_NICE, rtprio limit, ...) the next lower class is tried, down to
+// Normal. Returns the class that was actually applied.
+ThreadPriority set_current_thread_priority(ThreadPriority priority);
+
+// Pins the calling thread to the CPUs in `mask` (bit n = CPU n). A zero mask
+// gives the thread back the CPUs it was allowed before the first pinning.
+// Returns false if the OS does not support or refused it.
+bool set_current_thread_affinity(uint64_t mask);
+
+// Parses "0,2,4-7" into a CPU mask. Returns 0 for an empty or invalid list.
+uint64_t parse_cpu_list(const std::string &list);
+
+// CPU time consumed by the calling thread, in nanoseconds.
+uint64_t current_thread_cpu_time_ns();
+
+} // namespace AVerMedia
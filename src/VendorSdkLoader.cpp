@@ -0,0 +1,108 @@
+#include "VendorSdkLoader.hpp"
+
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/bmem.h>
+
+#include "AVerMediaVendorSdkLoader.h"
+#include "VendorSdkScheduler.hpp"
+
+#include <chrono>
+#include <future>
+
+namespace AVerMedia {
+
+static VendorSdk *g_vendorSdk = nullptr;
+static std::shared_future<bool> g_vendorSdkReady;
+
+VendorSdk *GetVendorSdk()
+{
+    return g_vendorSdk;
+}
+
+bool WaitVendorSdkReady(uint32_t timeout_ms)
+{
+    if (!g_vendorSdkReady.valid())
+        return false;
+
+    auto status = g_vendorSdkReady.wait_for(std::chrono::milliseconds(timeout_ms));
+    if (status != std::future_status::ready) {
+        obs_log(LOG_WARNING, "VendorSdk is not ready after %u ms", timeout_ms);
+        return false;
+    }
+    return g_vendorSdkReady.get();
+}
+
+bool IsVendorSdkReady()
+{
+    if (!g_vendorSdkReady.valid())
+        return false;
+    auto status = g_vendorSdkReady.wait_for(std::chrono::milliseconds(0));
+    return status == std::future_status::ready && g_vendorSdkReady.get();
+}
+
+void SubmitWhenVendorSdkReady(const std::string &dedupe_key, std::function<void()> command)
+{
+    // UnloadVendorSdk() resets the global, the command keeps its own copy
+    std::shared_future<bool> ready = g_vendorSdkReady;
+    if (!ready.valid())
+        return;
+
+    GetVendorSdkScheduler().Submit(dedupe_key, [ready, command = std::move(command)]() {
+        // everything queued after this needs the SDK as well
+        if (ready.get())
+            command();
+    });
+}
+
+} // namespace AVerMedia
+
+using namespace AVerMedia;
+
+extern "C" {
+
+void LoadVendorSdk()
+{
+    obs_log(LOG_INFO, "LoadVendorSdk");
+    if (g_vendorSdk != nullptr)
+        return;
+
+    char *path = obs_get_module_data_path(obs_current_module());
+    obs_log(LOG_INFO, "LoadVendorSdk path: %s", path);
+    g_vendorSdk = new VendorSdk(path);
+    bfree(path);
+    GetVendorSdkScheduler().Start();
+
+    VendorSdk *sdk = g_vendorSdk;
+    g_vendorSdkReady = std::async(std::launch::async, [sdk]() {
+        auto start = std::chrono::steady_clock::now();
+        int ret = sdk->initialize();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        obs_log(ret == VendorSdk::ERROR_OK ? LOG_INFO : LOG_WARNING,
+                "VendorSdk initialize returned %d after %lld ms", ret,
+                (long long)elapsed.count());
+        return ret == VendorSdk::ERROR_OK;
+    }).share();
+}
+
+void UnloadVendorSdk()
+{
+    obs_log(LOG_INFO, "UnloadVendorSdk");
+    if (g_vendorSdk == nullptr)
+        return;
+
+    // the SDK must not be torn down while initialize() is still running
+    if (g_vendorSdkReady.valid())
+        g_vendorSdkReady.wait();
+    g_vendorSdkReady = {};
+    GetVendorSdkScheduler().Stop();
+
+    g_vendorSdk->closePort();
+    g_vendorSdk->uninitialize();
+    delete g_vendorSdk;
+    g_vendorSdk = nullptr;
+}
+
+} // extern "C"
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace AVerMedia {
+
+class VendorSdk;
+
+// How long a source waits for the SDK before it gives up on switching the
+// device to non-PCM output and captures whatever the device delivers.
+constexpr uint32_t VENDOR_SDK_READY_TIMEOUT_MS = 5000;
+
+// Process-wide vendor SDK instance. The SDK object is created when the module
+// loads, initialize() runs on a background thread so OBS startup does not
+// wait for it. Returns nullptr if LoadVendorSdk() has not been called.
+VendorSdk *GetVendorSdk();
+
+// Blocks until the background initialize() has finished or `timeout_ms`
+// elapsed. Returns true only if the SDK finished initializing successfully.
+// Sources call this right before they need the SDK, never on module load.
+bool WaitVendorSdkReady(uint32_t timeout_ms);
+
+// Non-blocking: true once the background initialize() has succeeded.
+bool IsVendorSdkReady();
+
+// For a source that gave up waiting: queues `command` on the
+// VendorSdkScheduler behind the background initialize(). It runs once the SDK
+// is up and is dropped if initialize() fails.
+void SubmitWhenVendorSdkReady(const std::string &dedupe_key, std::function<void()> command);
+
+} // namespace AVerMedia
+
+extern "C" {
+void LoadVendorSdk();
+void UnloadVendorSdk();
+}
@@ -0,0 +1,178 @@
+#include "VendorSdkScheduler.hpp"
+
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <chrono>
+
+namespace AVerMedia {
+
+void VendorSdkScheduler::FormatState::Publish(bool value, uint64_t now_ns)
+{
+    non_pcm.store(value ? 1 : 0, std::memory_order_relaxed);
+    updated_ns.store(now_ns, std::memory_order_release);
+}
+
+VendorSdkScheduler::VendorSdkScheduler(uint32_t ttl_ms_) : ttl_ms(ttl_ms_) {}
+
+VendorSdkScheduler::~VendorSdkScheduler()
+{
+    Stop();
+}
+
+void VendorSdkScheduler::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable())
+        return;
+    stopping = false;
+    worker = std::thread(&VendorSdkScheduler::Loop, this);
+}
+
+void VendorSdkScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable())
+            return;
+        stopping = true;
+    }
+    cond.notify_all();
+    worker.join();
+    current_device.clear(); // the SDK is closed after this
+}
+
+std::shared_future<void> VendorSdkScheduler::Submit(const std::string &dedupe_key,
+                                                    std::function<void()> command)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!dedupe_key.empty()) {
+        for (const Command &pending : queue) {
+            if (pending.dedupe_key == dedupe_key) {
+                commands_deduped.fetch_add(1, std::memory_order_relaxed);
+                return pending.future;
+            }
+        }
+    }
+
+    Command cmd;
+    cmd.dedupe_key = dedupe_key;
+    cmd.run = std::move(command);
+    cmd.done = std::make_shared<std::promise<void>>();
+    cmd.future = cmd.done->get_future().share();
+    std::shared_future<void> future = cmd.future;
+    queue.push_back(std::move(cmd));
+
+    cond.notify_all();
+    return future;
+}
+
+VendorSdkScheduler::FormatState *VendorSdkScheduler::GetFormatState(const std::string &device_key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &state = states[device_key];
+    if (!state)
+        state = std::make_unique<FormatState>();
+    return state.get();
+}
+
+void VendorSdkScheduler::RegisterProbe(const std::string &device_key, const void *owner, Probe probe)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        probes[device_key].push_back({owner, std::move(probe)});
+    }
+    cond.notify_all();
+}
+
+void VendorSdkScheduler::UnregisterProbe(const void *owner)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto it = probes.begin(); it != probes.end();) {
+        auto &entries = it->second;
+        for (auto entry = entries.begin(); entry != entries.end();) {
+            entry = entry->owner == owner ? entries.erase(entry) : entry + 1;
+        }
+        it = entries.empty() ? probes.erase(it) : std::next(it);
+    }
+
+    if (std::this_thread::get_id() != worker.get_id())
+        probe_done.wait(lock, [&] { return running_owner != owner; });
+}
+
+void VendorSdkScheduler::RunDueProbes(std::unique_lock<std::mutex> &lock)
+{
+    uint64_t ttl_ns = (uint64_t)ttl_ms * 1000000ULL;
+
+    std::vector<std::string> devices;
+    for (const auto &[device_key, entries] : probes)
+        devices.push_back(device_key);
+
+    for (const std::string &device_key : devices) {
+        // the probe list may change while the lock is released
+        auto it = probes.find(device_key);
+        if (it == probes.end() || it->second.empty())
+            continue;
+
+        auto &state = states[device_key];
+        if (!state)
+            state = std::make_unique<FormatState>();
+        FormatState *snapshot = state.get();
+
+        uint64_t now = os_gettime_ns();
+        if (now - snapshot->updated_ns.load(std::memory_order_acquire) < ttl_ns)
+            continue;
+
+        ProbeEntry entry = it->second.front();
+        running_owner = entry.owner;
+        lock.unlock();
+
+        bool non_pcm = entry.probe();
+        snapshot->Publish(non_pcm, os_gettime_ns());
+        probes_run.fetch_add(1, std::memory_order_relaxed);
+
+        lock.lock();
+        running_owner = nullptr;
+        probe_done.notify_all();
+
+        if (!queue.empty())
+            return; // commands go first, the rest is picked up next round
+    }
+}
+
+void VendorSdkScheduler::Loop()
+{
+    os_set_thread_name("AVerMedia vendor SDK");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait_for(lock, std::chrono::milliseconds(ttl_ms),
+                      [this] { return stopping || !queue.empty(); });
+
+        if (!queue.empty()) {
+            Command cmd = std::move(queue.front());
+            queue.erase(queue.begin());
+            lock.unlock();
+
+            cmd.run();
+            commands_run.fetch_add(1, std::memory_order_relaxed);
+            cmd.done->set_value();
+
+            lock.lock();
+            continue;
+        }
+        if (stopping)
+            break;
+
+        RunDueProbes(lock);
+    }
+}
+
+VendorSdkScheduler &GetVendorSdkScheduler()
+{
+    static VendorSdkScheduler scheduler;
+    return scheduler;
+}
+
+} // namespace AVerMedia
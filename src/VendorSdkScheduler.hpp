@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace AVerMedia {
+
+// Serializes every plugin-side use of the vendor SDK on one thread. The SDK
+// keeps a single "current device", so commands from different sources must
+// not interleave. Device format queries are deduplicated per device and
+// cached: one probe per device runs at most once per TTL, and the result is
+// published as an atomic snapshot that real-time callbacks can read.
+class VendorSdkScheduler
+{
+public:
+    struct FormatState {
+        std::atomic<int> non_pcm{-1}; // -1 unknown, 0 PCM, 1 bitstream
+        std::atomic<uint64_t> updated_ns{0};
+
+        bool IsNonPcm() const { return non_pcm.load(std::memory_order_relaxed) == 1; }
+        void Publish(bool value, uint64_t now_ns);
+    };
+
+    using Probe = std::function<bool()>;
+
+    explicit VendorSdkScheduler(uint32_t ttl_ms = 500);
+    ~VendorSdkScheduler();
+
+    void Start();
+    void Stop(); // runs what is still queued, then joins
+
+    // Queues `command` behind everything submitted before it. While a command
+    // with the same non-empty `dedupe_key` is still queued, the new one is
+    // dropped and the pending command's future is returned instead.
+    std::shared_future<void> Submit(const std::string &dedupe_key, std::function<void()> command);
+
+    // Stable for the lifetime of the scheduler, never nullptr.
+    FormatState *GetFormatState(const std::string &device_key);
+
+    // `probe` queries the SDK on the scheduler thread and returns whether the
+    // device currently delivers a bitstream. Of all probes registered for a
+    // device only the first one is polled.
+    void RegisterProbe(const std::string &device_key, const void *owner, Probe probe);
+    // Removes all probes of `owner`; waits if one of them is running.
+    void UnregisterProbe(const void *owner);
+
+    // The device the SDK was last switched to. Scheduler thread only: the
+    // command or probe that switches records it, a probe of the current
+    // device can then query the format without switching again.
+    void SetCurrentDevice(const std::string &device_key) { current_device = device_key; }
+    bool IsCurrentDevice(const std::string &device_key) const
+    {
+        return !device_key.empty() && current_device == device_key;
+    }
+
+    uint64_t CommandsRun() const { return commands_run.load(std::memory_order_relaxed); }
+    uint64_t CommandsDeduped() const { return commands_deduped.load(std::memory_order_relaxed); }
+    uint64_t ProbesRun() const { return probes_run.load(std::memory_order_relaxed); }
+
+private:
+    struct Command {
+        std::string dedupe_key;
+        std::function<void()> run;
+        std::shared_ptr<std::promise<void>> done;
+        std::shared_future<void> future;
+    };
+
+    struct ProbeEntry {
+        const void *owner;
+        Probe probe;
+    };
+
+    void Loop();
+    void RunDueProbes(std::unique_lock<std::mutex> &lock);
+
+    const uint32_t ttl_ms;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable probe_done;
+    std::vector<Command> queue;
+    std::unordered_map<std::string, std::unique_ptr<FormatState>> states;
+    std::unordered_map<std::string, std::vector<ProbeEntry>> probes;
+    const void *running_owner = nullptr;
+    std::string current_device; // scheduler thread only
+    bool stopping = false;
+    std::thread worker;
+
+    std::atomic<uint64_t> commands_run{0};
+    std::atomic<uint64_t> commands_deduped{0};
+    std::atomic<uint64_t> probes_run{0};
+};
+
+// Process-wide instance, started and stopped with the vendor SDK.
+VendorSdkScheduler &GetVendorSdkScheduler();
+
+} // namespace AVerMedia
@@ -4,9 +4,18 @@
 #include <util/platform.h>
 #include <util/threading.h>
 #include "encode-dstr.hpp"
+#include "RealtimeCheck.hpp"
+#include "VendorSdkLoader.hpp"
+#include "VendorSdkScheduler.hpp"
+#include "CaptureSession.hpp"
+#include "PipelineTrace.hpp"
+
+#include <future>
 
 #define UNUSED(param) (void)param;
 #define AUDIO_DEVICE_ID   "audio_device_id"
+#define WARM_STANDBY       "warm_standby"
+#define WARM_STANDBY_LIMIT "warm_standby_limit"
 
 #ifdef ENABLE_FFMPEG_DECODE
 #include "FfmpegAudioDecode.hpp"
@@ -28,6 +37,34 @@ static DWORD CALLBACK DShowThread(LPVOID ptr)
     return 0;
 }
 
+static const char *phase_names[AVerMedia::AudioDShowInput::PHASE_COUNT] = {
+    "sdk_switch",
+    "reset_graph",
+    "update_device",
+    "connect_filters",
+    "set_callback",
+    "start",
+    "total",
+    "first_audio",
+};
+
+static inline uint64_t elapsed_us(uint64_t since_ns)
+{
+    return (os_gettime_ns() - since_ns) / 1000;
+}
+
+static void GetActivationStatsProc(void *data, calldata_t *cd)
+{
+    auto input = reinterpret_cast<AVerMedia::AudioDShowInput*>(data);
+    calldata_set_string(cd, "json", input->ActivationStatsJson().c_str());
+}
+
+static void GetDecoderStatsProc(void *data, calldata_t *cd)
+{
+    auto input = reinterpret_cast<AVerMedia::AudioDShowInput*>(data);
+    calldata_set_string(cd, "json", input->DecoderStatsJson().c_str());
+}
+
 static inline void ProcessMessages()
 {
     MSG msg;
@@ -40,30 +77,29 @@ static inline void ProcessMessages()
 namespace AVerMedia
 {
     AudioDShowInput::AudioDShowInput(VendorSdk *sdk, obs_data_t* settings, obs_source_t* source)
-        : obsSource(source), device(new AVerMedia::AudioDevice)
+        : obsSource(source), sourceGate(source), device(new AVerMedia::AudioDevice),
+          scheduler([this]() { ReleaseSemaphore(semaphore, 1, nullptr); }), vendorSdk(sdk)
     {
-        deviceOpener.SetVendorSdk(sdk);
-        deviceOpener.SetLogHandler([=](int log_level, const char* message){
-            if (log_level == DeviceOpener::LEVEL_ERROR) {
-                obs_log(LOG_ERROR, message);
-            }
-            else {
-                obs_log(LOG_DEBUG, message);
-            }
-        });
-
         semaphore = CreateSemaphore(nullptr, 0, 0x7FFFFFFF, nullptr);
         if (!semaphore)
             throw "Failed to create semaphore";
 
-        activated_event = CreateEvent(nullptr, false, false, nullptr);
-        if (!activated_event)
-            throw "Failed to create activated_event";
-
         thread = CreateThread(nullptr, 0, DShowThread, this, 0, nullptr);
         if (!thread)
             throw "Failed to create thread";
 
+        taps.Update(settings);
+        decodeOptions = DecodeOptions::FromSettings(settings);
+        decodeOptions.device_key = obs_data_get_string(settings, AUDIO_DEVICE_ID);
+        warmStandby = obs_data_get_bool(settings, WARM_STANDBY);
+        standbyLimitSec = (uint32_t)obs_data_get_int(settings, WARM_STANDBY_LIMIT);
+
+        proc_handler_t* ph = obs_source_get_proc_handler(source);
+        proc_handler_add(ph, "void get_activation_stats(out string json)",
+                         GetActivationStatsProc, this);
+        proc_handler_add(ph, "void get_decoder_stats(out string json)",
+                         GetDecoderStatsProc, this);
+
         if (obs_data_get_bool(settings, "active")) {
             bool showing = obs_source_showing(source);
             if (showing) {
@@ -80,6 +116,12 @@ namespace AVerMedia
     {
         obs_log(LOG_DEBUG, "AudioDShowInput::~AudioDShowInput 1");
 
+        /* an activation still in progress sees the shutdown and bails out */
+        scheduler.Post(Action::Shutdown);
+        WaitForSingleObject(thread, INFINITE);
+        GetVendorSdkScheduler().UnregisterProbe(this);
+        LeaveSession();
+
         if (device) {
             obs_log(LOG_DEBUG, "AudioDShowInput::~AudioDShowInput, delete device");
             device->Stop();
@@ -95,23 +137,45 @@ namespace AVerMedia
         }
 #endif // ENABLE_FFMPEG_DECODE
 
-        {
-            CriticalScope scope(mutex);
-            actions.resize(1);
-            actions[0] = Action::Shutdown;
-        }
-
-        ReleaseSemaphore(semaphore, 1, nullptr);
-
-        WaitForSingleObject(thread, INFINITE);
-
         obs_log(LOG_DEBUG, "AudioDShowInput::~AudioDShowInput 2");
     }
 
     void AudioDShowInput::Update(obs_data_t* settings)
     {
+        std::string deviceId = obs_data_get_string(settings, AUDIO_DEVICE_ID);
+        bool deviceChanged;
+
+        /* debug taps, decoder options and standby limits apply in place,
+         * only a different device needs the graph rebuilt */
+        taps.Update(settings);
+        {
+            CriticalScope scope(mutex);
+            DecodeOptions options = DecodeOptions::FromSettings(settings);
+            options.device_key = deviceId;
+#ifdef ENABLE_FFMPEG_DECODE
+            if (decode) {
+                decode->SetOptions(options);
+            }
+#endif // ENABLE_FFMPEG_DECODE
+            decodeOptions = options;
+            warmStandby = obs_data_get_bool(settings, WARM_STANDBY);
+            standbyLimitSec = (uint32_t)obs_data_get_int(settings, WARM_STANDBY_LIMIT);
+            deviceChanged = appliedDeviceId.empty() || deviceId != appliedDeviceId;
+        }
+
         if (m_active) {
-            QueueActivate(settings);
+            if (deviceChanged) {
+                /* a hide may replace this Activate before it runs */
+                standbyStale = true;
+                QueueActivate(settings);
+            } else {
+                obs_log(LOG_DEBUG, "AudioDShowInput::Update, device unchanged, no restart");
+                obs_data_erase(settings, "synchronous_activate");
+            }
+        } else if (warmStandbyGraph && deviceChanged) {
+            /* the standby graph was built for the old device */
+            standbyStale = true;
+            QueueAction(Action::Deactivate);
         }
     }
 
@@ -131,7 +195,15 @@ namespace AVerMedia
 
     void AudioDShowInput::Deactivate()
     {
-        deviceOpener.StopChecking();
+        SetAppliedDeviceId("");
+        warmStandbyGraph = false;
+        inStandby = false;
+        graphRunning = false;
+        outputGated = false;
+        LeaveSession();
+        GetVendorSdkScheduler().UnregisterProbe(this);
+        formatState = nullptr;
+        deviceOpener = nullptr;
         if (device) {
             obs_log(LOG_DEBUG, "AudioDShowInput Deactivate, ResetGraph");
             //device->ResetGraph();
@@ -146,33 +218,134 @@ namespace AVerMedia
 #endif // ENABLE_FFMPEG_DECODE
     }
 
-    void AudioDShowInput::PrepareShutDown()
+    /* Hidden: keep the graph and decoder running, only stop the output */
+    void AudioDShowInput::EnterStandby()
     {
-        deviceOpener.StopChecking();
+        warmStandbyGraph = true;
+        uint32_t limitSec;
+        {
+            CriticalScope scope(mutex);
+            limitSec = standbyLimitSec;
+        }
+
+        /* the decoder keeps feeding the other sources of a shared session */
+        outputGated = true;
+        inStandby = true;
+        standbyDeadlineNs = limitSec ? os_gettime_ns() + limitSec * 1000000000ULL : 0;
+        obs_log(LOG_INFO, "AudioDShowInput: warm standby (limit %u s)", limitSec);
+    }
+
+    void AudioDShowInput::LeaveStandby()
+    {
+        warmStandbyGraph = false;
+        inStandby = false;
+        outputGated = false;
+        obs_log(LOG_INFO, "AudioDShowInput: resumed from warm standby");
+    }
 
+    void AudioDShowInput::PrepareShutDown()
+    {
         if (device) {
             device->ShutdownGraph();
         }
     }
 
+    void AudioDShowInput::Detach()
+    {
+        sourceGate.Detach();
+        LeaveSession();
+#ifdef ENABLE_FFMPEG_DECODE
+        CriticalScope scope(mutex);
+        if (decode) {
+            decode->Detach();
+        }
+#endif // ENABLE_FFMPEG_DECODE
+    }
+
+    /* sink of this source in its capture session, on the leader's decode thread */
+    void AudioDShowInput::OutputAudio(const obs_source_audio* audio)
+    {
+        if (outputGated) {
+            return;
+        }
+        OutputGate::Use source(sourceGate);
+        if (source) {
+            AVT_TRACE_SPAN("obs_source_output_audio");
+            obs_source_output_audio(source.get(), audio);
+        }
+    }
+
+    bool AudioDShowInput::JoinSession(const std::string& deviceKey)
+    {
+        auto membership = GetCaptureSessionRegistry().Join(deviceKey, this,
+            [this](const obs_source_audio* audio) { OutputAudio(audio); },
+            [this]() { QueueAction(Action::Activate); });
+        {
+            CriticalScope scope(mutex);
+            session = membership.session;
+            sessionGeneration = membership.generation;
+        }
+
+        /* Detach() may have run while joining */
+        if (!sourceGate.Attached()) {
+            LeaveSession();
+            return false;
+        }
+        return membership.leader;
+    }
+
+    void AudioDShowInput::LeaveSession()
+    {
+        GetCaptureSessionRegistry().Leave(this);
+        CriticalScope scope(mutex);
+        session.reset();
+    }
+
+    OBSDataAutoRelease AudioDShowInput::GetSourceSettings()
+    {
+        OutputGate::Use source(sourceGate);
+        if (!source) {
+            return nullptr;
+        }
+        return obs_source_get_settings(source.get());
+    }
+
     void AudioDShowInput::SetActive(bool active)
     {
         OBSDataAutoRelease settings = obs_source_get_settings(obsSource);
-        QueueAction(active ? Action::Activate : Action::Deactivate);
+        QueueAction(active ? Action::Resume : Action::Deactivate);
         obs_data_set_bool(settings, "active", active);
         m_active = active;
     }
 
-    bool AudioDShowInput::Activate(obs_data_t* settings)
+    bool AudioDShowInput::Activate(obs_data_t* settings, const ActionScheduler::Task& task)
     {
         obs_log(LOG_DEBUG, "AudioDShowInput::Activate 0");
 
+        SetAppliedDeviceId("");
+        standbyStale = false;
+        warmStandbyGraph = false;
+        inStandby = false;
+        graphRunning = false;
+        outputGated = false;
+
+        /* OnAudioData uses the decoder without the lock and creates one for
+         * the session it last joined, so the old graph stops first */
+        if (device) {
+            device->Stop();
+        }
+
 #ifdef ENABLE_FFMPEG_DECODE
-        if (decode) {
-            obs_log(LOG_DEBUG, "delete old decoder");
-            delete decode;
+        FfmpegAudioDecode* oldDecode;
+        {
+            CriticalScope scope(mutex);
+            oldDecode = decode;
             decode = nullptr;
         }
+        if (oldDecode) {
+            obs_log(LOG_DEBUG, "delete old decoder");
+            delete oldDecode;
+        }
 #endif // ENABLE_FFMPEG_DECODE
 
         DeviceInfo info;
@@ -188,56 +361,145 @@ namespace AVerMedia
         }
 #endif
 
-        deviceOpener.StopChecking();
-        deviceOpener.SwitchDeviceThenDetectAudioFormat({info.name, info.path});
+        VendorSdkScheduler& sdkScheduler = GetVendorSdkScheduler();
+        sdkScheduler.UnregisterProbe(this);
+        formatState = nullptr;
+        deviceOpener = nullptr;
+
+        /* only one source per device captures, the others share its audio */
+        std::string deviceKey = obs_data_get_string(settings, AUDIO_DEVICE_ID);
+        if (!JoinSession(deviceKey)) {
+            /* no graph and no SDK switch, the leader's decoder feeds us */
+            if (device) {
+                device->Stop();
+            }
+            if (!sourceGate.Attached()) {
+                return false;
+            }
+            obs_log(LOG_INFO, "AudioDShowInput::Activate, sharing the capture of another source");
+            SetAppliedDeviceId(deviceKey.c_str());
+            return true;
+        }
+
+        uint64_t activateStart = os_gettime_ns();
+        pendingFirstAudioNs = 0;
+
+        /* the vendor SDK talks to the device over USB, independent of the
+         * DirectShow graph, so switch it while the graph is being built */
+        std::shared_ptr<SharedDeviceOpener> opener =
+            SharedDeviceOpener::Acquire(vendorSdk, deviceKey, {info.name, info.path});
+        VendorSdkScheduler::FormatState* state = sdkScheduler.GetFormatState(deviceKey);
+        auto switchDevice = [opener, state]() {
+            state->Publish(opener->SwitchThenDetect(), os_gettime_ns());
+        };
+        std::future<bool> sdkSwitch = std::async(std::launch::async, [this, switchDevice, deviceKey, &sdkScheduler]() {
+            if (!WaitVendorSdkReady(VENDOR_SDK_READY_TIMEOUT_MS)) {
+                /* don't hold the graph back, switch as soon as the SDK is up */
+                SubmitWhenVendorSdkReady("switch:" + deviceKey, switchDevice);
+                return false;
+            }
+
+            uint64_t start = os_gettime_ns();
+            /* queued behind the SDK work of every other source */
+            sdkScheduler.Submit("switch:" + deviceKey, switchDevice).wait();
+            phaseTimes[PHASE_SDK_SWITCH].Record(elapsed_us(start));
+            return true;
+        });
+
+        /* an early return below still waits for the switch in ~future */
+        auto runPhase = [this](ActivationPhase phase, auto&& step) {
+            uint64_t start = os_gettime_ns();
+            bool ok = step();
+            phaseTimes[phase].Record(elapsed_us(start));
+            if (!ok)
+                obs_log(LOG_WARNING, "AudioDShowInput::Activate, %s failed", phase_names[phase]);
+            return ok;
+        };
 
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 1");
         if (device == nullptr) {
             return false;
         }
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 2");
-        if (!device->ResetGraph()) {
+        if (!runPhase(PHASE_RESET_GRAPH, [&] { return device->ResetGraph(); })) {
             return false;
         }
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 3");
-
-        if (!device->UpdateDevice(info.name, info.path)) {
+        if (scheduler.IsSuperseded(task)) {
+            obs_log(LOG_DEBUG, "AudioDShowInput::Activate, superseded before building the graph");
             return false;
         }
-
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 4");
-        if (!device->ConnectFilters()) {
+        if (!runPhase(PHASE_UPDATE_DEVICE, [&] { return device->UpdateDevice(info.name, info.path); })) {
+            return false;
+        }
+        if (!runPhase(PHASE_CONNECT_FILTERS, [&] { return device->ConnectFilters(); })) {
+            return false;
+        }
+        if (!runPhase(PHASE_SET_CALLBACK, [&] { return device->SetCallback(this); })) {
             return false;
-        }           
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 5");
-        if (!device->SetCallback(this)) {
+        }
+
+        /* the device must be switched before the first samples arrive */
+        bool sdkSwitched = sdkSwitch.get();
+        if (scheduler.IsSuperseded(task)) {
+            obs_log(LOG_DEBUG, "AudioDShowInput::Activate, superseded after device switch");
             return false;
         }
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 6");
-        if (!device->Start()) {
+
+        pendingFirstAudioNs = activateStart;
+        if (!runPhase(PHASE_START, [&] { return device->Start(); })) {
+            pendingFirstAudioNs = 0;
             return false;
         }
-        obs_log(LOG_DEBUG, "AudioDShowInput::Activate 7");
-        deviceOpener.StartChecking();
+        /* polled on the scheduler thread, once per device and TTL; after a
+         * late SDK start the probe picks the format up once it is switched */
+        deviceOpener = opener;
+        formatState = state;
+        sdkScheduler.RegisterProbe(deviceKey, this, [opener]() {
+            return opener->Detect();
+        });
+        graphRunning = true;
+        SetAppliedDeviceId(obs_data_get_string(settings, AUDIO_DEVICE_ID));
+
+        phaseTimes[PHASE_TOTAL].Record(elapsed_us(activateStart));
+        obs_log(LOG_INFO, "AudioDShowInput::Activate took %llu ms (sdk switch %llu ms)",
+                (unsigned long long)phaseTimes[PHASE_TOTAL].LastUs() / 1000,
+                sdkSwitched ? (unsigned long long)phaseTimes[PHASE_SDK_SWITCH].LastUs() / 1000 : 0ULL);
 
         return true;
     }
 
-    void AudioDShowInput::QueueAction(Action action)
+    void AudioDShowInput::SetAppliedDeviceId(const char* deviceId)
+    {
+        CriticalScope scope(mutex);
+        appliedDeviceId = deviceId;
+    }
+
+    GraphState AudioDShowInput::GetGraphState(obs_data_t* settings)
+    {
+        GraphState graph;
+        graph.running = graphRunning;
+        graph.in_standby = inStandby;
+        graph.stale = standbyStale.exchange(false);
+        if (settings) {
+            const char* deviceId = obs_data_get_string(settings, AUDIO_DEVICE_ID);
+            CriticalScope scope(mutex);
+            graph.device_matches = !appliedDeviceId.empty() && appliedDeviceId == deviceId;
+        }
+        return graph;
+    }
+
+    uint64_t AudioDShowInput::QueueAction(Action action)
     {
-        obs_log(LOG_DEBUG, "AudioDShowInput::QueueAction %d", action);
-        actions.push_back(action);
-        ReleaseSemaphore(semaphore, 1, nullptr);
+        obs_log(LOG_DEBUG, "AudioDShowInput::QueueAction %s", action_name(action));
+        return scheduler.Post(action);
     }
 
     void AudioDShowInput::QueueActivate(obs_data_t* settings)
     {
         bool block =
             obs_data_get_bool(settings, "synchronous_activate");
-        QueueAction(block ? Action::ActivateBlock : Action::Activate);
+        uint64_t ticket = QueueAction(Action::Activate);
         if (block) {
             obs_data_erase(settings, "synchronous_activate");
-            WaitForSingleObject(activated_event, INFINITE);
+            scheduler.Wait(ticket);
         }
     }
 
@@ -247,60 +509,151 @@ namespace AVerMedia
         obs_log(LOG_DEBUG, "AudioDShowInput::DShowLoop, thread id: %lu", GetCurrentThreadId());
 
         while (true) {
+            DWORD timeout = INFINITE;
+            if (inStandby && standbyDeadlineNs) {
+                uint64_t now = os_gettime_ns();
+                timeout = now >= standbyDeadlineNs
+                    ? 0 : (DWORD)((standbyDeadlineNs - now + 999999) / 1000000);
+            }
+
             DWORD ret = MsgWaitForMultipleObjects(1, &semaphore, false,
-                INFINITE, QS_ALLINPUT);
+                timeout, QS_ALLINPUT);
             if (ret == (WAIT_OBJECT_0 + 1)) {
                 ProcessMessages();
                 continue;
             }
+            else if (ret == WAIT_TIMEOUT) {
+                obs_log(LOG_INFO, "AudioDShowInput: warm standby limit reached, stopping device");
+                Deactivate();
+                continue;
+            }
             else if (ret != WAIT_OBJECT_0) {
                 break;
             }
 
-            Action action = Action::None;
-            {
-                CriticalScope scope(mutex);
-                if (actions.size()) {
-                    action = actions.front();
-                    actions.erase(actions.begin());
-                }
-            }
+            ActionScheduler::Task task = scheduler.Take();
 
-            switch (action) {
-            case Action::Activate:
-            case Action::ActivateBlock: {
+            switch (task.action) {
+            case Action::Activate: {
                 obs_log(LOG_DEBUG, "AudioDShowInput::DShowLoop, Action::Activate");
-                OBSDataAutoRelease settings = obs_source_get_settings(obsSource);
-                
-                Activate(settings);
-
-                if (action == Action::ActivateBlock) {
-                    SetEvent(activated_event);
+                OBSDataAutoRelease settings = GetSourceSettings();
+                if (settings) {
+                    Activate(settings, task);
                 }
-                break;;
+                break;
             };
-            case Action::Deactivate:
-                Deactivate();
+            case Action::Resume: {
+                OBSDataAutoRelease settings = GetSourceSettings();
+                switch (resume_step(GetGraphState(settings))) {
+                case GraphStep::LeaveStandby:
+                    LeaveStandby();
+                    break;
+                case GraphStep::Ungate:
+                    /* shown again before the hide was handled, nothing to rebuild */
+                    outputGated = false;
+                    break;
+                default:
+                    if (settings) {
+                        Activate(settings, task);
+                    }
+                    break;
+                }
                 break;
+            }
+
+            case Action::Deactivate: {
+                bool warm;
+                {
+                    CriticalScope scope(mutex);
+                    warm = warmStandby;
+                }
+                /* a device change while hidden must not keep the old graph warm */
+                OBSDataAutoRelease settings = GetSourceSettings();
+                if (deactivate_step(GetGraphState(settings), warm) == GraphStep::EnterStandby) {
+                    EnterStandby();
+                } else {
+                    Deactivate();
+                }
+                break;
+            }
 
             case Action::Shutdown:
                 PrepareShutDown();
+                scheduler.Complete(task);
                 return;
-            case Action::None:;
+            case Action::None:
+                continue;
             }
+
+            scheduler.Complete(task);
+        }
+    }
+
+    std::string AudioDShowInput::ActivationStatsJson() const
+    {
+        std::string json = "{";
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            if (i)
+                json += ",";
+            json += "\"";
+            json += phase_names[i];
+            json += "\":";
+            json += phaseTimes[i].ToJson();
+        }
+        json += "}";
+        return json;
+    }
+
+    std::string AudioDShowInput::DecoderStatsJson()
+    {
+#ifdef ENABLE_FFMPEG_DECODE
+        CriticalScope scope(mutex);
+        if (decode) {
+            return decode->Stats().ToJson();
         }
+#endif // ENABLE_FFMPEG_DECODE
+        return "{}";
     }
 
     BOOL AudioDShowInput::OnAudioData(AUDIO_SAMPLE_INFO audioInfo, BYTE* pbData, LONG lLength)
     {
+        AVT_TRACE_SPAN("capture");
+        if (pendingFirstAudioNs.load(std::memory_order_relaxed)) {
+            uint64_t start = pendingFirstAudioNs.exchange(0);
+            if (start)
+                phaseTimes[PHASE_FIRST_AUDIO].Record(elapsed_us(start));
+        }
+
+        if (taps.raw.IsActive()) {
+            AudioDebugTap::Format format;
+            format.sample_rate = audioInfo.dwSamplingRate;
+            format.channels = (uint16_t)audioInfo.dwChannels;
+            format.bits = (uint16_t)audioInfo.dwBitsPerSample;
+            taps.raw.SetFormat(format);
+            taps.raw.Write(pbData, (size_t)lLength);
+        }
+
 #ifdef ENABLE_FFMPEG_DECODE
 //        obs_log(LOG_DEBUG, "AudioDShowInput::OnAudioData %d %d %d %d",
 //                audioInfo.dwSamplingRate, audioInfo.dwChannels, audioInfo.dwBitsPerSample, lLength);
 
-        if (deviceOpener.IsAudioFormatNonPcm()) {
+        VendorSdkScheduler::FormatState* state = formatState.load(std::memory_order_acquire);
+        if (state && state->IsNonPcm()) {
             if (decode == nullptr) { /* having packets, create decoder now */
-                decode = new FfmpegAudioDecode(obsSource);
+                CriticalScope scope(mutex);
+                if (!sourceGate.Attached()) {
+                    return TRUE; /* being destroyed */
+                }
+                std::shared_ptr<CaptureSession> shared = session;
+                uint64_t generation = sessionGeneration;
+                decode = new FfmpegAudioDecode([shared, generation](const obs_source_audio* audio) {
+                    if (shared) {
+                        shared->Output(generation, audio);
+                    }
+                }, &taps, decodeOptions);
             }
+            RealtimeScope rt;
+            decode->SetInputRate(audioInfo.dwSamplingRate);
             decode->OnEncodedAudioData(pbData, lLength, 0);
             return TRUE;
         }
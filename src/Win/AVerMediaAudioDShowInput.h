@@ -5,8 +5,18 @@
 #include <obs.hpp>
 #include <util/windows/WinHandle.hpp>
 
-#include "AVerMediaDeviceOpener.h"
 #include "AVerMediaAudioDevice.h"
+#include "AudioDebugTap.hpp"
+#include "DecodeOptions.hpp"
+#include "ActionScheduler.hpp"
+#include "LatencyHistogram.hpp"
+#include "VendorSdkScheduler.hpp"
+#include "SharedDeviceOpener.hpp"
+#include "OutputGate.hpp"
+#include "CaptureSession.hpp"
+
+#include <atomic>
+#include <string>
 
 class CriticalSection {
     CRITICAL_SECTION mutex;
@@ -40,12 +50,18 @@ class FfmpegAudioDecode;
 class AudioDShowInput : public AudioDealer
 {
 public:
-    enum class Action {
-        None,
-        Activate,
-        ActivateBlock,
-        Deactivate,
-        Shutdown
+    using Action = ActionScheduler::Action;
+
+    enum ActivationPhase {
+        PHASE_SDK_SWITCH,     // vendor SDK device switch + format detection
+        PHASE_RESET_GRAPH,
+        PHASE_UPDATE_DEVICE,
+        PHASE_CONNECT_FILTERS,
+        PHASE_SET_CALLBACK,
+        PHASE_START,
+        PHASE_TOTAL,          // Activate() entry until the graph runs
+        PHASE_FIRST_AUDIO,    // Activate() entry until the first audio callback
+        PHASE_COUNT
     };
 
     AudioDShowInput(AVerMedia::VendorSdk* sdk, obs_data_t* settings, obs_source_t* source);
@@ -54,11 +70,22 @@ public:
     void Update(obs_data_t* settings);
     void Activate();
     void Deactivate();
+    void EnterStandby();
+    void LeaveStandby();
     void PrepareShutDown();
+    // Cuts every path from this input to its obs_source_t. Called by the
+    // destroy callback before the rest of the teardown is deferred.
+    void Detach();
     void SetActive(bool active);
 
-    bool Activate(obs_data_t *settings);
-    void QueueAction(Action action);
+    bool Activate(obs_data_t *settings, const ActionScheduler::Task &task);
+    void SetAppliedDeviceId(const char* deviceId);
+    GraphState GetGraphState(obs_data_t* settings); // DShow thread only, consumes standbyStale
+    OBSDataAutoRelease GetSourceSettings(); // nullptr once detached
+    bool JoinSession(const std::string& deviceKey); // true if this source captures
+    void LeaveSession();
+    void OutputAudio(const obs_source_audio* audio);
+    uint64_t QueueAction(Action action);
     void QueueActivate(obs_data_t* settings);
 
     void DShowLoop();
@@ -66,6 +93,10 @@ public:
 
     bool IsActivated() const { return m_active; }
 
+    const LatencyHistogram& PhaseTime(ActivationPhase phase) const { return phaseTimes[phase]; }
+    std::string ActivationStatsJson() const;
+    std::string DecoderStatsJson(); // "{}" without a decoder
+
 #if defined(TEST_PROJECT)
     void SetDevice(const DeviceInfo& device) {
         test_device = device;
@@ -73,16 +104,34 @@ public:
 #endif
 
 private:
-    obs_source_t* obsSource = nullptr;
+    obs_source_t* obsSource = nullptr; // UI thread only, see sourceGate
+    OutputGate sourceGate;             // obsSource for the DShow and capture threads
     AudioDevice *device = nullptr;
     bool m_active = false;
+    bool graphRunning = false;   // DShow thread only
+    bool inStandby = false;      // DShow thread only
+    uint64_t standbyDeadlineNs = 0;
+    std::atomic<bool> outputGated{false};
+    std::atomic<bool> warmStandbyGraph{false}; // a hidden graph is kept running
+    std::atomic<bool> standbyStale{false};     // settings changed while hidden
+    std::string appliedDeviceId; // guarded by mutex, device of the running graph
+    bool warmStandby = false;    // guarded by mutex
+    uint32_t standbyLimitSec = 0; // guarded by mutex, 0 = no limit
     WinHandle semaphore;
-    WinHandle activated_event;
     WinHandle thread;
     CriticalSection mutex;
-    std::vector<Action> actions;
+    ActionScheduler scheduler;
     FfmpegAudioDecode* decode = nullptr;
-    DeviceOpener deviceOpener;
+    std::shared_ptr<CaptureSession> session; // guarded by mutex
+    uint64_t sessionGeneration = 0;          // guarded by mutex
+    VendorSdk* vendorSdk = nullptr;
+    std::shared_ptr<SharedDeviceOpener> deviceOpener; // DShow thread only
+    /* format snapshot of the switched device, read instead of the SDK */
+    std::atomic<VendorSdkScheduler::FormatState*> formatState{nullptr};
+    AudioDebugTaps taps;
+    DecodeOptions decodeOptions;
+    LatencyHistogram phaseTimes[PHASE_COUNT];
+    std::atomic<uint64_t> pendingFirstAudioNs{0};
 #if defined(TEST_PROJECT)
     DeviceInfo test_device;
 #endif
@@ -7,12 +7,13 @@
 #include <plugin-support.h>
 
 #include "AVerMediaAudioDShowInput.h"
-#include "AVerMediaVendorSdkLoader.h"
+#include "VendorSdkLoader.hpp"
+#include "SourceReaper.hpp"
+#include "DeviceRegistry.hpp"
 #include "encode-dstr.hpp"
 #include "LogHelper.h"
 #include <limits>
-#include <thread>
-#include <chrono>
+#include <cfgmgr32.h>
 
 #undef min
 #undef max
@@ -23,8 +24,6 @@
 #define LAST_AUDIO_DEV_ID "last_audio_device_id"
 #define TEXT_DEVICE        obs_module_text("Device")
 
-static AVerMedia::VendorSdk* g_vendorSdk = nullptr;
-
 static void PropertiesDataDestroy(void* data)
 {
 	delete reinterpret_cast<AVerMedia::PropertiesData*>(data);
@@ -107,24 +106,46 @@ static bool DeviceSelectionChanged(obs_properties_t* props,
 	return true;
 }
 
-static bool AddAudioDevice(obs_property_t* device_list,
-	const AVerMedia::DeviceInfo& device)
+static AVerMedia::DeviceEntry MakeDeviceEntry(const AVerMedia::DeviceInfo& device)
 {
-	DStr name, path, device_id;
+	DStr name, device_id;
 
 	dstr_from_wcs(name, device.name.c_str());
-	dstr_from_wcs(path, device.path.c_str());
+	EncodeDeviceId(device_id, device.name.c_str(), device.path.c_str());
 
-	encode_dstr(path);
+	return {std::string(device_id->array), std::string(name->array)};
+}
 
-	dstr_copy_dstr(device_id, name);
-	encode_dstr(device_id);
-	dstr_cat(device_id, ":");
-	dstr_cat_dstr(device_id, path);
+static AVerMedia::DeviceList EnumerateAudioDevices()
+{
+	AVerMedia::DeviceList result;
 
-	obs_property_list_add_string(device_list, name, device_id);
+	/* runs on the registry thread, which has no apartment of its own */
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
 
-	return true;
+	std::vector<AVerMedia::DeviceInfo> devices;
+	AVerMedia::AudioDevice::GetDeviceList(devices);
+	for (const AVerMedia::DeviceInfo& device : devices) {
+		result.push_back(MakeDeviceEntry(device));
+	}
+
+	if (SUCCEEDED(hr))
+		CoUninitialize();
+	return result;
+}
+
+static AVerMedia::DeviceRegistry g_deviceRegistry(EnumerateAudioDevices);
+static HCMNOTIFICATION g_deviceNotification = nullptr;
+
+static DWORD CALLBACK DeviceNotificationCallback(HCMNOTIFICATION, PVOID context,
+						 CM_NOTIFY_ACTION action,
+						 PCM_NOTIFY_EVENT_DATA, DWORD)
+{
+	if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL ||
+	    action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) {
+		reinterpret_cast<AVerMedia::DeviceRegistry*>(context)->Invalidate();
+	}
+	return ERROR_SUCCESS;
 }
 
 static const char *avt_audio_dshow_getname(void *unused)
@@ -137,14 +158,24 @@ static void avt_audio_dshow_destroy(void *data)
 {
 	obs_log(LOG_INFO, "avt_audio_dshow_destroy");
 	obs_log(LOG_DEBUG, "avt_audio_dshow_destroy, CURRENTID %lu", GetCurrentThreadId());
-	delete reinterpret_cast<AVerMedia::AudioDShowInput*>(data);
+	auto input = reinterpret_cast<AVerMedia::AudioDShowInput*>(data);
+
+	/* the source is gone once this returns, the graph and threads are
+	 * stopped and joined in the background */
+	input->Detach();
+	AVerMedia::GetSourceReaper().Defer("avt_audio_dshow_source", [input]() {
+		HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+		delete input;
+		if (SUCCEEDED(hr))
+			CoUninitialize();
+	});
 }
 
 static void *avt_audio_dshow_create(obs_data_t *settings, obs_source_t *source)
 {
 	obs_log(LOG_INFO, "avt_audio_dshow_create");
 	obs_log(LOG_DEBUG, "avt_audio_dshow_create, CURRENTID %lu", GetCurrentThreadId());
-    AVerMedia::AudioDShowInput* audioSource = new AVerMedia::AudioDShowInput(g_vendorSdk, settings, source);
+    AVerMedia::AudioDShowInput* audioSource = new AVerMedia::AudioDShowInput(AVerMedia::GetVendorSdk(), settings, source);
     return audioSource;
 }
 
@@ -174,6 +205,10 @@ static void avt_audio_dshow_get_default(obs_data_t *settings)
 
 	obs_data_set_default_bool(settings, "active", true);
 	obs_data_set_default_bool(settings, "enable_ffmpeg_decode", true);
+	obs_data_set_default_bool(settings, "warm_standby", false);
+	obs_data_set_default_int(settings, "warm_standby_limit", 300);
+	AVerMedia::DecodeOptions::GetDefaults(settings);
+	AVerMedia::AudioDebugTaps::GetDefaults(settings);
 }
 
 static obs_properties_t *avt_audio_dshow_get_properties(void *obj)
@@ -194,11 +229,24 @@ static obs_properties_t *avt_audio_dshow_get_properties(void *obj)
 
 	obs_property_set_modified_callback(device_prop, DeviceSelectionChanged);
 	
-	AVerMedia::AudioDevice::GetDeviceList(data->audioDevices);
-	for (const AVerMedia::DeviceInfo& device : data->audioDevices) {
-		AddAudioDevice(device_prop, device);
+	auto devices = g_deviceRegistry.Snapshot();
+	for (const AVerMedia::DeviceEntry& entry : *devices) {
+		AVerMedia::DeviceInfo device;
+		if (!DecodeDeviceId(device.name, device.path, entry.id.c_str()))
+			continue;
+		data->audioDevices.push_back(device);
+		obs_property_list_add_string(device_prop, entry.name.c_str(), entry.id.c_str());
 	}
 
+	obs_properties_add_bool(props, "warm_standby", obs_module_text("WarmStandby"));
+	obs_property_t* limit = obs_properties_add_int(props, "warm_standby_limit",
+		obs_module_text("WarmStandby.Limit"), 0, 24 * 60 * 60, 10);
+	obs_property_int_set_suffix(limit, " s");
+	obs_property_set_long_description(limit, obs_module_text("WarmStandby.Limit.Description"));
+
+	AVerMedia::DecodeOptions::AddProperties(props);
+	AVerMedia::AudioDebugTaps::AddProperties(props);
+
 	return props;
 }
 
@@ -256,30 +304,29 @@ void RegisterAVerMediaAudioDShowInput()
 	avt_audio_dshow_input.get_properties = avt_audio_dshow_get_properties;
 	avt_audio_dshow_input.icon_type = OBS_ICON_TYPE_AUDIO_INPUT;
 	obs_register_source(&avt_audio_dshow_input);
-}
-void LoadVendorSdk()
-{
-    obs_log(LOG_INFO, "LoadVendorSdk");
-    if (g_vendorSdk == nullptr) {
-        obs_log(LOG_INFO, "LoadVendorSdk g_vendorSdk == nullptr");
-		auto mod = obs_current_module();
-		auto path = obs_get_module_data_path(mod);
-        obs_log(LOG_INFO, "LoadVendorSdk path: %s", path);
-		g_vendorSdk = new AVerMedia::VendorSdk(path);
-		g_vendorSdk->initialize();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+	g_deviceRegistry.Start();
+
+	CM_NOTIFY_FILTER filter = {};
+	filter.cbSize = sizeof(filter);
+	filter.Flags = CM_NOTIFY_FILTER_FLAG_ALL_INTERFACE_CLASSES;
+	filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+	CONFIGRET cr = CM_Register_Notification(&filter, &g_deviceRegistry,
+						DeviceNotificationCallback,
+						&g_deviceNotification);
+	if (cr != CR_SUCCESS) {
+		obs_log(LOG_WARNING, "CM_Register_Notification failed: %lu, "
+			"device list will not follow hotplug", cr);
+		g_deviceNotification = nullptr;
 	}
 }
-void UnloadVendorSdk()
+
+void UnregisterAVerMediaAudioDShowInput()
 {
-	obs_log(LOG_DEBUG, "UnloadVendorSdk");
-	if (g_vendorSdk != nullptr) {
-		g_vendorSdk->closePort();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-		g_vendorSdk->uninitialize();
-		delete g_vendorSdk;
-		g_vendorSdk = nullptr;
+	if (g_deviceNotification) {
+		CM_Unregister_Notification(g_deviceNotification);
+		g_deviceNotification = nullptr;
 	}
+	g_deviceRegistry.Stop();
 }
-
 } // extern "C"
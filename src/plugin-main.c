@@ -25,19 +25,32 @@ OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
 #ifdef WIN32
 extern void RegisterLogHelper();
 extern void RegisterAVerMediaAudioDShowInput();
+extern void UnregisterAVerMediaAudioDShowInput();
 #endif // WIN32
 #ifdef MACOS
 extern void RegisterAVerMediaCoreAudioInput();
+extern void UnregisterAVerMediaCoreAudioInput();
 #endif // MACOS
+#ifdef LINUX
+extern void RegisterAVerMediaAlsaInput();
+extern void UnregisterAVerMediaAlsaInput();
+extern void RegisterAVerMediaShmInput();
+#endif // LINUX
 
 extern void LoadVendorSdk();
 extern void UnloadVendorSdk();
+extern void StartSourceReaper();
+extern void StopSourceReaper();
+extern void StartPipelineTrace();
+extern void StopPipelineTrace();
 
 bool obs_module_load(void)
 {
 	obs_log(LOG_INFO, "version %s (%s)", PLUGIN_VERSION, MY_BUILT_TIME_STR);
 
 	LoadVendorSdk();
+	StartSourceReaper();
+	StartPipelineTrace();
 #ifdef WIN32
 	RegisterLogHelper();
 	RegisterAVerMediaAudioDShowInput();
@@ -45,6 +58,10 @@ bool obs_module_load(void)
 #ifdef MACOS
     RegisterAVerMediaCoreAudioInput();
 #endif // MACOS
+#ifdef LINUX
+	RegisterAVerMediaAlsaInput();
+	RegisterAVerMediaShmInput();
+#endif // LINUX
 	return true;
 }
 
@@ -56,5 +73,17 @@ void obs_module_post_load(void)
 void obs_module_unload(void)
 {
 	//obs_log(LOG_INFO, "plugin unloaded");
+	StopPipelineTrace();
+	/* deferred teardown still needs the SDK and the device registries */
+	StopSourceReaper();
+#ifdef WIN32
+	UnregisterAVerMediaAudioDShowInput();
+#endif // WIN32
+#ifdef MACOS
+	UnregisterAVerMediaCoreAudioInput();
+#endif // MACOS
+#ifdef LINUX
+	UnregisterAVerMediaAlsaInput();
+#endif // LINUX
 	UnloadVendorSdk();
 }
@@ -0,0 +1,161 @@
+#include "Test.hpp"
+
+#include "ActionScheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace AVerMedia;
+using Action = ActionScheduler::Action;
+
+AVT_TEST(ActionScheduler, CoalescesToNewestIntent)
+{
+    int notified = 0;
+    ActionScheduler scheduler([&] { notified++; });
+
+    scheduler.Post(Action::Activate);
+    scheduler.Post(Action::Deactivate);
+    uint64_t last = scheduler.Post(Action::Resume);
+
+    ActionScheduler::Task task = scheduler.Take();
+    AVT_CHECK(task.action == Action::Resume);
+    AVT_CHECK(task.ticket == last);
+    AVT_CHECK(scheduler.CoalescedCount() == 2);
+    AVT_CHECK(notified == 3);
+    AVT_CHECK(scheduler.Take().action == Action::None);
+}
+
+AVT_TEST(ActionScheduler, LaterPostSupersedesRunningTask)
+{
+    ActionScheduler scheduler;
+    scheduler.Post(Action::Activate);
+    ActionScheduler::Task task = scheduler.Take();
+    AVT_CHECK(!scheduler.IsSuperseded(task));
+
+    scheduler.Post(Action::Deactivate);
+    AVT_CHECK(scheduler.IsSuperseded(task));
+    // taking the new one does not make the old one current again
+    ActionScheduler::Task next = scheduler.Take();
+    AVT_CHECK(scheduler.IsSuperseded(task));
+    AVT_CHECK(!scheduler.IsSuperseded(next));
+}
+
+AVT_TEST(ActionScheduler, WaitReturnsOnceTicketCompletes)
+{
+    ActionScheduler scheduler;
+    uint64_t ticket = scheduler.Post(Action::Activate);
+    AVT_CHECK(!scheduler.Wait(ticket, 10));
+
+    std::thread worker([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        scheduler.Complete(scheduler.Take());
+    });
+    AVT_CHECK(scheduler.Wait(ticket, 5000));
+    worker.join();
+    AVT_CHECK(scheduler.Wait(ticket, 0));
+}
+
+AVT_TEST(ActionScheduler, WaitIsReleasedByCoalescedSuccessor)
+{
+    ActionScheduler scheduler;
+    uint64_t first = scheduler.Post(Action::Activate);
+    uint64_t second = scheduler.Post(Action::Deactivate);
+
+    // the first one never runs on its own, completing the second covers it
+    ActionScheduler::Task task = scheduler.Take();
+    AVT_CHECK(task.ticket == second);
+    scheduler.Complete(task);
+    AVT_CHECK(scheduler.Wait(first, 0));
+    AVT_CHECK(scheduler.Wait(second, 0));
+}
+
+AVT_TEST(ActionScheduler, ShutdownIsSticky)
+{
+    ActionScheduler scheduler;
+    uint64_t activate = scheduler.Post(Action::Activate);
+    uint64_t shutdown = scheduler.Post(Action::Shutdown);
+
+    // ignored, and the ticket of the shutdown comes back
+    AVT_CHECK(scheduler.Post(Action::Activate) == shutdown);
+    AVT_CHECK(scheduler.Post(Action::Resume) == shutdown);
+
+    ActionScheduler::Task task = scheduler.Take();
+    AVT_CHECK(task.action == Action::Shutdown);
+    AVT_CHECK(scheduler.Take().action == Action::None);
+
+    // waiters are released without anything being completed
+    AVT_CHECK(scheduler.Wait(activate, 0));
+    AVT_CHECK(scheduler.Wait(shutdown + 1));
+}
+
+AVT_TEST(ActionScheduler, ShutdownReleasesBlockedWaiter)
+{
+    ActionScheduler scheduler;
+    uint64_t ticket = scheduler.Post(Action::Activate);
+
+    std::atomic<bool> released{false};
+    std::thread waiter([&] {
+        scheduler.Wait(ticket);
+        released = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    AVT_CHECK(!released);
+
+    scheduler.Post(Action::Shutdown);
+    waiter.join();
+    AVT_CHECK(released);
+}
+
+AVT_TEST(ActionScheduler, HideAfterDeviceChangeDoesNotKeepOldGraphWarm)
+{
+    // active, then Update picks another device and a hide follows before
+    // the worker runs: the Activate is replaced by the Deactivate
+    ActionScheduler scheduler;
+    scheduler.Post(Action::Activate);
+    scheduler.Post(Action::Deactivate);
+    ActionScheduler::Task task = scheduler.Take();
+    AVT_CHECK(task.action == Action::Deactivate);
+
+    GraphState graph;
+    graph.running = true;
+    graph.device_matches = false; // the settings already name the new device
+    AVT_CHECK(deactivate_step(graph, true) == GraphStep::Deactivate);
+
+    // even if the device check could not see it, the stale mark still does
+    graph.device_matches = true;
+    graph.stale = true;
+    AVT_CHECK(deactivate_step(graph, true) == GraphStep::Deactivate);
+
+    // the later show rebuilds instead of resuming the old device
+    GraphState stopped;
+    AVT_CHECK(resume_step(stopped) == GraphStep::Activate);
+}
+
+AVT_TEST(ActionScheduler, WarmStandbyOnlyForTheSameDevice)
+{
+    GraphState graph;
+    graph.running = true;
+    graph.device_matches = true;
+    AVT_CHECK(deactivate_step(graph, false) == GraphStep::Deactivate);
+    AVT_CHECK(deactivate_step(graph, true) == GraphStep::EnterStandby);
+
+    graph.in_standby = true;
+    AVT_CHECK(resume_step(graph) == GraphStep::LeaveStandby);
+    graph.device_matches = false;
+    AVT_CHECK(resume_step(graph) == GraphStep::Activate);
+}
+
+AVT_TEST(ActionScheduler, ResumeOfRunningGraphDoesNotRebuild)
+{
+    GraphState graph;
+    graph.running = true;
+    graph.device_matches = true;
+    AVT_CHECK(resume_step(graph) == GraphStep::Ungate);
+
+    graph.device_matches = false;
+    AVT_CHECK(resume_step(graph) == GraphStep::Activate);
+    graph.device_matches = true;
+    graph.stale = true;
+    AVT_CHECK(resume_step(graph) == GraphStep::Activate);
+}
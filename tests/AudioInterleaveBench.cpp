@@ -0,0 +1,125 @@
+/*
+ * avt-interleave-bench: checks every interleave kernel this CPU can run
+ * bit for bit against the scalar loop, then times them on capture sized
+ * periods.
+ *
+ *   avt-interleave-bench [milliseconds per kernel]
+ *
+ * Exits with 1 on any mismatch, so ctest runs it as a test.
+ */
+
+#include "AudioInterleave.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#define BENCH_PERIOD_FRAMES 1024 // a CoreAudio buffer
+#define GUARD_SAMPLES 16         // behind the output, must stay untouched
+#define GUARD_VALUE ((int16_t)0x5A5A)
+
+using namespace AVerMedia;
+using namespace std::chrono;
+
+static bool check_kernel(const interleave_kernel &kernel, std::minstd_rand &rng)
+{
+    // every tail length the vector loops leave, and unaligned starts
+    static const size_t lengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 1027};
+    static const int32_t edges[] = {INT32_MIN, INT32_MAX, -1, 0, 1, 0x7FFF, 0x8000, 0xFFFF, 0x10000, -0x10000};
+
+    for (size_t frames : lengths) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            std::vector<int32_t> left(frames + offset), right(frames + offset);
+            for (size_t i = 0; i < left.size(); i++) {
+                bool edge = rng() % 4 == 0;
+                left[i] = edge ? edges[rng() % 10] : (int32_t)rng();
+                right[i] = edge ? edges[rng() % 10] : (int32_t)(rng() << 1);
+            }
+
+            std::vector<int16_t> out(frames * 2 + offset + GUARD_SAMPLES, GUARD_VALUE);
+            kernel.proc(left.data() + offset, right.data() + offset, out.data() + offset, frames);
+
+            for (size_t i = 0; i < frames; i++) {
+                int16_t l = (int16_t)(left[offset + i] >> 16);
+                int16_t r = (int16_t)(right[offset + i] >> 16);
+                if (out[offset + i * 2] != l || out[offset + i * 2 + 1] != r) {
+                    fprintf(stderr, "%s: mismatch at frame %zu of %zu (offset %zu)\n",
+                            kernel.name, i, frames, offset);
+                    return false;
+                }
+            }
+            for (size_t i = 0; i < offset; i++) {
+                if (out[i] != GUARD_VALUE) {
+                    fprintf(stderr, "%s: wrote before the output\n", kernel.name);
+                    return false;
+                }
+            }
+            for (size_t i = offset + frames * 2; i < out.size(); i++) {
+                if (out[i] != GUARD_VALUE) {
+                    fprintf(stderr, "%s: wrote past %zu frames\n", kernel.name, frames);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// nanoseconds per frame over `budget`
+static double time_kernel(const interleave_kernel &kernel, const std::vector<int32_t> &left,
+                          const std::vector<int32_t> &right, milliseconds budget, uint32_t &sink)
+{
+    std::vector<int16_t> out(BENCH_PERIOD_FRAMES * 2);
+    uint64_t periods = 0;
+    auto start = steady_clock::now();
+    auto end = start;
+    do {
+        for (int i = 0; i < 64; i++, periods++) {
+            kernel.proc(left.data(), right.data(), out.data(), BENCH_PERIOD_FRAMES);
+            sink += (uint16_t)out[periods % out.size()];
+        }
+        end = steady_clock::now();
+    } while (end - start < budget);
+
+    return (double)duration_cast<nanoseconds>(end - start).count() /
+           (double)(periods * BENCH_PERIOD_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+    milliseconds budget(argc > 1 ? atoi(argv[1]) : 200);
+
+    interleave_kernel kernels[8];
+    size_t count = interleave_kernels(kernels, 8);
+    printf("selected:   %s\n", interleave_kernel_name());
+
+    std::minstd_rand rng(1);
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        bool exact = check_kernel(kernels[i], rng);
+        printf("%-10s  %s\n", kernels[i].name, exact ? "bit-exact" : "MISMATCH");
+        ok &= exact;
+    }
+
+    std::vector<int32_t> left(BENCH_PERIOD_FRAMES), right(BENCH_PERIOD_FRAMES);
+    for (size_t i = 0; i < BENCH_PERIOD_FRAMES; i++) {
+        left[i] = (int32_t)rng();
+        right[i] = (int32_t)rng();
+    }
+    uint32_t sink = 0;
+    double scalar_ns = 0;
+    printf("\n%-10s %10s %10s   (%d frame periods)\n", "kernel", "ns/frame", "speedup",
+           BENCH_PERIOD_FRAMES);
+    for (size_t i = 0; i < count; i++) {
+        double ns = time_kernel(kernels[i], left, right, budget, sink);
+        if (i == 0)
+            scalar_ns = ns;
+        printf("%-10s %10.3f %9.2fx\n", kernels[i].name, ns, ns > 0 ? scalar_ns / ns : 0.0);
+    }
+    printf("\nchecksum:   %08x\n", sink);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include "Test.hpp"
+
+#include "BackoffPolicy.hpp"
+
+using namespace AVerMedia;
+
+static BackoffPolicy::Config TestConfig(double jitter)
+{
+    BackoffPolicy::Config config;
+    config.initial_ms = 100;
+    config.max_ms = 1000;
+    config.multiplier = 2.0;
+    config.jitter = jitter;
+    return config;
+}
+
+AVT_TEST(BackoffPolicy, DoublesUpToCap)
+{
+    BackoffPolicy backoff(TestConfig(0.0), 1);
+    const uint32_t expected[] = {100, 200, 400, 800, 1000, 1000, 1000};
+    for (uint32_t delay : expected)
+        AVT_CHECK(backoff.NextDelayMs() == delay);
+
+    // the exponent stops at the cap, the attempts keep counting
+    AVT_CHECK(backoff.Attempts() == 7);
+    AVT_CHECK(backoff.NextDelayMs() == 1000);
+}
+
+AVT_TEST(BackoffPolicy, SeededJitterIsReproducible)
+{
+    BackoffPolicy a(TestConfig(0.2), 42);
+    BackoffPolicy b(TestConfig(0.2), 42);
+    BackoffPolicy other(TestConfig(0.2), 43);
+
+    bool differs = false;
+    double base = 100;
+    for (int i = 0; i < 20; i++) {
+        uint32_t delay = a.NextDelayMs();
+        AVT_CHECK(delay == b.NextDelayMs());
+        differs |= delay != other.NextDelayMs();
+
+        // +/- 20 % around the unjittered delay, never above the cap
+        AVT_CHECK(delay >= (uint32_t)(base * 0.8));
+        AVT_CHECK(delay <= (uint32_t)(base * 1.2 + 0.5));
+        AVT_CHECK(delay <= 1000);
+        base = base * 2 > 1000 ? 1000 : base * 2;
+    }
+    AVT_CHECK(differs);
+}
+
+AVT_TEST(BackoffPolicy, ResetStartsOver)
+{
+    BackoffPolicy backoff(TestConfig(0.0), 1);
+    for (int i = 0; i < 10; i++)
+        backoff.NextDelayMs();
+    AVT_CHECK(backoff.NextDelayMs() == 1000);
+
+    backoff.Reset();
+    AVT_CHECK(backoff.Attempts() == 0);
+    AVT_CHECK(backoff.NextDelayMs() == 100);
+    AVT_CHECK(backoff.NextDelayMs() == 200);
+}
+
+AVT_TEST(BackoffPolicy, ConfigIsSanitized)
+{
+    BackoffPolicy::Config config;
+    config.initial_ms = 500;
+    config.max_ms = 100;     // below the initial delay
+    config.multiplier = 0.5; // would shrink
+    config.jitter = 0.0;
+    BackoffPolicy backoff(config, 1);
+    AVT_CHECK(backoff.NextDelayMs() == 500);
+    AVT_CHECK(backoff.NextDelayMs() == 500);
+}
@@ -0,0 +1,192 @@
+#include "Test.hpp"
+
+#include "CaptureSession.hpp"
+#include "RealtimeCheck.hpp"
+
+#include <atomic>
+#include <thread>
+
+using namespace AVerMedia;
+
+namespace {
+
+struct Member {
+    std::atomic<int> buffers{0};
+    std::atomic<int> promotions{0};
+
+    CaptureSession::Sink Sink()
+    {
+        return [this](const struct obs_source_audio *) { buffers++; };
+    }
+    std::function<void()> Promote()
+    {
+        return [this]() { promotions++; };
+    }
+};
+
+} // namespace
+
+AVT_TEST(CaptureSession, FirstMemberLeadsAndAllReceive)
+{
+    CaptureSessionRegistry registry;
+    Member a, b;
+    auto leader = registry.Join("dev", &a, a.Sink(), a.Promote());
+    auto follower = registry.Join("dev", &b, b.Sink(), b.Promote());
+
+    AVT_CHECK(leader.leader);
+    AVT_CHECK(!follower.leader);
+    AVT_CHECK(leader.session == follower.session);
+    AVT_CHECK(leader.session->MemberCount() == 2);
+
+    struct obs_source_audio audio = {};
+    leader.session->Output(leader.generation, &audio);
+    AVT_CHECK(a.buffers == 1);
+    AVT_CHECK(b.buffers == 1);
+
+    registry.Leave(&b);
+    registry.Leave(&a);
+    AVT_CHECK(registry.SessionCount() == 0);
+}
+
+AVT_TEST(CaptureSession, LeaderLeavingPromotesNext)
+{
+    CaptureSessionRegistry registry;
+    Member a, b, c;
+    registry.Join("dev", &a, a.Sink(), a.Promote());
+    registry.Join("dev", &b, b.Sink(), b.Promote());
+    registry.Join("dev", &c, c.Sink(), c.Promote());
+
+    registry.Leave(&a);
+    AVT_CHECK(a.promotions == 0);
+    AVT_CHECK(b.promotions == 1);
+    AVT_CHECK(c.promotions == 0);
+
+    // joining again keeps the role, and tells the new leader it leads
+    auto again = registry.Join("dev", &b, b.Sink(), b.Promote());
+    AVT_CHECK(again.leader);
+
+    // a follower leaving promotes nobody
+    registry.Leave(&c);
+    AVT_CHECK(b.promotions == 1);
+    registry.Leave(&b);
+}
+
+AVT_TEST(CaptureSession, ReplacedLeaderIsFenced)
+{
+    CaptureSessionRegistry registry;
+    Member a, b;
+    auto old_leader = registry.Join("dev", &a, a.Sink(), a.Promote());
+    registry.Join("dev", &b, b.Sink(), b.Promote());
+    registry.Leave(&a);
+
+    auto new_leader = registry.Join("dev", &b, b.Sink(), b.Promote());
+    AVT_CHECK(new_leader.generation != old_leader.generation);
+
+    // the old pipeline is still shutting down and outputs a late buffer
+    struct obs_source_audio audio = {};
+    old_leader.session->Output(old_leader.generation, &audio);
+    AVT_CHECK(b.buffers == 0);
+
+    new_leader.session->Output(new_leader.generation, &audio);
+    AVT_CHECK(b.buffers == 1);
+    AVT_CHECK(a.buffers == 0);
+    registry.Leave(&b);
+}
+
+AVT_TEST(CaptureSession, PromoteMayJoinAndLeave)
+{
+    CaptureSessionRegistry registry;
+    Member a, b, c;
+    registry.Join("dev", &a, a.Sink(), a.Promote());
+
+    // b moves to another device as soon as it would have to capture
+    bool moved_leads = false;
+    registry.Join("dev", &b, b.Sink(), [&]() {
+        b.promotions++;
+        auto moved = registry.Join("other", &b, b.Sink(), b.Promote());
+        moved_leads = moved.leader;
+    });
+    registry.Join("dev", &c, c.Sink(), c.Promote());
+
+    registry.Leave(&a);
+    AVT_CHECK(b.promotions == 1);
+    AVT_CHECK(moved_leads);
+    // leaving "dev" from inside the callback handed the capture on to c
+    AVT_CHECK(c.promotions == 1);
+    AVT_CHECK(registry.SessionCount() == 2);
+
+    // and a promote callback that simply leaves
+    Member d;
+    registry.Join("dev", &d, d.Sink(), [&]() {
+        d.promotions++;
+        registry.Leave(&d);
+    });
+    registry.Leave(&c);
+    AVT_CHECK(d.promotions == 1);
+    AVT_CHECK(registry.SessionCount() == 1);
+
+    registry.Leave(&b);
+    AVT_CHECK(registry.SessionCount() == 0);
+}
+
+AVT_TEST(CaptureSession, NoSinkCallAfterLeave)
+{
+    CaptureSessionRegistry registry;
+    Member a;
+    std::atomic<bool> left{false};
+    std::atomic<int> late{0};
+    auto leader = registry.Join("dev", &a, a.Sink(), a.Promote());
+    int followers = 0;
+    registry.Join("dev", &followers, [&](const struct obs_source_audio *) {
+        if (left)
+            late++;
+    }, {});
+
+    std::atomic<bool> stop{false};
+    std::thread capture([&] {
+        struct obs_source_audio audio = {};
+        while (!stop)
+            leader.session->Output(leader.generation, &audio);
+    });
+    while (a.buffers < 1000)
+        std::this_thread::yield();
+
+    registry.Leave(&followers);
+    left = true;
+    int before = a.buffers;
+    while (a.buffers < before + 1000)
+        std::this_thread::yield();
+    stop = true;
+    capture.join();
+
+    AVT_CHECK(late == 0);
+    registry.Leave(&a);
+}
+
+// run under the rt-check shim by the CaptureSessionRtCheck ctest entry
+AVT_TEST(CaptureSession, OutputIsRealtimeSafeWhileMembersChange)
+{
+    CaptureSessionRegistry registry;
+    Member a, b;
+    auto leader = registry.Join("dev", &a, a.Sink(), a.Promote());
+
+    std::atomic<bool> stop{false};
+    std::thread capture([&] {
+        struct obs_source_audio audio = {};
+        while (!stop) {
+            RealtimeScope realtime;
+            leader.session->Output(leader.generation, &audio);
+        }
+    });
+    for (int i = 0; i < 200; i++) {
+        registry.Join("dev", &b, b.Sink(), b.Promote());
+        registry.Leave(&b);
+    }
+    while (a.buffers < 1000)
+        std::this_thread::yield();
+    stop = true;
+    capture.join();
+
+    AVT_CHECK(leader.session->MemberCount() == 1);
+    registry.Leave(&a);
+}
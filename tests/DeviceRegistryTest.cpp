@@ -0,0 +1,140 @@
+#include "Test.hpp"
+
+#include "DeviceRegistry.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace AVerMedia;
+using namespace std::chrono;
+
+namespace {
+
+// Stands in for the OS enumeration; a scan can be held until released.
+struct FakeEnumerator {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool hold = false;
+    bool scanning = false;
+    std::atomic<int> scans{0};
+
+    DeviceList operator()()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        scanning = true;
+        cond.notify_all();
+        cond.wait(lock, [this] { return !hold; });
+        scanning = false;
+        int n = ++scans;
+        return {{"id" + std::to_string(n), "Device " + std::to_string(n)}};
+    }
+
+    void Hold()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hold = true;
+    }
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hold = false;
+        cond.notify_all();
+    }
+    bool WaitScanning()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, seconds(5), [this] { return scanning; });
+    }
+};
+
+bool WaitGeneration(const DeviceRegistry &registry, uint64_t generation)
+{
+    auto deadline = steady_clock::now() + seconds(5);
+    while (registry.Generation() < generation) {
+        if (steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace
+
+AVT_TEST(DeviceRegistry, SnapshotDoesNotWaitForScan)
+{
+    FakeEnumerator fake;
+    DeviceRegistry registry([&] { return fake(); }, 10);
+    fake.Hold();
+    registry.Start();
+    AVT_CHECK(fake.WaitScanning());
+
+    // the first scan is stuck in the OS, the property callback still returns
+    auto start = steady_clock::now();
+    auto snapshot = registry.Snapshot();
+    AVT_CHECK(steady_clock::now() - start < milliseconds(100));
+    AVT_CHECK(snapshot->empty());
+    AVT_CHECK(registry.Generation() == 0);
+
+    fake.Release();
+    AVT_CHECK(WaitGeneration(registry, 1));
+    snapshot = registry.Snapshot();
+    AVT_CHECK(snapshot->size() == 1);
+    AVT_CHECK(snapshot->front().id == "id1");
+    registry.Stop();
+}
+
+AVT_TEST(DeviceRegistry, NotificationBurstIsOneRescan)
+{
+    FakeEnumerator fake;
+    DeviceRegistry registry([&] { return fake(); }, 100);
+    registry.Start();
+    AVT_CHECK(WaitGeneration(registry, 1));
+
+    // a hotplug fires several notifications well inside the debounce
+    for (int i = 0; i < 10; i++)
+        registry.Invalidate();
+    AVT_CHECK(WaitGeneration(registry, 2));
+    std::this_thread::sleep_for(milliseconds(300));
+
+    AVT_CHECK(fake.scans == 2);
+    AVT_CHECK(registry.Generation() == 2);
+    AVT_CHECK(registry.Snapshot()->front().id == "id2");
+    registry.Stop();
+}
+
+AVT_TEST(DeviceRegistry, InvalidateDuringScanRescansOnce)
+{
+    FakeEnumerator fake;
+    DeviceRegistry registry([&] { return fake(); }, 10);
+    fake.Hold();
+    registry.Start();
+    AVT_CHECK(fake.WaitScanning());
+
+    // the list may already be stale by the time this scan returns
+    registry.Invalidate();
+    registry.Invalidate();
+    fake.Release();
+    AVT_CHECK(WaitGeneration(registry, 2));
+    std::this_thread::sleep_for(milliseconds(100));
+
+    AVT_CHECK(fake.scans == 2);
+    registry.Stop();
+}
+
+AVT_TEST(DeviceRegistry, StopDuringDebounce)
+{
+    FakeEnumerator fake;
+    DeviceRegistry registry([&] { return fake(); }, 10000);
+    registry.Start();
+    AVT_CHECK(WaitGeneration(registry, 1));
+
+    registry.Invalidate();
+    std::this_thread::sleep_for(milliseconds(20));
+    auto start = steady_clock::now();
+    registry.Stop();
+    AVT_CHECK(steady_clock::now() - start < seconds(1));
+    AVT_CHECK(fake.scans == 1);
+}
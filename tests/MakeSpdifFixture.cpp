@@ -0,0 +1,105 @@
+/*
+ * avt-make-fixture: writes a tone as AC-3 in IEC 61937, 16-bit stereo at
+ * 48 kHz, the way a capture card delivers a bitstream and avt-decode reads
+ * it. Used to feed the decoder in tests without committing capture dumps.
+ *
+ *   avt-make-fixture out.spdif [seconds]
+ */
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+}
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#define FIXTURE_RATE 48000
+#define FIXTURE_TONE_HZ 1000.0
+
+static bool encode(AVCodecContext *encoder, AVFormatContext *muxer, AVFrame *frame, AVPacket *packet)
+{
+    if (avcodec_send_frame(encoder, frame) < 0)
+        return false;
+    while (avcodec_receive_packet(encoder, packet) == 0) {
+        packet->stream_index = 0;
+        av_packet_rescale_ts(packet, encoder->time_base, muxer->streams[0]->time_base);
+        if (av_interleaved_write_frame(muxer, packet) < 0)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s out.spdif [seconds]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    double seconds = argc == 3 ? atof(argv[2]) : 4.0;
+
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AC3);
+    if (!codec) {
+        fprintf(stderr, "no AC-3 encoder in this FFmpeg build\n");
+        return 1;
+    }
+    AVCodecContext *encoder = avcodec_alloc_context3(codec);
+    encoder->sample_rate = FIXTURE_RATE;
+    encoder->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    encoder->bit_rate = 192000;
+    encoder->time_base = {1, FIXTURE_RATE};
+    av_channel_layout_default(&encoder->ch_layout, 2);
+    if (avcodec_open2(encoder, codec, nullptr) < 0) {
+        fprintf(stderr, "cannot open the AC-3 encoder\n");
+        return 1;
+    }
+
+    AVFormatContext *muxer = nullptr;
+    if (avformat_alloc_output_context2(&muxer, nullptr, "spdif", path) < 0) {
+        fprintf(stderr, "no spdif muxer in this FFmpeg build\n");
+        return 1;
+    }
+    AVStream *stream = avformat_new_stream(muxer, nullptr);
+    avcodec_parameters_from_context(stream->codecpar, encoder);
+    stream->time_base = encoder->time_base;
+    if (avio_open(&muxer->pb, path, AVIO_FLAG_WRITE) < 0 || avformat_write_header(muxer, nullptr) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    frame->nb_samples = encoder->frame_size;
+    frame->format = encoder->sample_fmt;
+    frame->sample_rate = encoder->sample_rate;
+    av_channel_layout_copy(&frame->ch_layout, &encoder->ch_layout);
+    av_frame_get_buffer(frame, 0);
+    AVPacket *packet = av_packet_alloc();
+
+    bool ok = true;
+    int64_t total = (int64_t)(seconds * FIXTURE_RATE);
+    for (int64_t pts = 0; ok && pts < total; pts += frame->nb_samples) {
+        av_frame_make_writable(frame);
+        for (int i = 0; i < frame->nb_samples; i++) {
+            float sample = (float)(0.5 * sin(2.0 * M_PI * FIXTURE_TONE_HZ * (double)(pts + i) / FIXTURE_RATE));
+            for (int ch = 0; ch < frame->ch_layout.nb_channels; ch++)
+                ((float *)frame->data[ch])[i] = sample;
+        }
+        frame->pts = pts;
+        ok = encode(encoder, muxer, frame, packet);
+    }
+    ok = ok && encode(encoder, muxer, nullptr, packet);
+    ok = ok && av_write_trailer(muxer) == 0;
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avio_closep(&muxer->pb);
+    avformat_free_context(muxer);
+    avcodec_free_context(&encoder);
+
+    if (!ok)
+        fprintf(stderr, "%s: encoding failed\n", path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include "StubVendorSdk.hpp"
+
+#include "AVerMediaVendorSdkLoader.h"
+
+#include <chrono>
+#include <thread>
+
+namespace AVerMedia {
+
+namespace Test {
+
+StubVendorSdkControl &StubVendorSdk()
+{
+    static StubVendorSdkControl control;
+    return control;
+}
+
+} // namespace Test
+
+using Test::StubVendorSdk;
+
+struct VendorSdk::VendorSdkPrivate {};
+
+VendorSdk::VendorSdk(const char *) {}
+
+VendorSdk::~VendorSdk() {}
+
+int VendorSdk::initialize()
+{
+    StubVendorSdk().inits_started++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(StubVendorSdk().init_delay_ms.load()));
+    StubVendorSdk().inits_finished++;
+    return StubVendorSdk().init_result;
+}
+
+int VendorSdk::uninitialize()
+{
+    if (StubVendorSdk().inits_finished != StubVendorSdk().inits_started)
+        StubVendorSdk().uninit_during_init = true;
+    StubVendorSdk().uninits++;
+    return ERROR_OK;
+}
+
+int VendorSdk::setDevice(const char *, const char *, int, int)
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::setPort(int, const char *)
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::closePort()
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::getAudioFormat(int *audioFormat)
+{
+    if (audioFormat)
+        *audioFormat = 0;
+    return ERROR_OK;
+}
+
+int VendorSdk::getNonPcmOnOff(unsigned int *bEnable)
+{
+    if (bEnable)
+        *bEnable = 0;
+    return ERROR_OK;
+}
+
+int VendorSdk::setNonPcmOnOff(int)
+{
+    return ERROR_OK;
+}
+
+int VendorSdk::getSerialNum(unsigned char *, unsigned int, unsigned int *resultLen)
+{
+    if (resultLen)
+        *resultLen = 0;
+    return ERROR_OK;
+}
+
+} // namespace AVerMedia
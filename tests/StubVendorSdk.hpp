@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Test double for the vendor SDK binary, linked into avt-tests instead of
+// the platform SDK. initialize() sleeps for `init_delay_ms` and returns
+// `init_result`; the counters tell what the loader did with it.
+namespace AVerMedia::Test {
+
+struct StubVendorSdkControl {
+    std::atomic<uint32_t> init_delay_ms{0};
+    std::atomic<int> init_result{0};
+
+    std::atomic<int> inits_started{0};
+    std::atomic<int> inits_finished{0};
+    std::atomic<int> uninits{0};
+    std::atomic<bool> uninit_during_init{false};
+
+    void Reset(uint32_t delay_ms, int result)
+    {
+        init_delay_ms = delay_ms;
+        init_result = result;
+        inits_started = 0;
+        inits_finished = 0;
+        uninits = 0;
+        uninit_during_init = false;
+    }
+};
+
+StubVendorSdkControl &StubVendorSdk();
+
+} // namespace AVerMedia::Test
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+// Minimal test registry for the avt-tests runner, see TestMain.cpp. Each
+// suite is registered with ctest on its own.
+namespace AVerMedia::Test {
+
+struct Case {
+    const char *suite;
+    const char *name;
+    void (*run)();
+};
+
+std::vector<Case> &Cases();
+void Fail(const char *file, int line, const char *expr);
+
+struct Register {
+    Register(const char *suite, const char *name, void (*run)()) { Cases().push_back({suite, name, run}); }
+};
+
+} // namespace AVerMedia::Test
+
+#define AVT_TEST(suite, name)                                                                   \
+    static void suite##_##name();                                                               \
+    static AVerMedia::Test::Register suite##_##name##_register(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+// Records the failure and carries on with the test.
+#define AVT_CHECK(expr)                                                \
+    do {                                                               \
+        if (!(expr))                                                   \
+            AVerMedia::Test::Fail(__FILE__, __LINE__, #expr);          \
+    } while (0)
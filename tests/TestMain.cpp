@@ -0,0 +1,46 @@
+#include "Test.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace AVerMedia::Test {
+
+static int failures = 0;
+
+std::vector<Case> &Cases()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+void Fail(const char *file, int line, const char *expr)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    failures++;
+}
+
+} // namespace AVerMedia::Test
+
+using namespace AVerMedia::Test;
+
+// usage: avt-tests [suite], runs every suite without one
+int main(int argc, char **argv)
+{
+    const char *suite = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    for (const Case &test : Cases()) {
+        if (suite && strcmp(suite, test.suite) != 0)
+            continue;
+        int before = failures;
+        test.run();
+        printf("%s %s.%s\n", failures == before ? "ok  " : "FAIL", test.suite, test.name);
+        run++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "no tests in suite %s\n", suite ? suite : "(all)");
+        return 1;
+    }
+    printf("%d tests, %d failed checks\n", run, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include "Test.hpp"
+
+#include "StubVendorSdk.hpp"
+#include "VendorSdkLoader.hpp"
+#include "VendorSdkScheduler.hpp"
+
+#include <obs-module.h>
+
+#include <atomic>
+#include <chrono>
+
+using namespace AVerMedia;
+using namespace std::chrono;
+using Test::StubVendorSdk;
+
+// LoadVendorSdk() asks the current module for its data path
+OBS_DECLARE_MODULE()
+
+namespace {
+
+// Returns once everything queued on the scheduler before it has run.
+void DrainScheduler()
+{
+    GetVendorSdkScheduler().Submit("", [] {}).wait();
+}
+
+} // namespace
+
+AVT_TEST(VendorSdkLoader, ReadyOnceInitializeSucceeds)
+{
+    StubVendorSdk().Reset(100, 0);
+    AVT_CHECK(!WaitVendorSdkReady(0)); // not loaded yet
+
+    LoadVendorSdk();
+    AVT_CHECK(GetVendorSdk() != nullptr);
+    AVT_CHECK(!IsVendorSdkReady()); // initialize() runs in the background
+
+    AVT_CHECK(WaitVendorSdkReady(5000));
+    AVT_CHECK(IsVendorSdkReady());
+    AVT_CHECK(StubVendorSdk().inits_started == 1);
+
+    UnloadVendorSdk();
+    AVT_CHECK(GetVendorSdk() == nullptr);
+    AVT_CHECK(!IsVendorSdkReady());
+    AVT_CHECK(StubVendorSdk().uninits == 1);
+}
+
+AVT_TEST(VendorSdkLoader, WaitTimesOutWhileInitializeRuns)
+{
+    StubVendorSdk().Reset(300, 0);
+    LoadVendorSdk();
+
+    auto start = steady_clock::now();
+    AVT_CHECK(!WaitVendorSdkReady(20));
+    AVT_CHECK(steady_clock::now() - start < milliseconds(250));
+    AVT_CHECK(!IsVendorSdkReady());
+
+    // a later, longer wait still sees it come up
+    AVT_CHECK(WaitVendorSdkReady(5000));
+    UnloadVendorSdk();
+}
+
+AVT_TEST(VendorSdkLoader, FailedInitializeIsNeverReady)
+{
+    StubVendorSdk().Reset(50, -1);
+    LoadVendorSdk();
+
+    AVT_CHECK(!WaitVendorSdkReady(5000));
+    AVT_CHECK(!IsVendorSdkReady());
+    AVT_CHECK(StubVendorSdk().inits_finished == 1);
+    UnloadVendorSdk();
+}
+
+AVT_TEST(VendorSdkLoader, SubmitWhenReadyRunsAfterInitialize)
+{
+    StubVendorSdk().Reset(150, 0);
+    LoadVendorSdk();
+
+    std::atomic<bool> ran{false};
+    std::atomic<bool> after_init{false};
+    SubmitWhenVendorSdkReady("switch:dev", [&] {
+        after_init = StubVendorSdk().inits_finished == 1;
+        ran = true;
+    });
+    AVT_CHECK(!ran);
+
+    DrainScheduler();
+    AVT_CHECK(ran);
+    AVT_CHECK(after_init);
+    UnloadVendorSdk();
+}
+
+AVT_TEST(VendorSdkLoader, SubmitWhenReadyDropsOnFailure)
+{
+    StubVendorSdk().Reset(100, -1);
+    LoadVendorSdk();
+
+    std::atomic<bool> ran{false};
+    SubmitWhenVendorSdkReady("switch:dev", [&] { ran = true; });
+    DrainScheduler();
+    AVT_CHECK(!ran);
+    AVT_CHECK(StubVendorSdk().inits_finished == 1);
+    UnloadVendorSdk();
+
+    // nothing is queued once the SDK is unloaded
+    SubmitWhenVendorSdkReady("switch:dev", [&] { ran = true; });
+    AVT_CHECK(!ran);
+}
+
+AVT_TEST(VendorSdkLoader, UnloadWaitsForInitialize)
+{
+    StubVendorSdk().Reset(200, 0);
+    LoadVendorSdk();
+
+    auto start = steady_clock::now();
+    UnloadVendorSdk();
+    AVT_CHECK(steady_clock::now() - start >= milliseconds(100));
+    AVT_CHECK(StubVendorSdk().inits_finished == 1);
+    AVT_CHECK(StubVendorSdk().uninits == 1);
+    AVT_CHECK(!StubVendorSdk().uninit_during_init);
+}
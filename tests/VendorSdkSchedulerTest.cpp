@@ -0,0 +1,202 @@
+#include "Test.hpp"
+
+#include "VendorSdkScheduler.hpp"
+
+#include <util/platform.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace AVerMedia;
+using namespace std::chrono;
+
+namespace {
+
+// Stands in for the vendor SDK: counts what it is asked and can hold a call
+// until released, like a USB transfer that takes a while.
+struct MockSdk {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool hold = false;
+    bool busy = false;
+    std::atomic<int> switches{0};
+    std::atomic<int> queries{0};
+    std::atomic<bool> non_pcm{true};
+
+    void Call()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        busy = true;
+        cond.notify_all();
+        cond.wait(lock, [this] { return !hold; });
+        busy = false;
+    }
+    void SwitchDevice()
+    {
+        Call();
+        switches++;
+    }
+    bool QueryFormat()
+    {
+        Call();
+        queries++;
+        return non_pcm;
+    }
+
+    void Hold()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hold = true;
+    }
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hold = false;
+        cond.notify_all();
+    }
+    bool WaitBusy()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, seconds(5), [this] { return busy; });
+    }
+};
+
+} // namespace
+
+AVT_TEST(VendorSdkScheduler, QueuedSwitchIsDeduplicated)
+{
+    MockSdk sdk;
+    VendorSdkScheduler scheduler(50);
+    scheduler.Start();
+
+    // keep the worker busy so the switches below stay queued
+    sdk.Hold();
+    scheduler.Submit("", [&] { sdk.Call(); });
+    AVT_CHECK(sdk.WaitBusy());
+
+    auto first = scheduler.Submit("switch:dev", [&] { sdk.SwitchDevice(); });
+    auto second = scheduler.Submit("switch:dev", [&] { sdk.SwitchDevice(); });
+    auto other = scheduler.Submit("switch:other", [&] { sdk.SwitchDevice(); });
+    AVT_CHECK(scheduler.CommandsDeduped() == 1);
+
+    sdk.Release();
+    first.wait();
+    second.wait();
+    other.wait();
+    AVT_CHECK(sdk.switches == 2);
+
+    // only pending commands are merged, a later switch runs again
+    scheduler.Submit("switch:dev", [&] { sdk.SwitchDevice(); }).wait();
+    AVT_CHECK(sdk.switches == 3);
+    AVT_CHECK(scheduler.CommandsRun() == 4);
+    scheduler.Stop();
+}
+
+AVT_TEST(VendorSdkScheduler, ProbeRunsOncePerDeviceAndTtl)
+{
+    MockSdk sdk;
+    VendorSdkScheduler scheduler(100);
+    VendorSdkScheduler::FormatState *state = scheduler.GetFormatState("dev");
+    AVT_CHECK(state == scheduler.GetFormatState("dev"));
+    AVT_CHECK(state->non_pcm == -1);
+
+    // two sources on one device, only one of them is polled
+    std::atomic<int> first_runs{0}, second_runs{0};
+    int first = 0, second = 0;
+    scheduler.RegisterProbe("dev", &first, [&] { first_runs++; return sdk.QueryFormat(); });
+    scheduler.RegisterProbe("dev", &second, [&] { second_runs++; return sdk.QueryFormat(); });
+    scheduler.Start();
+
+    std::this_thread::sleep_for(milliseconds(550));
+    int queries = sdk.queries;
+    AVT_CHECK(queries >= 2);
+    AVT_CHECK(queries <= 7);
+    AVT_CHECK(second_runs == 0);
+    AVT_CHECK(state->IsNonPcm());
+
+    // a fresh result from a command holds the probe off for a TTL
+    scheduler.UnregisterProbe(&first);
+    scheduler.Submit("switch:dev", [&] { state->Publish(false, os_gettime_ns()); }).wait();
+    int before = sdk.queries;
+    std::this_thread::sleep_for(milliseconds(50));
+    AVT_CHECK(sdk.queries == before);
+    AVT_CHECK(!state->IsNonPcm());
+
+    // the remaining probe takes over
+    std::this_thread::sleep_for(milliseconds(250));
+    AVT_CHECK(second_runs > 0);
+    AVT_CHECK(state->IsNonPcm());
+
+    scheduler.UnregisterProbe(&second);
+    scheduler.Stop();
+}
+
+AVT_TEST(VendorSdkScheduler, UnregisterWaitsForRunningProbe)
+{
+    MockSdk sdk;
+    VendorSdkScheduler scheduler(10);
+    int owner = 0, bystander = 0;
+    scheduler.RegisterProbe("dev", &owner, [&] { return sdk.QueryFormat(); });
+    sdk.Hold();
+    scheduler.Start();
+    AVT_CHECK(sdk.WaitBusy());
+
+    // another owner does not wait for it
+    auto start = steady_clock::now();
+    scheduler.UnregisterProbe(&bystander);
+    AVT_CHECK(steady_clock::now() - start < milliseconds(100));
+
+    std::atomic<bool> returned{false};
+    std::thread source([&] {
+        scheduler.UnregisterProbe(&owner);
+        returned = true;
+    });
+    std::this_thread::sleep_for(milliseconds(50));
+    AVT_CHECK(!returned); // the probe still uses what the source owns
+
+    sdk.Release();
+    source.join();
+    AVT_CHECK(returned);
+
+    // and it is not polled again
+    int queries = sdk.queries;
+    std::this_thread::sleep_for(milliseconds(50));
+    AVT_CHECK(sdk.queries == queries);
+    scheduler.Stop();
+}
+
+AVT_TEST(VendorSdkScheduler, ProbeOfCurrentDeviceOnlyQueries)
+{
+    MockSdk sdk;
+    VendorSdkScheduler scheduler(20);
+    // what SharedDeviceOpener::Detect() does
+    auto detect = [&](const std::string &device_key) {
+        if (!scheduler.IsCurrentDevice(device_key)) {
+            sdk.SwitchDevice();
+            scheduler.SetCurrentDevice(device_key);
+        }
+        return sdk.QueryFormat();
+    };
+    int owner = 0;
+    scheduler.RegisterProbe("a", &owner, [&] { return detect("a"); });
+    scheduler.Start();
+
+    std::this_thread::sleep_for(milliseconds(150));
+    AVT_CHECK(sdk.switches == 1);
+    AVT_CHECK(sdk.queries >= 2);
+
+    // another device's switch makes the next probe switch back once
+    scheduler.Submit("switch:b", [&] {
+        sdk.SwitchDevice();
+        scheduler.SetCurrentDevice("b");
+    }).wait();
+    std::this_thread::sleep_for(milliseconds(150));
+    AVT_CHECK(sdk.switches == 3);
+
+    scheduler.UnregisterProbe(&owner);
+    scheduler.Stop();
+    AVT_CHECK(!scheduler.IsCurrentDevice("a"));
+}
@@ -0,0 +1,312 @@
+/*
+ * avt-decode: runs a capture file through the plugin's decode pipeline
+ * (FfmpegAudioDecode: IEC 61937 burst extraction, decoding and the
+ * conversion to OBS audio) as fast as it can and reports how it went.
+ *
+ *   avt-decode [-p frames] [-P profile] [-i] [-r] [-o out.wav] [-t trace.json] capture.pcm
+ *
+ *   -p FRAMES   frames handed over per call, like a capture period (default 1024)
+ *   -P PROFILE  decode profile: quality (default), balanced, low-cpu, or all
+ *               to run the file once per profile and compare their cost
+ *   -i          decode inline, on the thread that hands over the input
+ *   -r          hand over the input in real time and report the latency from
+ *               handing over a period to the output it completes
+ *   -o PATH     also write the decoded audio, through the PCM debug tap
+ *   -t PATH     record a pipeline trace (Chrome trace JSON, opens in Perfetto)
+ *
+ * The input is 16-bit stereo as captured, e.g. a "Record raw capture" dump.
+ * Prints the speed relative to real time, the decode cost per frame, how
+ * often the decoder had to recover or resync and a checksum of the decoded
+ * audio, so runs against different decoder changes or FFmpeg builds can be
+ * compared.
+ * Runs under perf without OBS. The CPU
+ * cost is the CPU time of the decode thread and of the thread handing over
+ * the input, which does the decoding inline, per second of input.
+ */
+
+#include <obs-module.h>
+#include <plugin-support.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "AudioDebugTap.hpp"
+#include "FfmpegAudioDecode.hpp"
+#include "LatencyHistogram.hpp"
+#include "PipelineTrace.hpp"
+#include "ThreadTuning.hpp"
+
+// the decoder looks up module text and config paths, which are empty here
+OBS_DECLARE_MODULE()
+OBS_MODULE_USE_DEFAULT_LOCALE("avt-decode", "en-US")
+
+#define INPUT_RATE         48000
+#define INPUT_FRAME_BYTES  (2 * sizeof(int16_t))
+#define DRAIN_TIMEOUT_MS   30000
+
+using namespace AVerMedia;
+
+namespace {
+
+struct OutputStats {
+    uint64_t frames = 0;   // decoded frames handed to the sink
+    uint64_t samples = 0;  // per channel
+    uint64_t bytes = 0;
+    uint64_t checksum = 0xcbf29ce484222325ULL; // FNV-1a 64
+    uint32_t sample_rate = 0;
+    uint32_t channels = 0;
+
+    void Hash(const uint8_t *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++) {
+            checksum ^= data[i];
+            checksum *= 0x100000001b3ULL;
+        }
+        bytes += size;
+    }
+
+    // same bytes OBS would receive from obs_source_output_audio()
+    void Add(const struct obs_source_audio *audio)
+    {
+        uint32_t ch = get_audio_channels(audio->speakers);
+        size_t planes = is_audio_planar(audio->format) ? ch : 1;
+        size_t plane_size = (size_t)audio->frames * get_audio_bytes_per_channel(audio->format) *
+                            (planes == 1 ? ch : 1);
+        for (size_t i = 0; i < planes; i++)
+            Hash(audio->data[i], plane_size);
+
+        frames++;
+        samples += audio->frames;
+        sample_rate = audio->samples_per_sec;
+        channels = ch;
+    }
+};
+
+bool read_file(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    uint8_t chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + got);
+    fclose(file);
+    return true;
+}
+
+struct RunResult {
+    OutputStats stats;
+    bool drained = false;
+    double wall_s = 0;
+    uint64_t cpu_ns = 0;
+    bool stayed_inline = false;
+    DecoderStats decoder;
+    uint64_t mean_us = 0, p50_us = 0, p95_us = 0, max_us = 0;
+    LatencyHistogram latency;
+};
+
+struct RunConfig {
+    size_t period = 1024;
+    DecodeProfile profile = DecodeProfile::Quality;
+    bool inline_decode = false;
+    bool realtime = false;
+};
+
+// one pass over the input through a fresh decoder
+void run(const std::vector<uint8_t> &input, const RunConfig &config, AudioDebugTaps *taps,
+         RunResult &result)
+{
+    DecodeOptions options;
+    options.profile = config.profile;
+    options.inline_decode = config.inline_decode;
+
+    // time the period that completes a frame was handed over
+    std::atomic<uint64_t> handed_over{0};
+    auto sink = [&result, &handed_over](const struct obs_source_audio *audio) {
+        result.latency.Record((os_gettime_ns() - handed_over.load()) / 1000);
+        result.stats.Add(audio);
+    };
+    // no device key: the stream parameter cache stays out of the way
+    FfmpegAudioDecode decode(sink, taps, options);
+    decode.SetInputRate(INPUT_RATE);
+
+    uint64_t start = os_gettime_ns();
+    uint64_t feeder_cpu = current_thread_cpu_time_ns();
+    const size_t chunk = config.period * INPUT_FRAME_BYTES;
+    for (size_t pos = 0; pos < input.size(); pos += chunk) {
+        size_t size = std::min(chunk, input.size() - pos);
+        if (config.realtime) {
+            // a capture period is handed over once it is complete
+            uint64_t frames = (pos + size) / INPUT_FRAME_BYTES;
+            os_sleepto_ns(start + util_mul_div64(frames, UINT64_C(1000000000), INPUT_RATE));
+        } else {
+            while (decode.QueueFree() < size)
+                os_sleep_ms(1); // the decoder is behind, do not drop
+        }
+        handed_over = os_gettime_ns();
+        decode.OnEncodedAudioData(const_cast<uint8_t *>(input.data()) + pos, size, 0);
+    }
+    result.stayed_inline = decode.DecodingInline();
+    result.drained = decode.Drain(DRAIN_TIMEOUT_MS);
+    result.wall_s = (double)(os_gettime_ns() - start) / 1e9;
+    result.cpu_ns = decode.ThreadCpuTimeNs() + (current_thread_cpu_time_ns() - feeder_cpu);
+    result.decoder = decode.Stats();
+
+    const LatencyHistogram &cost = decode.DecodeCost();
+    result.mean_us = cost.MeanUs();
+    result.p50_us = cost.PercentileUs(50);
+    result.p95_us = cost.PercentileUs(95);
+    result.max_us = cost.MaxUs();
+}
+
+void print_result(const RunResult &result, double input_s, const RunConfig &config)
+{
+    const OutputStats &stats = result.stats;
+    if (config.inline_decode)
+        printf("mode:       %s\n", result.stayed_inline ? "inline" : "inline, fell back to the decode thread");
+    printf("output:     %" PRIu64 " frames, %" PRIu64 " samples, %u ch, %u Hz, %.3f s\n",
+           stats.frames, stats.samples, stats.channels, stats.sample_rate,
+           stats.sample_rate ? (double)stats.samples / stats.sample_rate : 0.0);
+    printf("speed:      %.1fx realtime (%.3f s)\n",
+           result.wall_s > 0 ? input_s / result.wall_s : 0.0, result.wall_s);
+    printf("cpu:        %.2f ms per second of input\n", (double)result.cpu_ns / 1e6 / input_s);
+    printf("frame cost: mean %" PRIu64 " us, p50 %" PRIu64 " us, p95 %" PRIu64
+           " us, max %" PRIu64 " us\n",
+           result.mean_us, result.p50_us, result.p95_us, result.max_us);
+    if (config.realtime) {
+        const LatencyHistogram &latency = result.latency;
+        printf("latency:    mean %" PRIu64 " us, p50 %" PRIu64 " us, p95 %" PRIu64
+               " us, max %" PRIu64 " us\n",
+               latency.MeanUs(), latency.PercentileUs(50), latency.PercentileUs(95),
+               latency.MaxUs());
+    }
+    const DecoderStats &decoder = result.decoder;
+    printf("decoder:    %s, %" PRIu64 " probe failures, %" PRIu64 " decode errors, %" PRIu64
+           " restarts, %" PRIu64 " backoffs, %" PRIu64 " codec changes\n",
+           decoder_state_name(decoder.state), decoder.probe_failures, decoder.decode_errors,
+           decoder.restarts, decoder.backoffs, decoder.codec_switches);
+    if (decoder.lost_bursts) {
+        printf("resync:     %" PRIu64 " bursts lost in %" PRIu64 " resyncs, %" PRIu64
+               " ms concealed, worst %u ms\n",
+               decoder.lost_bursts, decoder.resyncs, decoder.concealed_ms, decoder.resync_ms_max);
+    }
+    printf("checksum:   %016" PRIx64 " (%" PRIu64 " bytes)\n", stats.checksum, stats.bytes);
+}
+
+void usage(const char *self)
+{
+    fprintf(stderr,
+            "usage: %s [-p frames] [-P quality|balanced|low-cpu|all] [-i] [-r] [-o out.wav]\n"
+            "       [-t trace.json] capture.pcm\n",
+            self);
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    RunConfig config;
+    const char *output = nullptr;
+    const char *trace = nullptr;
+    std::vector<DecodeProfile> profiles = {DecodeProfile::Quality};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:P:iro:t:")) != -1) {
+        switch (opt) {
+        case 'p':
+            config.period = strtoul(optarg, nullptr, 10);
+            break;
+        case 'i':
+            config.inline_decode = true;
+            break;
+        case 'r':
+            config.realtime = true;
+            break;
+        case 'P':
+            if (strcmp(optarg, "all") == 0) {
+                profiles = {DecodeProfile::Quality, DecodeProfile::Balanced, DecodeProfile::LowCpu};
+            } else if (!parse_decode_profile(optarg, profiles[0])) {
+                usage(argv[0]);
+            }
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 't':
+            trace = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || config.period == 0 || (output && profiles.size() > 1))
+        usage(argv[0]);
+
+    std::vector<uint8_t> input;
+    if (!read_file(argv[optind], input))
+        return 1;
+    input.resize(input.size() - input.size() % INPUT_FRAME_BYTES);
+    if (input.empty()) {
+        fprintf(stderr, "%s: no audio\n", argv[optind]);
+        return 1;
+    }
+    double input_s = (double)(input.size() / INPUT_FRAME_BYTES) / INPUT_RATE;
+
+    AudioDebugTaps taps;
+    if (output && !taps.pcm.Start(output, AudioDebugTap::Container::Wav)) {
+        fprintf(stderr, "%s: cannot write\n", output);
+        return 1;
+    }
+
+    if (trace)
+        PipelineTrace::Start();
+
+    printf("input:      %.3f s\n", input_s);
+    // LatencyHistogram is not movable, results stay where they are
+    std::vector<std::unique_ptr<RunResult>> results;
+    for (DecodeProfile profile : profiles) {
+        if (profiles.size() > 1)
+            printf("\n[%s]\n", decode_profile_name(profile));
+        config.profile = profile;
+        results.push_back(std::make_unique<RunResult>());
+        run(input, config, &taps, *results.back());
+        print_result(*results.back(), input_s, config);
+    }
+    taps.StopAll();
+    if (trace) {
+        PipelineTrace::Stop();
+        PipelineTrace::WriteJson(trace);
+    }
+
+    if (results.size() > 1) {
+        printf("\n%-10s %12s %10s %10s\n", "profile", "cpu ms/s", "vs first", "mean us");
+        for (size_t i = 0; i < results.size(); i++) {
+            double cpu = (double)results[i]->cpu_ns / 1e6 / input_s;
+            double base = (double)results[0]->cpu_ns / 1e6 / input_s;
+            printf("%-10s %12.2f %9.0f%% %10" PRIu64 "\n", decode_profile_name(profiles[i]), cpu,
+                   base > 0 ? cpu * 100.0 / base : 0.0, results[i]->mean_us);
+        }
+    }
+
+    for (const auto &result : results) {
+        if (!result->drained) {
+            fprintf(stderr, "decoder did not finish within %d ms\n", DRAIN_TIMEOUT_MS);
+            return 1;
+        }
+        if (!result->stats.frames)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * rt-check shim: LD_PRELOAD library that fails a test run when the plugin's
+ * real-time capture path allocates, blocks on a lock or logs. Waiting on a
+ * condition variable needs a locked mutex, so the mutex hook covers it.
+ *
+ *   LD_PRELOAD=./libavt-rt-check.so obs ...
+ *
+ * Threads are marked by RealtimeScope (src/RealtimeCheck.hpp) in builds
+ * configured with -DENABLE_RT_CHECK=ON. Environment:
+ *
+ *   AVT_RT_CHECK_WARMUP  scope entries to ignore before checking (default 100)
+ *   AVT_RT_CHECK_ABORT   abort() on the first violation, for a debugger
+ *
+ * If any violation was seen, the process exit status is forced to 3.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RT_EXPORT __attribute__((visibility("default")))
+#define MAX_REPORTED 20
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread int rt_depth;
+static __thread int exempt_depth;
+static __thread bool in_report;
+
+static atomic_ulong scope_entries;
+static atomic_ulong violations;
+static unsigned long warmup = 100;
+static bool abort_on_violation;
+
+static void write_str(const char *str)
+{
+	ssize_t unused = write(STDERR_FILENO, str, strlen(str));
+	(void)unused;
+}
+
+static void report(const char *what)
+{
+	if (rt_depth == 0 || exempt_depth > 0 || in_report)
+		return;
+	if (atomic_load(&scope_entries) <= warmup)
+		return;
+
+	in_report = true;
+	unsigned long count = atomic_fetch_add(&violations, 1) + 1;
+	if (count <= MAX_REPORTED) {
+		void *frames[32];
+		write_str("[rt-check] violation: ");
+		write_str(what);
+		write_str(" on real-time thread\n");
+		backtrace_symbols_fd(frames, backtrace(frames, 32), STDERR_FILENO);
+	}
+	if (abort_on_violation)
+		abort();
+	in_report = false;
+}
+
+RT_EXPORT void avt_rt_check_enter(void)
+{
+	if (rt_depth++ == 0)
+		atomic_fetch_add(&scope_entries, 1);
+}
+
+RT_EXPORT void avt_rt_check_leave(void)
+{
+	rt_depth--;
+}
+
+RT_EXPORT void avt_rt_check_exempt_begin(void)
+{
+	exempt_depth++;
+}
+
+RT_EXPORT void avt_rt_check_exempt_end(void)
+{
+	exempt_depth--;
+}
+
+/* allocator ---------------------------------------------------------------- */
+
+RT_EXPORT void *malloc(size_t size)
+{
+	report("malloc");
+	return __libc_malloc(size);
+}
+
+RT_EXPORT void *calloc(size_t count, size_t size)
+{
+	report("calloc");
+	return __libc_calloc(count, size);
+}
+
+RT_EXPORT void *realloc(void *ptr, size_t size)
+{
+	report("realloc");
+	return __libc_realloc(ptr, size);
+}
+
+RT_EXPORT void free(void *ptr)
+{
+	if (ptr)
+		report("free");
+	__libc_free(ptr);
+}
+
+RT_EXPORT int posix_memalign(void **out, size_t alignment, size_t size)
+{
+	report("posix_memalign");
+	void *ptr = __libc_memalign(alignment, size);
+	if (!ptr)
+		return 12; /* ENOMEM */
+	*out = ptr;
+	return 0;
+}
+
+RT_EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+	report("aligned_alloc");
+	return __libc_memalign(alignment, size);
+}
+
+/* locks -------------------------------------------------------------------- */
+
+#define REAL(name) \
+	static __typeof__(name) *real_##name; \
+	if (!real_##name) \
+		real_##name = (__typeof__(name) *)dlsym(RTLD_NEXT, #name)
+
+RT_EXPORT int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	REAL(pthread_mutex_lock);
+	report("pthread_mutex_lock");
+	return real_pthread_mutex_lock(mutex);
+}
+
+RT_EXPORT int pthread_rwlock_rdlock(pthread_rwlock_t *lock)
+{
+	REAL(pthread_rwlock_rdlock);
+	report("pthread_rwlock_rdlock");
+	return real_pthread_rwlock_rdlock(lock);
+}
+
+RT_EXPORT int pthread_rwlock_wrlock(pthread_rwlock_t *lock)
+{
+	REAL(pthread_rwlock_wrlock);
+	report("pthread_rwlock_wrlock");
+	return real_pthread_rwlock_wrlock(lock);
+}
+
+/* logging (libobs) --------------------------------------------------------- */
+
+extern void blogva(int log_level, const char *format, va_list args);
+
+RT_EXPORT void blogva(int log_level, const char *format, va_list args)
+{
+	REAL(blogva);
+	report("blogva");
+	if (real_blogva)
+		real_blogva(log_level, format, args);
+}
+
+/* setup -------------------------------------------------------------------- */
+
+__attribute__((constructor)) static void rt_check_init(void)
+{
+	const char *value = getenv("AVT_RT_CHECK_WARMUP");
+	if (value)
+		warmup = strtoul(value, NULL, 10);
+	abort_on_violation = getenv("AVT_RT_CHECK_ABORT") != NULL;
+
+	/* the first backtrace() loads libgcc, do it while nothing is checked */
+	void *frames[1];
+	backtrace(frames, 1);
+}
+
+__attribute__((destructor)) static void rt_check_exit(void)
+{
+	unsigned long count = atomic_load(&violations);
+	char msg[128];
+	snprintf(msg, sizeof(msg), "[rt-check] %lu scope entries, %lu violations\n",
+		 atomic_load(&scope_entries), count);
+	write_str(msg);
+	if (count > 0)
+		_exit(3);
+}
@@ -0,0 +1,221 @@
+/*
+ * avt-shm-producer: feeds a raw capture into the shared memory ring read by
+ * avt_shm_source, paced at the sample rate, the way a capture helper would.
+ *
+ *   avt-shm-producer [options] capture.pcm|-
+ *
+ *   -n NAME     shared memory name (default /avt-capture)
+ *   -r RATE     sample rate (default 48000)
+ *   -c CHANNELS interleaved channels (default 2)
+ *   -f FORMAT   auto, pcm or iec61937 (default auto)
+ *   -p FRAMES   frames per record (default 1024)
+ *   -s KIB      ring size in KiB, a power of two (default 256)
+ *   -l          loop the file
+ *
+ * Input is signed 16-bit little-endian, e.g. a "Record raw capture" dump.
+ * Records are read from the file straight into the ring. The object is
+ * unlinked on exit, so a running source notices and waits for the next run.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "avt-shm-ring.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ns / 1000000000ULL);
+	ts.tv_nsec = (long)(ns % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop)
+		;
+}
+
+static void usage(const char *self)
+{
+	fprintf(stderr,
+		"usage: %s [-n name] [-r rate] [-c channels] [-f auto|pcm|iec61937]\n"
+		"       [-p frames] [-s kib] [-l] capture.pcm|-\n",
+		self);
+	exit(2);
+}
+
+static struct avt_shm_header *create_ring(const char *name, uint64_t capacity, uint32_t format,
+					  uint32_t rate, uint32_t channels, size_t *size)
+{
+	*size = AVT_SHM_HEADER_SIZE + capacity;
+
+	/* a new object each run, so a consumer of the old one can tell */
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		perror("shm_open");
+		return NULL;
+	}
+	if (ftruncate(fd, (off_t)*size) != 0) {
+		perror("ftruncate");
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	struct avt_shm_header *h = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED) {
+		perror("mmap");
+		shm_unlink(name);
+		return NULL;
+	}
+
+	h->version = AVT_SHM_VERSION;
+	h->header_size = AVT_SHM_HEADER_SIZE;
+	h->format = format;
+	h->sample_rate = rate;
+	h->channels = channels;
+	h->capacity = capacity;
+	h->producer_pid = (int32_t)getpid();
+	__atomic_store_n(&h->magic, AVT_SHM_MAGIC, __ATOMIC_RELEASE);
+	return h;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = AVT_SHM_DEFAULT_NAME;
+	uint32_t rate = 48000;
+	uint32_t channels = 2;
+	uint32_t format = AVT_SHM_FORMAT_AUTO;
+	uint32_t period = 1024;
+	uint64_t capacity = 256 * 1024;
+	bool loop = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:c:f:p:s:l")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'r':
+			rate = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			channels = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			if (strcmp(optarg, "auto") == 0)
+				format = AVT_SHM_FORMAT_AUTO;
+			else if (strcmp(optarg, "pcm") == 0)
+				format = AVT_SHM_FORMAT_PCM;
+			else if (strcmp(optarg, "iec61937") == 0)
+				format = AVT_SHM_FORMAT_IEC61937;
+			else
+				usage(argv[0]);
+			break;
+		case 'p':
+			period = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			capacity = strtoull(optarg, NULL, 10) * 1024;
+			break;
+		case 'l':
+			loop = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !rate || !channels || !period || capacity < 4096 ||
+	    (capacity & (capacity - 1)))
+		usage(argv[0]);
+
+	const char *path = argv[optind];
+	FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+	if (!in) {
+		perror(path);
+		return 1;
+	}
+
+	size_t frame_bytes = channels * sizeof(int16_t);
+	uint32_t record_bytes = (uint32_t)(period * frame_bytes);
+	if (avt_shm_record_bytes(record_bytes) > capacity / 2) {
+		fprintf(stderr, "%u frames per record do not fit a %llu KiB ring\n", period,
+			(unsigned long long)(capacity / 1024));
+		return 2;
+	}
+
+	size_t size;
+	struct avt_shm_header *h = create_ring(name, capacity, format, rate, channels, &size);
+	if (!h)
+		return 1;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	fprintf(stderr, "%s: %u Hz, %u channels, %u frames per record\n", name, rate, channels,
+		period);
+
+	uint64_t start = now_ns();
+	uint64_t frames_sent = 0;
+	uint64_t dropped = 0;
+	uint32_t flags = 0;
+	void *scratch = malloc(record_bytes);
+
+	while (!stop) {
+		uint64_t ts = start + frames_sent * 1000000000ULL / rate;
+		sleep_until(ts + (uint64_t)period * 1000000000ULL / rate);
+
+		void *dst = avt_shm_reserve(h, record_bytes);
+		if (!dst) {
+			/* consumer is behind or absent, drop like a capture device */
+			dropped++;
+			flags = AVT_SHM_RECORD_DISCONTINUITY;
+			frames_sent += period;
+			if (fread(scratch, 1, record_bytes, in) == 0)
+				break;
+			continue;
+		}
+
+		size_t got = fread(dst, 1, record_bytes, in);
+		if (got < record_bytes && loop && in != stdin) {
+			rewind(in);
+			got += fread((uint8_t *)dst + got, 1, record_bytes - got, in);
+		}
+		got -= got % frame_bytes;
+		if (got == 0)
+			break;
+
+		avt_shm_commit(h, (uint32_t)got, flags, ts);
+		flags = 0;
+		frames_sent += got / frame_bytes;
+	}
+
+	fprintf(stderr, "%s: sent %llu frames, dropped %llu records\n", name,
+		(unsigned long long)frames_sent, (unsigned long long)dropped);
+	shm_unlink(name);
+	munmap(h, size);
+	free(scratch);
+	if (in != stdin)
+		fclose(in);
+	return 0;
+}